@@ -109,6 +109,21 @@ static struct option long_options[] =
 	{"custom-style-name", required_argument, 0, 49},
 	{"highlight-odd-rec", no_argument, 0, 50},
 	{"hide-header-line", no_argument, 0, 51},
+	{"no-mmap", no_argument, 0, 52},
+	{"no-background-load", no_argument, 0, 53},
+	{"csv-sample-rows", required_argument, 0, 54},
+	{"prepared-query", no_argument, 0, 55},
+	{"follow", no_argument, 0, 56},
+	{"follow-rows", required_argument, 0, 57},
+	{"follow-mb", required_argument, 0, 58},
+	{"benchmark", no_argument, 0, 59},
+	{"benchmark-rows", required_argument, 0, 60},
+	{"benchmark-columns", required_argument, 0, 61},
+	{"benchmark-unicode", required_argument, 0, 62},
+	{"stats-file", required_argument, 0, 63},
+	{"memory-limit", required_argument, 0, 64},
+	{"compress-rows", no_argument, 0, 65},
+	{"snapshot", no_argument, 0, 66},
 	{0, 0, 0, 0}
 };
 
@@ -315,7 +330,12 @@ readargs(char **argv,
 					fprintf(stdout, "  --clipboard-app=NUM      specify app used by copy to clipboard (1, 2, 3)\n");
 					fprintf(stdout, "  --interactive            force interactive mode\n");
 					fprintf(stdout, "  --ignore_file_suffix     don't try to deduce format from file suffix\n");
+					fprintf(stdout, "  --memory-limit=N         evict rows over N MB to temporary file\n");
+					fprintf(stdout, "  --compress-rows          compress rows that are not displayed\n");
+					fprintf(stdout, "  --snapshot               cache parsed file for fast reopen\n");
 					fprintf(stdout, "  --ni                     not interactive mode (only for csv and query)\n");
+					fprintf(stdout, "  --no-background-load     don't read input in background thread\n");
+					fprintf(stdout, "  --no-mmap                don't map input file to memory\n");
 					fprintf(stdout, "  --no-mouse               don't use own mouse handling\n");
 					fprintf(stdout, "  --no-progressive-load    don't use progressive data load\n");
 					fprintf(stdout, "  --no-sigint-search-reset\n");
@@ -330,6 +350,9 @@ readargs(char **argv,
 					fprintf(stdout, "  --quit-on-f3             exit on F3 like mc viewers\n");
 					fprintf(stdout, "  --rr=ROWNUM              rows reserved for specific purposes\n");
 					fprintf(stdout, "  --stream                 read input forever\n");
+					fprintf(stdout, "  --follow                 read input forever, append rows and hold only last rows\n");
+					fprintf(stdout, "  --follow-rows=N          in follow mode hold last N rows (default 100000)\n");
+					fprintf(stdout, "  --follow-mb=N            in follow mode hold last N MB of rows\n");
 					fprintf(stdout, "  -X, --reprint-on-exit    preserve content after exit\n");
 					fprintf(stdout, "\nOutput format options:\n");
 					fprintf(stdout, "  -a, --ascii decor        force ascii\n");
@@ -367,12 +390,15 @@ readargs(char **argv,
 					fprintf(stdout, "  --csv                    input stream has csv format\n");
 					fprintf(stdout, "  --csv-separator          char used as field separator\n");
 					fprintf(stdout, "  --csv-header [on/off]    specify header line usage\n");
+					fprintf(stdout, "  --csv-sample-rows=N      format csv, tsv and query result progressively,\n");
+					fprintf(stdout, "                           widths are calculated from first N rows\n");
 					fprintf(stdout, "  --skip-columns-like=\"SPACE SEPARATED STRING LIST\"\n");
 					fprintf(stdout, "                           columns with substr in name are ignored\n");
 					fprintf(stdout, "  --tsv                    input stream has tsv format\n");
 					fprintf(stdout, "\nWatch mode options:\n");
 					fprintf(stdout, "  -q, --query=QUERY        execute query\n");
 					fprintf(stdout, "  -w, --watch time         the query (or read file) is repeated every time (sec)\n");
+					fprintf(stdout, "  --prepared-query         watched query is prepared only once\n");
 					fprintf(stdout, "\nConnection options\n");
 					fprintf(stdout, "  -d, --dbname=DBNAME      database name\n");
 					fprintf(stdout, "  -h, --host=HOSTNAME      database server host (default: \"local socket\")\n");
@@ -381,7 +407,12 @@ readargs(char **argv,
 					fprintf(stdout, "  -W, --password           force password prompt\n");
 					fprintf(stdout, "\nDebug options:\n");
 					fprintf(stdout, "  --log=FILE               log debug info to file\n");
+					fprintf(stdout, "  --stats-file=FILE        save timers and counters in json format to file at exit\n");
 					fprintf(stdout, "  --wait=NUM               wait NUM seconds to allow attach from a debugger\n");
+					fprintf(stdout, "  --benchmark              run benchmark over generated data and print results\n");
+					fprintf(stdout, "  --benchmark-rows=N       rows of generated data (default 100000)\n");
+					fprintf(stdout, "  --benchmark-columns=N    columns of generated data (default 10)\n");
+					fprintf(stdout, "  --benchmark-unicode=N    percent of text values with non ascii chars (default 10)\n");
 					fprintf(stdout, "\n");
 					fprintf(stdout, "pspg shares lot of key commands with less pager or vi editor.\n");
 
@@ -684,6 +715,98 @@ readargs(char **argv,
 			case 51:
 				opts->hide_header_line = true;
 				break;
+			case 52:
+				opts->mmap_load = false;
+				break;
+			case 53:
+				opts->background_load = false;
+				break;
+			case 54:
+				n = atoi(optarg);
+				if (n < 0)
+				{
+					state->errstr = "csv sample rows should not be negative";
+					return false;
+				}
+				opts->csv_sample_rows = n;
+				break;
+			case 55:
+				opts->prepared_query = true;
+				break;
+			case 56:
+				opts->follow = true;
+				state->stream_mode = true;
+				break;
+			case 57:
+				n = atoi(optarg);
+				if (n < 0)
+				{
+					state->errstr = "follow rows should not be negative";
+					return false;
+				}
+				opts->follow_rows = n;
+				opts->follow = true;
+				state->stream_mode = true;
+				break;
+			case 58:
+				n = atoi(optarg);
+				if (n < 0)
+				{
+					state->errstr = "follow mb should not be negative";
+					return false;
+				}
+				opts->follow_mb = n;
+				opts->follow = true;
+				state->stream_mode = true;
+				break;
+			case 59:
+				state->benchmark = true;
+				break;
+			case 60:
+				n = atoi(optarg);
+				if (n < 1)
+				{
+					state->errstr = "benchmark rows should be positive";
+					return false;
+				}
+				state->benchmark_rows = n;
+				break;
+			case 61:
+				n = atoi(optarg);
+				if (n < 3 || n > 1000)
+				{
+					state->errstr = "benchmark columns should be between 3 and 1000";
+					return false;
+				}
+				state->benchmark_columns = n;
+				break;
+			case 62:
+				n = atoi(optarg);
+				if (n < 0 || n > 100)
+				{
+					state->errstr = "benchmark unicode should be between 0 and 100 (percent)";
+					return false;
+				}
+				state->benchmark_unicode = n;
+				break;
+			case 63:
+				opts->stats_pathname = sstrdup(optarg);
+				break;
+			case 64:
+				n = atoi(optarg);
+				if (n < 1)
+				{
+					state->errstr = "memory limit should be positive number (MB)";
+					return false;
+				}
+				opts->memory_limit_mb = n;
+				break;
+			case 65:
+				opts->compress_rows = true;
+				break;
+			case 66:
+				opts->snapshot = true;
+				break;
 
 			default:
 				{
@@ -779,6 +902,16 @@ args_are_consistent(Options *opts, StateData *state)
 		return false;
 	}
 
+	if (opts->follow && (opts->querystream || opts->query ||
+						 opts->csv_format || opts->tsv_format))
+	{
+		state->errstr = "follow mode can be used only for plain or psql stream";
+		return false;
+	}
+
+	if (opts->follow && opts->follow_rows == 0 && opts->follow_mb == 0)
+		opts->follow_rows = 100000;
+
 	if (opts->csv_skip_columns_like && (opts->csv_header != '+' && !opts->query))
 	{
 		state->errstr = "skipping columns requires header row (option \"csv-header on\")";
@@ -0,0 +1,601 @@
+/*-------------------------------------------------------------------------
+ *
+ * bench.c
+ *	  built-in benchmark of main operations over synthetic data
+ *
+ * Portions Copyright (c) 2017-2021 Pavel Stehule
+ *
+ * IDENTIFICATION
+ *	  src/bench.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <langinfo.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "inputs.h"
+#include "pspg.h"
+#include "themes.h"
+#include "unicode.h"
+
+#define BENCH_SEARCH_HIT			"benchmark_marker"
+#define BENCH_SEARCH_MISS			"no-such-value"
+
+#define BENCH_SCREEN_ROWS			60
+#define BENCH_SCREEN_COLS			240
+#define BENCH_SCROLL_STEPS			2000
+
+/*
+ * Benchmark doesn't use an interactive mode, so it should not touch
+ * real terminal. The results are printed to stdout in tsv format, so
+ * they can be simply compared by scripts.
+ */
+typedef struct
+{
+	int		rows;
+	int		columns;
+	int		unicode;
+	struct timespec start;
+} BenchContext;
+
+static void
+bench_start(BenchContext *ctx)
+{
+	clock_gettime(CLOCK_MONOTONIC, &ctx->start);
+}
+
+static void
+bench_stop(BenchContext *ctx, const char *test)
+{
+	struct timespec stop;
+	double	ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	ms = (stop.tv_sec - ctx->start.tv_sec) * 1000.0 +
+		 (stop.tv_nsec - ctx->start.tv_nsec) / 1000000.0;
+
+	fprintf(stdout, "%s\t%d\t%d\t%d\t%.3f\n",
+			test, ctx->rows, ctx->columns, ctx->unicode, ms);
+	fflush(stdout);
+
+	log_row("benchmark %s %.3f ms", test, ms);
+}
+
+/*
+ * Returns pseudo random number for the cell. The values should be
+ * same for every run, so the results of benchmarks are comparable.
+ */
+static unsigned int
+cell_hash(int rowno, int colno)
+{
+	unsigned int h = (unsigned int) rowno * 2654435761U ^ (unsigned int) colno * 40503U;
+
+	h ^= h >> 15;
+	h *= 2246822519U;
+	h ^= h >> 13;
+
+	return h;
+}
+
+static const char *ascii_words[] = {
+	"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel"
+};
+
+static const char *unicode_words[] = {
+	"žluťoučký", "kůň", "úpěl", "ďábelské", "ódy", "日本語", "中文字", "한국어"
+};
+
+/*
+ * The columns are integer, text and decimal number. First column
+ * is row number. The text of last row contains searched pattern.
+ */
+static bool
+cell_is_numeric(int colno)
+{
+	return colno % 3 != 1;
+}
+
+static void
+cell_value(BenchContext *ctx, int rowno, int colno, char *buffer, size_t size)
+{
+	unsigned int h = cell_hash(rowno, colno);
+
+	switch (colno % 3)
+	{
+		case 0:
+			if (colno == 0)
+				snprintf(buffer, size, "%d", rowno + 1);
+			else
+				snprintf(buffer, size, "%u", h % 1000000);
+			break;
+
+		case 1:
+			if (rowno == ctx->rows - 1 && colno == 1)
+				snprintf(buffer, size, "%s", BENCH_SEARCH_HIT);
+			else if ((int) (h % 100) < ctx->unicode)
+				snprintf(buffer, size, "%s %s",
+						 unicode_words[h % 8], unicode_words[(h >> 8) % 8]);
+			else
+				snprintf(buffer, size, "%s %s %u",
+						 ascii_words[h % 8], ascii_words[(h >> 8) % 8], (h >> 16) % 1000);
+			break;
+
+		default:
+			snprintf(buffer, size, "%u.%02u", (h >> 4) % 100000, h % 100);
+			break;
+	}
+}
+
+static int
+value_width(const char *str)
+{
+	return use_utf8 ? utf_string_dsplen(str, strlen(str)) : (int) strlen(str);
+}
+
+static void
+write_padded(FILE *fp, const char *str, int width, bool align_right)
+{
+	int		spaces = width - value_width(str);
+
+	if (align_right)
+		fprintf(fp, "%*s%s", spaces, "", str);
+	else
+		fprintf(fp, "%s%*s", str, spaces, "");
+}
+
+/*
+ * Generates psql like data (border 1) and csv data. The widths of
+ * columns are calculated in first pass.
+ */
+static bool
+generate_data(BenchContext *ctx, const char *table_path, const char *csv_path)
+{
+	FILE   *tfp, *cfp;
+	int	   *widths;
+	char	buffer[256];
+	int		i, j;
+
+	widths = smalloc(ctx->columns * sizeof(int));
+
+	for (j = 0; j < ctx->columns; j++)
+	{
+		snprintf(buffer, sizeof(buffer), "c%d", j + 1);
+		widths[j] = value_width(buffer);
+	}
+
+	for (i = 0; i < ctx->rows; i++)
+	{
+		for (j = 0; j < ctx->columns; j++)
+		{
+			int		width;
+
+			cell_value(ctx, i, j, buffer, sizeof(buffer));
+			width = value_width(buffer);
+
+			if (width > widths[j])
+				widths[j] = width;
+		}
+	}
+
+	tfp = fopen(table_path, "w");
+	cfp = fopen(csv_path, "w");
+	if (!tfp || !cfp)
+	{
+		if (tfp)
+			fclose(tfp);
+		if (cfp)
+			fclose(cfp);
+
+		free(widths);
+		return false;
+	}
+
+	for (j = 0; j < ctx->columns; j++)
+	{
+		snprintf(buffer, sizeof(buffer), "c%d", j + 1);
+
+		fprintf(tfp, "%s", j > 0 ? " | " : " ");
+		write_padded(tfp, buffer, widths[j], false);
+
+		fprintf(cfp, "%s%s", j > 0 ? "," : "", buffer);
+	}
+
+	fprintf(tfp, " \n");
+	fprintf(cfp, "\n");
+
+	for (j = 0; j < ctx->columns; j++)
+	{
+		fprintf(tfp, "%s", j > 0 ? "+" : "");
+		for (i = 0; i < widths[j] + 2; i++)
+			fputc('-', tfp);
+	}
+
+	fprintf(tfp, "\n");
+
+	for (i = 0; i < ctx->rows; i++)
+	{
+		for (j = 0; j < ctx->columns; j++)
+		{
+			cell_value(ctx, i, j, buffer, sizeof(buffer));
+
+			fprintf(tfp, "%s", j > 0 ? " | " : " ");
+			write_padded(tfp, buffer, widths[j], cell_is_numeric(j));
+
+			fprintf(cfp, "%s%s", j > 0 ? "," : "", buffer);
+		}
+
+		fprintf(tfp, " \n");
+		fprintf(cfp, "\n");
+	}
+
+	fprintf(tfp, "(%d rows)\n\n", ctx->rows);
+
+	fclose(tfp);
+	fclose(cfp);
+	free(widths);
+
+	return true;
+}
+
+static bool
+load_data(Options *opts, DataDesc *desc, StateData *state, char *path, bool csv_format)
+{
+	bool	result;
+
+	memset(desc, 0, sizeof(DataDesc));
+
+	opts->pathname = path;
+	opts->csv_format = csv_format;
+
+	if (!open_data_stream(opts))
+		return false;
+
+	if (csv_format)
+		result = read_and_format(opts, desc, state);
+	else
+		result = readfile(opts, desc, state);
+
+	close_data_stream();
+
+	return result;
+}
+
+/*
+ * Search next row with pattern from start of data by same routine
+ * like cmd_SearchNext uses.
+ */
+static int
+search_next(Options *opts, ScrDesc *scrdesc, DataDesc *desc, const char *pattern)
+{
+	strncpy(scrdesc->searchterm, pattern, sizeof(scrdesc->searchterm) - 1);
+	scrdesc->has_upperchr = false;
+	scrdesc->searchterm_size = strlen(scrdesc->searchterm);
+	scrdesc->searchterm_char_size = use_utf8 ?  utf8len(scrdesc->searchterm) : (int) strlen(scrdesc->searchterm);
+
+	return search_next_row(opts, scrdesc, desc, desc->first_data_row, 0,
+						   scrdesc->fix_rows_rows + desc->title_rows);
+}
+
+/*
+ * ncurses screen, that is connected to /dev/null. The output is generated
+ * like for real terminal, but it is not displayed anywhere.
+ */
+typedef struct
+{
+	SCREEN *screen;
+	FILE   *outfp;
+	FILE   *infp;
+} HeadlessScreen;
+
+static bool
+open_headless_screen(HeadlessScreen *hs, Options *opts)
+{
+	char   *term;
+
+	memset(hs, 0, sizeof(HeadlessScreen));
+
+	hs->outfp = fopen("/dev/null", "w");
+	hs->infp = fopen("/dev/null", "r");
+	if (!hs->outfp || !hs->infp)
+		goto error;
+
+	term = getenv("TERM");
+	hs->screen = newterm(term && *term ? term : "xterm", hs->outfp, hs->infp);
+	if (!hs->screen)
+		goto error;
+
+	resize_term(BENCH_SCREEN_ROWS, BENCH_SCREEN_COLS);
+
+	if (has_colors())
+	{
+		start_color();
+		initialize_color_pairs(opts->theme);
+	}
+
+	return true;
+
+error:
+	if (hs->outfp)
+		fclose(hs->outfp);
+	if (hs->infp)
+		fclose(hs->infp);
+
+	memset(hs, 0, sizeof(HeadlessScreen));
+
+	return false;
+}
+
+static void
+close_headless_screen(HeadlessScreen *hs)
+{
+	if (!hs->screen)
+		return;
+
+	if (!isendwin())
+		endwin();
+
+	delscreen(hs->screen);
+
+	fclose(hs->outfp);
+	fclose(hs->infp);
+
+	memset(hs, 0, sizeof(HeadlessScreen));
+}
+
+/*
+ * Draws fixed rows and rows windows like main loop does, when user
+ * scrolls (page down to end and back, with some line steps). Other
+ * windows are not drawn, because their layout is maintained by main
+ * loop.
+ */
+static void
+scroll_data(BenchContext *ctx, Options *opts, ScrDesc *scrdesc, DataDesc *desc)
+{
+	int		first_row;
+	int		max_first_row;
+	int		i;
+
+	reset_window_damage();
+
+	initialize_theme(opts->theme, WINDOW_ROWS, true, opts->no_highlight_lines, 0, &scrdesc->themes[WINDOW_ROWS]);
+	initialize_theme(opts->theme, WINDOW_FIX_ROWS, true, opts->no_highlight_lines, 0, &scrdesc->themes[WINDOW_FIX_ROWS]);
+
+	scrdesc->main_maxy = BENCH_SCREEN_ROWS;
+	scrdesc->main_maxx = BENCH_SCREEN_COLS;
+	scrdesc->fix_rows_rows = desc->first_data_row - desc->title_rows;
+	scrdesc->fix_cols_cols = 0;
+	scrdesc->rows_rows = BENCH_SCREEN_ROWS - scrdesc->fix_rows_rows;
+	desc->fixed_rows = scrdesc->fix_rows_rows;
+
+	w_fix_rows(scrdesc) = subwin(stdscr, scrdesc->fix_rows_rows, BENCH_SCREEN_COLS, 0, 0);
+	w_rows(scrdesc) = subwin(stdscr, scrdesc->rows_rows, BENCH_SCREEN_COLS, scrdesc->fix_rows_rows, 0);
+
+	max_first_row = max_int(desc->last_data_row - desc->first_data_row - scrdesc->rows_rows + 1, 0);
+
+	bench_start(ctx);
+
+	first_row = 0;
+
+	for (i = 0; i < BENCH_SCROLL_STEPS; i++)
+	{
+		int		step = i % 4 == 3 ? 1 : scrdesc->rows_rows;
+
+		if (i < BENCH_SCROLL_STEPS / 2)
+			first_row = min_int(first_row + step, max_first_row);
+		else
+			first_row = max_int(first_row - step, 0);
+
+		window_fill(WINDOW_FIX_ROWS,
+					desc->title_rows, 0, -1,
+					-1, -1, -1, -1,
+					desc, scrdesc, opts);
+
+		window_fill(WINDOW_ROWS,
+					desc->first_data_row + first_row, 0, 0,
+					-1, -1, -1, -1,
+					desc, scrdesc, opts);
+
+		wnoutrefresh(w_fix_rows(scrdesc));
+		wnoutrefresh(w_rows(scrdesc));
+		doupdate();
+	}
+
+	bench_stop(ctx, "scroll");
+
+	delwin(w_rows(scrdesc));
+	delwin(w_fix_rows(scrdesc));
+	w_rows(scrdesc) = NULL;
+	w_fix_rows(scrdesc) = NULL;
+}
+
+static bool
+export_to_null(Options *opts, ScrDesc *scrdesc, DataDesc *desc, ClipboardFormat format)
+{
+	FILE   *fp;
+	bool	result;
+
+	fp = fopen("/dev/null", "w");
+	if (!fp)
+		return false;
+
+	result = export_data(opts, scrdesc, desc, 0, 0, fp, 0, 0.0, NULL,
+						 cmd_CopyAllLines, format);
+
+	fclose(fp);
+
+	return result;
+}
+
+/*
+ * Generates data, and measure time of basic operations over these
+ * data. Returns exit code.
+ */
+int
+run_benchmark(Options *opts, StateData *state)
+{
+	BenchContext ctx;
+	DataDesc	desc;
+	ScrDesc		scrdesc;
+	HeadlessScreen hs;
+	char		dirpath[] = "/tmp/pspg-bench-XXXXXX";
+	char		table_path[64];
+	char		csv_path[64];
+	int			result = EXIT_FAILURE;
+
+	setlocale(LC_ALL, "");
+	use_utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+
+	ctx.rows = state->benchmark_rows;
+	ctx.columns = state->benchmark_columns;
+	ctx.unicode = use_utf8 ? state->benchmark_unicode : 0;
+
+	/* data should be complete after one call of readfile */
+	opts->progressive_load_mode = false;
+	opts->tsv_format = false;
+
+	memset(&hs, 0, sizeof(HeadlessScreen));
+
+	if (!mkdtemp(dirpath))
+	{
+		fprintf(stderr, "cannot to create directory for benchmark data\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(table_path, sizeof(table_path), "%s/data.txt", dirpath);
+	snprintf(csv_path, sizeof(csv_path), "%s/data.csv", dirpath);
+
+	fprintf(stdout, "test\trows\tcolumns\tunicode\tms\n");
+
+	bench_start(&ctx);
+	if (!generate_data(&ctx, table_path, csv_path))
+	{
+		fprintf(stderr, "cannot to generate benchmark data\n");
+		goto cleanup;
+	}
+	bench_stop(&ctx, "generate");
+
+	bench_start(&ctx);
+	if (!load_data(opts, &desc, state, table_path, false))
+	{
+		fprintf(stderr, "cannot to read benchmark data (%s)\n",
+				state->errstr ? state->errstr : "no data");
+		goto cleanup;
+	}
+	bench_stop(&ctx, "readfile");
+
+	bench_start(&ctx);
+	if (!desc.headline || !translate_headline(&desc))
+	{
+		fprintf(stderr, "cannot to detect format of benchmark data\n");
+		goto cleanup;
+	}
+	bench_stop(&ctx, "translate_headline");
+
+	/*
+	 * Generated data has border 1 and footer, so the data rows are between
+	 * header border and first footer row (it is same what main does).
+	 */
+	desc.first_data_row = desc.border_head_row + 1;
+	if (desc.alt_footer_row != -1)
+	{
+		desc.footer_row = desc.alt_footer_row;
+		desc.last_data_row = desc.footer_row - 1;
+	}
+	else
+		desc.last_data_row = desc.last_row;
+
+	memset(&scrdesc, 0, sizeof(ScrDesc));
+	scrdesc.search_first_row = -1;
+	scrdesc.search_first_column = -1;
+	scrdesc.selected_first_row = -1;
+	scrdesc.selected_first_column = -1;
+
+	if (!open_headless_screen(&hs, opts))
+	{
+		fprintf(stderr, "cannot to initialize screen for benchmark\n");
+		goto cleanup;
+	}
+
+	scroll_data(&ctx, opts, &scrdesc, &desc);
+
+	/* export doesn't show progress, when ncurses are not active */
+	endwin();
+
+	bench_start(&ctx);
+	update_order_map(&scrdesc, &desc, 3, false);
+	bench_stop(&ctx, "sort_numeric");
+
+	sort_cache_free(&desc);
+
+	bench_start(&ctx);
+	update_order_map(&scrdesc, &desc, 2, false);
+	bench_stop(&ctx, "sort_text");
+
+	bench_start(&ctx);
+	update_order_map(&scrdesc, &desc, 2, true);
+	bench_stop(&ctx, "sort_text_cached_desc");
+
+	free(desc.order_map);
+	desc.order_map = NULL;
+
+	bench_start(&ctx);
+	if (search_next(opts, &scrdesc, &desc, BENCH_SEARCH_MISS) != -1)
+		log_row("benchmark: unexpected found of \"%s\"", BENCH_SEARCH_MISS);
+	bench_stop(&ctx, "search_next_miss");
+
+	bench_start(&ctx);
+	if (search_next(opts, &scrdesc, &desc, BENCH_SEARCH_HIT) == -1)
+		log_row("benchmark: cannot to find \"%s\"", BENCH_SEARCH_HIT);
+	bench_stop(&ctx, "search_next_hit");
+
+	bench_start(&ctx);
+	search_all_rows(opts, &scrdesc, &desc);
+	bench_stop(&ctx, "search_all_rows");
+
+	bench_start(&ctx);
+	if (!export_to_null(opts, &scrdesc, &desc, CLIPBOARD_FORMAT_CSV))
+	{
+		fprintf(stderr, "cannot to export benchmark data (%s)\n",
+				state->errstr ? state->errstr : "unknown error");
+		goto cleanup;
+	}
+	bench_stop(&ctx, "export_csv");
+
+	bench_start(&ctx);
+	if (!export_to_null(opts, &scrdesc, &desc, CLIPBOARD_FORMAT_TEXT))
+	{
+		fprintf(stderr, "cannot to export benchmark data (%s)\n",
+				state->errstr ? state->errstr : "unknown error");
+		goto cleanup;
+	}
+	bench_stop(&ctx, "export_text");
+
+	lb_free(&desc);
+
+	bench_start(&ctx);
+	if (!load_data(opts, &desc, state, csv_path, true))
+	{
+		fprintf(stderr, "cannot to read benchmark csv data (%s)\n",
+				state->errstr ? state->errstr : "no data");
+		goto cleanup;
+	}
+	bench_stop(&ctx, "read_and_format");
+
+	result = EXIT_SUCCESS;
+
+cleanup:
+	close_headless_screen(&hs);
+
+	unlink(table_path);
+	unlink(csv_path);
+	rmdir(dirpath);
+
+	return result;
+}
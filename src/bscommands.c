@@ -779,6 +779,22 @@ parse_and_eval_bscommand(const char *cmdline,
 		else
 			free(spec.pattern);
 	}
+	else if (IS_TOKEN(cmdline, n, "findall"))
+	{
+		cmdline += n;
+		*next_command = cmd_SearchAll;
+	}
+	else if (IS_TOKEN(cmdline, n, "stats"))
+	{
+		char	buffer[512];
+
+		cmdline += n;
+
+		stats_summary(buffer, sizeof(buffer));
+		log_row("stats: %s", buffer);
+
+		show_info_wait(" %s", buffer, false, true, false, false);
+	}
 	else if (IS_TOKEN(cmdline, n, "ord") ||
 			 IS_TOKEN(cmdline, n, "order") ||
 			 IS_TOKEN(cmdline, n, "ordd") ||
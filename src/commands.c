@@ -252,6 +252,8 @@ cmd_string(int cmd)
 			return "SearchPrev";
 		case cmd_SearchColumn:
 			return "SearchColumn";
+		case cmd_SearchAll:
+			return "SearchAll";
 		case cmd_ShowTopBar:
 			return "ShowTopBar";
 		case cmd_ShowBottomBar:
@@ -379,6 +381,8 @@ translate_event(int c, bool alt, Options *opts, int *nested_command)
 				return cmd_BoldLabelsToggle;
 			case 'c':
 				return cmd_ShowCursor;
+			case 'f':
+				return cmd_SearchAll;
 			case 'l':
 				return cmd_GotoLine;
 			case 'm':
@@ -711,6 +715,7 @@ require_complete_load(int cmd)
 		case cmd_Copy:
 		case cmd_GotoLine:
 		case cmd_ForwardSearch:
+		case cmd_SearchAll:
 			return true;
 
 		default:
@@ -110,6 +110,7 @@ typedef enum PspgCommand
 	cmd_SearchNext,
 	cmd_SearchPrev,
 	cmd_SearchColumn,
+	cmd_SearchAll,
 	cmd_ShowTopBar,
 	cmd_ShowBottomBar,
 	cmd_RowNumToggle,
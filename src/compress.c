@@ -0,0 +1,240 @@
+/*-------------------------------------------------------------------------
+ *
+ * compress.c
+ *	  fast compression of blocks of rows
+ *
+ * Portions Copyright (c) 2017-2021 Pavel Stehule
+ *
+ * IDENTIFICATION
+ *	  src/compress.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pspg.h"
+
+/*
+ * Simple LZ77 codec with format similar to LZ4 block format. The tables
+ * generated by psql are very redundant (padding spaces, border chars,
+ * repeated values), and just simple and fast matching of repeated
+ * sequences is good enough.
+ *
+ * Compressed data is sequence of items. Every item starts by token - high
+ * four bits is number of literals, low four bits is length of match minus
+ * LZ_MIN_MATCH. The value 15 means, so the length is continued by bytes,
+ * that are added to length (255 means next byte follows). Then follows
+ * literals and two bytes of offset of match (little endian). Last item
+ * has literals only. The match can overlap current position (sequence
+ * of spaces is encoded as one space and match with offset 1).
+ */
+#define LZ_MIN_MATCH		4
+#define LZ_MAX_OFFSET		65535
+#define LZ_HASH_BITS		14
+
+static inline uint32_t
+lz_hash(const unsigned char *ptr)
+{
+	uint32_t	v;
+
+	memcpy(&v, ptr, sizeof(v));
+
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static inline unsigned char *
+lz_put_length(unsigned char *op, size_t len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+
+	*op++ = (unsigned char) len;
+
+	return op;
+}
+
+/*
+ * Writes one item. When mlen is zero, only literals are written.
+ */
+static unsigned char *
+lz_put_item(unsigned char *op,
+			const unsigned char *literals,
+			size_t llen,
+			size_t offset,
+			size_t mlen)
+{
+	unsigned char *token = op++;
+
+	*token = (llen >= 15 ? 15 : llen) << 4;
+
+	if (llen >= 15)
+		op = lz_put_length(op, llen - 15);
+
+	memcpy(op, literals, llen);
+	op += llen;
+
+	if (mlen > 0)
+	{
+		mlen -= LZ_MIN_MATCH;
+
+		*token |= mlen >= 15 ? 15 : mlen;
+
+		*op++ = offset & 0xff;
+		*op++ = offset >> 8;
+
+		if (mlen >= 15)
+			op = lz_put_length(op, mlen - 15);
+	}
+
+	return op;
+}
+
+/*
+ * Returns max size of compressed data of size bytes
+ */
+size_t
+lz_compress_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+/*
+ * Compress src to dest, that should have lz_compress_bound(size) bytes
+ * at least. Returns size of compressed data.
+ */
+size_t
+lz_compress(const char *src, size_t size, char *dest)
+{
+	const unsigned char *base = (const unsigned char *) src;
+	unsigned char *op = (unsigned char *) dest;
+	uint32_t	table[1 << LZ_HASH_BITS];
+	size_t		anchor = 0;
+	size_t		pos = 0;
+
+	/* position + 1 is stored, so zero means empty slot */
+	memset(table, 0, sizeof(table));
+
+	while (pos + LZ_MIN_MATCH <= size)
+	{
+		uint32_t	h = lz_hash(base + pos);
+		size_t		ref = table[h];
+
+		table[h] = (uint32_t) pos + 1;
+
+		if (ref > 0 && pos - (ref - 1) <= LZ_MAX_OFFSET &&
+			memcmp(base + ref - 1, base + pos, LZ_MIN_MATCH) == 0)
+		{
+			size_t		mlen = LZ_MIN_MATCH;
+
+			ref -= 1;
+
+			while (pos + mlen < size && base[ref + mlen] == base[pos + mlen])
+				mlen += 1;
+
+			op = lz_put_item(op, base + anchor, pos - anchor, pos - ref, mlen);
+
+			pos += mlen;
+			anchor = pos;
+
+			/* the end of match is often start of next match */
+			if (pos >= 2 && pos - 2 + LZ_MIN_MATCH <= size)
+				table[lz_hash(base + pos - 2)] = (uint32_t) (pos - 2) + 1;
+		}
+		else
+			pos += 1;
+	}
+
+	op = lz_put_item(op, base + anchor, size - anchor, 0, 0);
+
+	return (char *) op - dest;
+}
+
+static inline bool
+lz_get_length(const unsigned char **ip, const unsigned char *iend, size_t *len)
+{
+	unsigned char c;
+
+	do
+	{
+		if (*ip >= iend)
+			return false;
+
+		c = *(*ip)++;
+		*len += c;
+	}
+	while (c == 255);
+
+	return true;
+}
+
+/*
+ * Decompress src (csize bytes) to dest, that has size bytes. Returns false,
+ * when data are broken or the size of decompressed data is not size.
+ */
+bool
+lz_decompress(const char *src, size_t csize, char *dest, size_t size)
+{
+	const unsigned char *ip = (const unsigned char *) src;
+	const unsigned char *iend = ip + csize;
+	unsigned char *op = (unsigned char *) dest;
+	unsigned char *oend = op + size;
+
+	while (ip < iend)
+	{
+		unsigned char token = *ip++;
+		size_t		llen = token >> 4;
+		size_t		mlen = token & 15;
+		size_t		offset;
+
+		if (llen == 15 && !lz_get_length(&ip, iend, &llen))
+			return false;
+
+		if (llen > (size_t) (iend - ip) || llen > (size_t) (oend - op))
+			return false;
+
+		memcpy(op, ip, llen);
+		ip += llen;
+		op += llen;
+
+		/* last item has not match */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (mlen == 15 && !lz_get_length(&ip, iend, &mlen))
+			return false;
+
+		mlen += LZ_MIN_MATCH;
+
+		if (offset == 0 || offset > (size_t) (op - (unsigned char *) dest) ||
+			mlen > (size_t) (oend - op))
+			return false;
+
+		if (offset >= mlen)
+		{
+			memcpy(op, op - offset, mlen);
+			op += mlen;
+		}
+		else
+		{
+			/* overlapped match repeats last offset bytes */
+			while (mlen-- > 0)
+			{
+				*op = *(op - offset);
+				op++;
+			}
+		}
+	}
+
+	return op == oend;
+}
@@ -42,6 +42,7 @@ typedef struct
 {
 	char   *pathname;
 	char   *log_pathname;
+	char   *stats_pathname;		/* save stats in json format to this file before exit */
 	bool	ignore_case;
 	bool	ignore_lower_case;
 	bool	no_mouse;
@@ -67,6 +68,7 @@ typedef struct
 	char	csv_header;			/* a - auto, - off, + on */
 	char   *nullstr;
 	char   *csv_skip_columns_like;
+	int		csv_sample_rows;	/* format csv progressively after these rows, 0 disabled */
 	bool	ignore_short_rows;
 	bool	pgcli_fix;			/* hints for using from pgcli */
 	bool	double_header;
@@ -75,6 +77,13 @@ typedef struct
 	bool	no_sigint_search_reset;
 	char   *query;
 	int		watch_time;
+	bool	prepared_query;		/* watched query is prepared only once */
+	int		follow_rows;		/* in follow mode hold only last rows, 0 without limit */
+	int		follow_mb;			/* in follow mode hold only last MB of rows, 0 without limit */
+	bool	follow;				/* append stream data and hold only last rows */
+	int		memory_limit_mb;	/* rows over this limit are evicted to temp file, 0 without limit */
+	bool	compress_rows;		/* full blocks of rows are compressed in memory */
+	bool	snapshot;			/* parsed mapped file is cached in snapshot */
 	char   *host;
 	char   *username;
 	char   *port;
@@ -97,6 +106,8 @@ typedef struct
 	char   *custom_theme_name;
 	bool	highlight_odd_rec;
 	bool	hide_header_line;
+	bool	mmap_load;
+	bool	background_load;
 } Options;
 
 extern bool save_config(char *path, Options *opts);
@@ -13,8 +13,13 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include "pspg.h"
 #include "commands.h"
@@ -717,6 +722,480 @@ process_item(ExportState *expstate,
 	return true;
 }
 
+/*
+ * Separates fields of line, and exports them
+ */
+static bool
+export_line(ExportState *expstate,
+			char *headline_transl,
+			char *rowstr,
+			bool is_colname,
+			bool continuation_mark,
+			bool prev_continuation_mark)
+{
+	int		size, width;
+	int		field_size;
+	int		field_xpos;
+	int		xpos;
+	char   *field, *ptr, typ;
+	FmtLineIter iter;
+
+	iter.headline = headline_transl;
+	iter.row = rowstr;
+	iter.xpos = 0;
+
+	field = NULL; field_size = 0; field_xpos = -1;
+
+	expstate->colno = 0;
+
+	/*
+	 * line parser - separates fields on line
+	 */
+	while ((ptr = next_char(&iter, &typ, &size, &width, &xpos)))
+	{
+		if (typ == 'd')
+		{
+			if (!field)
+				field = ptr;
+
+			field_size += size;
+			field_xpos = xpos;
+			continue;
+		}
+
+		if (field)
+		{
+			if (!process_item(expstate, 'd',
+							  field, field_size, field_xpos,
+							  is_colname,
+							  continuation_mark,
+							  prev_continuation_mark))
+				return false;
+
+			field = NULL; field_size = 0; field_xpos = -1;
+		}
+
+		if (!process_item(expstate, typ,
+						  ptr, size, xpos,
+						  is_colname,
+						  continuation_mark,
+						  prev_continuation_mark))
+			return false;
+	}
+
+	if (field)
+	{
+		if (!process_item(expstate, 'd',
+						  field, field_size, field_xpos,
+						  is_colname,
+						  continuation_mark,
+						  prev_continuation_mark))
+			return false;
+	}
+
+	return process_item(expstate, 'N',
+						NULL, 0, -1, is_colname,
+						continuation_mark,
+						prev_continuation_mark);
+}
+
+/*
+ * Data rows of bigger exports are formatted by workers to memory buffers
+ * (every worker formats chunks of rows), and these buffers are written
+ * in order by writer. The workers can be only EXPORT_WINDOW_CHUNKS chunks
+ * before writer, so memory usage is limited. The caller shows progress
+ * and can cancel export.
+ */
+#define EXPORT_PIPELINE_MIN_ROWS		20000
+#define EXPORT_CHUNK_ROWS				5000
+#define EXPORT_WINDOW_CHUNKS			64
+
+#ifndef IOV_MAX
+#define IOV_MAX							16
+#endif
+
+typedef struct
+{
+	char	   *data;				/* formatted rows (malloc-ed) */
+	size_t		size;
+	bool		ready;				/* true, when data are formatted */
+} ExportChunk;
+
+typedef struct
+{
+	ExportState *expstate;			/* template of state of workers */
+	DataDesc   *desc;
+	PspgCommand	cmd;
+	int			format;
+	int			first_row;			/* position of first exported row */
+	int			nrows;
+	int			fd;					/* target of writer */
+
+	ExportChunk *chunks;
+	int			nchunks;
+	int			next_chunk;			/* first chunk not assigned to worker */
+	int			written_chunks;		/* number of chunks written by writer */
+
+	bool		canceled;
+	int			_errno;				/* errno of failed write or 0 */
+
+	pthread_t	thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} ExportPipeline;
+
+typedef struct
+{
+	ExportPipeline *pl;
+	bool		is_writer;
+} ExportTask;
+
+/*
+ * Formats one chunk of rows to memory stream
+ */
+static void
+format_export_chunk(ExportPipeline *pl, int chunkno)
+{
+	ExportChunk *chunk = &pl->chunks[chunkno];
+	ExportState	expstate;
+	LineBufferIter lbi;
+	LineBufferMark lbm;
+	LineBuffer *pinned_lb = NULL;
+	bool		prev_continuation_mark = false;
+	int			first = pl->first_row + chunkno * EXPORT_CHUNK_ROWS;
+	int			nrows = min_int(EXPORT_CHUNK_ROWS, pl->first_row + pl->nrows - first);
+
+	memcpy(&expstate, pl->expstate, sizeof(ExportState));
+
+	expstate.fp = open_memstream(&chunk->data, &chunk->size);
+	if (!expstate.fp)
+		leave("out of memory");
+
+	init_lbi_ddesc(&lbi, pl->desc, first);
+
+	while (nrows-- > 0 && lbi_set_mark_next(&lbi, &lbm))
+	{
+		LineInfo   *linfo;
+		char	   *rowstr;
+		int			rn;
+		bool		continuation_mark = false;
+
+		/* evicted rows can be paged in by more workers in parallel */
+		if (lbm.lb != pinned_lb)
+		{
+			if (pinned_lb)
+				lb_unpin(pinned_lb);
+
+			lb_pin(lbm.lb);
+			pinned_lb = lbm.lb;
+		}
+
+		(void) lbm_get_line(&lbm, &rowstr, &linfo, &rn);
+
+		if (pl->cmd == cmd_CopyMarkedLines)
+		{
+			if (!linfo || ((linfo->mask & LINEINFO_BOOKMARK) == 0))
+				continue;
+		}
+
+		/* caller ensures valid result of search of all rows */
+		if (pl->cmd == cmd_CopySearchedLines &&
+			!FOUND_ROWS_TEST(pl->desc, lbm.lb->first_row + lbm.lb_rowno))
+			continue;
+
+		if (pl->format != CLIPBOARD_FORMAT_TEXT)
+			continuation_mark = LB_IS_CONTINUED(lbm.lb, lbm.lb_rowno);
+
+		/* memory stream can fail only when there are no memory */
+		(void) export_line(&expstate, pl->desc->headline_transl, rowstr,
+						   false,
+						   continuation_mark,
+						   prev_continuation_mark);
+
+		prev_continuation_mark = continuation_mark;
+	}
+
+	if (pinned_lb)
+		lb_unpin(pinned_lb);
+
+	fclose(expstate.fp);
+}
+
+/*
+ * Writes all data of chunks to fd. Returns errno when write fails.
+ */
+static int
+write_export_chunks(int fd, ExportChunk *chunks, int nchunks)
+{
+	struct iovec iov[IOV_MAX];
+	int			niov = 0;
+	int			i;
+
+	for (i = 0; i < nchunks; i++)
+	{
+		if (chunks[i].size > 0)
+		{
+			iov[niov].iov_base = chunks[i].data;
+			iov[niov].iov_len = chunks[i].size;
+			niov += 1;
+		}
+	}
+
+	i = 0;
+	while (i < niov)
+	{
+		ssize_t		written;
+
+		written = writev(fd, iov + i, niov - i);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return errno;
+		}
+
+		/* skip written buffers, and move in partially written buffer */
+		while (i < niov && (size_t) written >= iov[i].iov_len)
+			written -= iov[i++].iov_len;
+
+		if (i < niov)
+		{
+			iov[i].iov_base = (char *) iov[i].iov_base + written;
+			iov[i].iov_len -= written;
+		}
+	}
+
+	return 0;
+}
+
+static void *
+export_task(void *arg)
+{
+	ExportTask *task = (ExportTask *) arg;
+	ExportPipeline *pl = task->pl;
+
+	pthread_mutex_lock(&pl->mutex);
+
+	if (task->is_writer)
+	{
+		while (pl->written_chunks < pl->nchunks && !pl->canceled)
+		{
+			int		first = pl->written_chunks;
+			int		last = first;
+			int		_errno;
+			int		i;
+
+			if (!pl->chunks[first].ready)
+			{
+				pthread_cond_wait(&pl->cond, &pl->mutex);
+				continue;
+			}
+
+			while (last + 1 < pl->nchunks &&
+				   last + 1 - first < IOV_MAX &&
+				   pl->chunks[last + 1].ready)
+				last += 1;
+
+			pthread_mutex_unlock(&pl->mutex);
+
+			_errno = write_export_chunks(pl->fd, pl->chunks + first, last - first + 1);
+
+			for (i = first; i <= last; i++)
+			{
+				free(pl->chunks[i].data);
+				pl->chunks[i].data = NULL;
+			}
+
+			pthread_mutex_lock(&pl->mutex);
+
+			if (_errno)
+			{
+				pl->_errno = _errno;
+				pl->canceled = true;
+			}
+
+			pl->written_chunks = last + 1;
+			pthread_cond_broadcast(&pl->cond);
+		}
+	}
+	else
+	{
+		while (pl->next_chunk < pl->nchunks && !pl->canceled)
+		{
+			int		chunkno;
+
+			/* don't go too far before writer */
+			if (pl->next_chunk >= pl->written_chunks + EXPORT_WINDOW_CHUNKS)
+			{
+				pthread_cond_wait(&pl->cond, &pl->mutex);
+				continue;
+			}
+
+			chunkno = pl->next_chunk++;
+
+			pthread_mutex_unlock(&pl->mutex);
+
+			format_export_chunk(pl, chunkno);
+
+			pthread_mutex_lock(&pl->mutex);
+
+			pl->chunks[chunkno].ready = true;
+			pthread_cond_broadcast(&pl->cond);
+		}
+	}
+
+	pthread_mutex_unlock(&pl->mutex);
+
+	return NULL;
+}
+
+/*
+ * Runs writer and workers. This thread is used, because caller thread
+ * should be free for showing progress.
+ */
+static void *
+export_pipeline_main(void *arg)
+{
+	ExportPipeline *pl = (ExportPipeline *) arg;
+	ExportTask *tasks;
+	int			nworkers;
+	int			i;
+
+	nworkers = parallel_workers(pl->nrows, EXPORT_CHUNK_ROWS);
+
+	tasks = smalloc((nworkers + 1) * sizeof(ExportTask));
+
+	for (i = 0; i <= nworkers; i++)
+	{
+		tasks[i].pl = pl;
+		tasks[i].is_writer = i == 0;
+	}
+
+	run_parallel_tasks(export_task, tasks, sizeof(ExportTask), nworkers + 1);
+
+	free(tasks);
+
+	return NULL;
+}
+
+/*
+ * Exports data rows from first_row to first_row + nrows - 1 by parallel
+ * workers to stream fp. When ncurses is active, then the progress is
+ * displayed, and the export can be canceled by Escape or Ctrl C.
+ */
+static bool
+export_rows_pipelined(ExportState *expstate,
+					  DataDesc *desc,
+					  PspgCommand cmd,
+					  int first_row,
+					  int nrows)
+{
+	ExportPipeline pl;
+	sigset_t	sigset,
+				old_sigset;
+	bool		show_progress = !isendwin();
+	int			rc;
+	int			i;
+
+	errno = 0;
+	if (fflush(expstate->fp) != 0)
+	{
+		current_state->_errno = errno;
+		format_error("%s", strerror(errno));
+		return false;
+	}
+
+	memset(&pl, 0, sizeof(ExportPipeline));
+
+	pl.expstate = expstate;
+	pl.desc = desc;
+	pl.cmd = cmd;
+	pl.format = expstate->format;
+	pl.first_row = first_row;
+	pl.nrows = nrows;
+	pl.fd = fileno(expstate->fp);
+
+	pl.nchunks = (nrows + EXPORT_CHUNK_ROWS - 1) / EXPORT_CHUNK_ROWS;
+	log_row("export %d rows in %d chunks", nrows, pl.nchunks);
+
+	pl.chunks = smalloc(pl.nchunks * sizeof(ExportChunk));
+	memset(pl.chunks, 0, pl.nchunks * sizeof(ExportChunk));
+
+	pthread_mutex_init(&pl.mutex, NULL);
+	pthread_cond_init(&pl.cond, NULL);
+
+	/* signals should be handled by main thread */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &old_sigset);
+
+	rc = pthread_create(&pl.thread, NULL, export_pipeline_main, &pl);
+
+	pthread_sigmask(SIG_SETMASK, &old_sigset, NULL);
+
+	/* without thread, the pipeline is executed here */
+	if (rc != 0)
+	{
+		show_progress = false;
+		(void) export_pipeline_main(&pl);
+	}
+
+	while (show_progress)
+	{
+		char		buffer[100];
+		int			written_chunks;
+
+		pthread_mutex_lock(&pl.mutex);
+		written_chunks = pl.written_chunks;
+		show_progress = written_chunks < pl.nchunks && !pl.canceled;
+		pthread_mutex_unlock(&pl.mutex);
+
+		if (!show_progress)
+			break;
+
+		snprintf(buffer, sizeof(buffer),
+				 " Exported %d%% of rows (press Escape to cancel)",
+				 (int) ((long) written_chunks * 100 / pl.nchunks));
+
+		if (show_info_progress(buffer, 200))
+		{
+			pthread_mutex_lock(&pl.mutex);
+			pl.canceled = true;
+			pthread_cond_broadcast(&pl.cond);
+			pthread_mutex_unlock(&pl.mutex);
+		}
+	}
+
+	if (rc == 0)
+		pthread_join(pl.thread, NULL);
+
+	for (i = 0; i < pl.nchunks; i++)
+		free(pl.chunks[i].data);
+
+	free(pl.chunks);
+
+	pthread_mutex_destroy(&pl.mutex);
+	pthread_cond_destroy(&pl.cond);
+
+	if (pl._errno)
+	{
+		current_state->_errno = pl._errno;
+		format_error("%s", strerror(pl._errno));
+		log_row("Cannot write (%s)", current_state->errstr);
+
+		return false;
+	}
+	else if (pl.canceled)
+	{
+		format_error("export was canceled");
+		log_row("export was canceled");
+
+		return false;
+	}
+
+	return true;
+}
+
 /*
  * Exports data to defined stream in requested format.
  * Returns true, when the operation was successfull
@@ -753,6 +1232,9 @@ export_data(Options *opts,
 
 	bool	isok = true;
 
+	int		pipelined_first_row = -1;
+	int		pipelined_last_row = -1;
+
 	ExportState expstate;
 
 	expstate.format = format;
@@ -899,7 +1381,7 @@ export_data(Options *opts,
 
 				(void) lbm_get_line(&lbm, &rowstr, &linfo, &rn);
 
-				continuation_mark = linfo && linfo->mask & LINEINFO_CONTINUATION;
+				continuation_mark = LB_IS_CONTINUED(lbm.lb, lbm.lb_rowno);
 
 				if (!prevline_continuation_mark && continuation_mark)
 				{
@@ -944,24 +1426,50 @@ export_data(Options *opts,
 		}
 	}
 
+	/*
+	 * Bigger range of data rows without multilines can be formatted by
+	 * parallel workers (searched lines only when all rows was searched
+	 * already).
+	 */
+	if (!expstate.lines && !desc->has_multilines &&
+		cmd != cmd_CopyLineExtended &&
+		(cmd != cmd_CopySearchedLines || FOUND_ROWS_IS_VALID(desc)) &&
+		desc->first_data_row >= 0)
+	{
+		pipelined_first_row = max_int(min_row, desc->first_data_row);
+		pipelined_last_row = min_int(max_row, desc->last_data_row);
+
+		if (pipelined_last_row - pipelined_first_row + 1 < EXPORT_PIPELINE_MIN_ROWS)
+			pipelined_first_row = -1;
+	}
+
 	init_lbi_ddesc(&lbi, desc, 0);
 
 	while (lbi_set_mark_next(&lbi, &lbm))
 	{
 		LineInfo *linfo;
-
-		int		size, width;
-		int		field_size;
-		int		field_xpos;
-		int		colno;
-		int		xpos;
-		char   *field, *ptr, typ;
-		FmtLineIter iter;
 		bool	is_colname = false;
 		bool	continuation_mark = false;
 
 		(void) lbm_get_line(&lbm, &rowstr, &linfo, &rn);
 
+		if (pipelined_first_row != -1 &&
+			rn >= pipelined_first_row && rn <= pipelined_last_row)
+		{
+			if (rn == pipelined_first_row)
+			{
+				isok = export_rows_pipelined(&expstate, desc, cmd,
+											 pipelined_first_row,
+											 pipelined_last_row - pipelined_first_row + 1);
+				if (!isok)
+					goto exit_export;
+
+				init_lbi_ddesc(&lbi, desc, pipelined_last_row + 1);
+			}
+
+			continue;
+		}
+
 		/* reduce rows from export */
 		if (rn >= desc->first_data_row && rn <= desc->last_data_row)
 		{
@@ -975,11 +1483,22 @@ export_data(Options *opts,
 			}
 			if (cmd == cmd_CopySearchedLines)
 			{
-				/* force lineinfo setting */
-				linfo = set_line_info(opts, scrdesc, desc, &lbm, rowstr);
+				if (FOUND_ROWS_IS_VALID(desc))
+				{
+					int		rowno = lbm.lb->first_row + lbm.lb_rowno;
 
-				if (!linfo || ((linfo->mask & LINEINFO_FOUNDSTR) == 0))
-					continue;
+					/* all rows was searched already */
+					if (!FOUND_ROWS_TEST(desc, rowno))
+						continue;
+				}
+				else
+				{
+					/* force lineinfo setting */
+					linfo = set_line_info(opts, scrdesc, desc, &lbm, rowstr);
+
+					if (!linfo || ((linfo->mask & LINEINFO_FOUNDSTR) == 0))
+						continue;
+				}
 			}
 		}
 		else
@@ -1002,75 +1521,14 @@ export_data(Options *opts,
 				continue;
 		}
 
-		iter.headline = desc->headline_transl;
-		iter.row = rowstr;
-		iter.xpos = 0;
-
-		field = NULL; field_size = 0; field_xpos = -1;
-
-		colno = 0;
-		expstate.colno = 0;
-
 		/* for text format we have not concate lines of multiline field */
 		if (format != CLIPBOARD_FORMAT_TEXT)
-			continuation_mark = linfo && linfo->mask & LINEINFO_CONTINUATION;
-
-		/*
-		 * line parser - separates fields on line
-		 */
-		while ((ptr = next_char(&iter, &typ, &size, &width, &xpos)))
-		{
-			if (typ == 'd')
-			{
-				if (!field)
-					field = ptr;
-
-				field_size += size;
-				field_xpos = xpos;
-				continue;
-			}
-
-			if (field)
-			{
-				isok = process_item(&expstate, 'd',
-									field, field_size, field_xpos,
-									is_colname,
-									continuation_mark,
-									prev_continuation_mark);
-				if (!isok)
-					goto exit_export;
-
-				field = NULL; field_size = 0; field_xpos = -1;
-			}
-
-			isok = process_item(&expstate, typ,
-								ptr, size, xpos,
-								is_colname,
-								continuation_mark,
-								prev_continuation_mark);
-
-			if (!isok)
-				goto exit_export;
-
-			if (typ == 'I')
-				colno += 1;
-		}
-
-		if (field)
-		{
-			isok = process_item(&expstate, 'd',
-								field, field_size, field_xpos,
-								is_colname,
-								continuation_mark,
-								prev_continuation_mark);
-			if (!isok)
-				goto exit_export;
-		}
+			continuation_mark = LB_IS_CONTINUED(lbm.lb, lbm.lb_rowno);
 
-		isok = process_item(&expstate, 'N',
-							NULL, 0, -1, is_colname,
-							continuation_mark,
-							prev_continuation_mark);
+		isok = export_line(&expstate, desc->headline_transl, rowstr,
+						   is_colname,
+						   continuation_mark,
+						   prev_continuation_mark);
 		if (!isok)
 			goto exit_export;
 
@@ -11,6 +11,9 @@
  *-------------------------------------------------------------------------
  */
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -168,6 +171,8 @@ smalloc(int size)
 
 	memset(result, 0, size);
 
+	stats_alloc_add(size);
+
 	return result;
 }
 
@@ -195,28 +200,40 @@ smalloc2(int size, char *debugstr)
 
 	memset(result, 0, size);
 
+	stats_alloc_add(size);
+
 	return result;
 }
 
 char *
 sstrdup(const char *str)
 {
-	char *result = strdup(str);
+	size_t		size = strlen(str) + 1;
+	char	   *result = malloc(size);
 
 	if (!result)
 		leave("out of memory");
 
+	memcpy(result, str, size);
+
+	stats_alloc_add(size);
+
 	return result;
 }
 
 char *
 sstrdup2(const char *str, char *debugstr)
 {
-	char *result = strdup(str);
+	size_t		size = strlen(str) + 1;
+	char	   *result = malloc(size);
 
 	if (!result)
 		leave("out of memory while %s", debugstr);
 
+	memcpy(result, str, size);
+
+	stats_alloc_add(size);
+
 	return result;
 }
 
@@ -235,6 +252,251 @@ sstrndup(const char *str, int bytes)
 	return result;
 }
 
+/*
+ * Memory arena - simple chunked allocator. An allocated memory cannot be
+ * released separately, only all memory of arena can be released at once.
+ * It is used for storing rows, line buffers and line infos of DataDesc.
+ */
+#define ARENA_CHUNK_SIZE		(1024 * 1024)
+#define ARENA_ALIGN				(sizeof(void *))
+
+MemArena *
+arena_create(void)
+{
+	return smalloc(sizeof(MemArena));
+}
+
+/*
+ * Arena with smaller chunks is used for data, that are released often
+ * (rows of line buffers that can be spilled to disk).
+ */
+MemArena *
+arena_create_sized(size_t chunk_size)
+{
+	MemArena   *arena = smalloc(sizeof(MemArena));
+
+	arena->chunk_size = chunk_size;
+
+	return arena;
+}
+
+static void *
+_arena_alloc(MemArena *arena, size_t size, size_t align)
+{
+	MemArenaChunk *chunk = arena->chunks;
+	size_t		offset = 0;
+
+	if (chunk)
+		offset = (chunk->used + align - 1) & ~(align - 1);
+
+	if (!chunk || offset + size > chunk->size)
+	{
+		size_t		chunk_size = arena->chunk_size > 0 ? arena->chunk_size : ARENA_CHUNK_SIZE;
+
+		/* too big allocation has own chunk */
+		if (size > chunk_size / 4)
+			chunk_size = size;
+
+		chunk = malloc(offsetof(MemArenaChunk, data) + chunk_size);
+		if (!chunk)
+			leave("out of memory");
+
+		stats_alloc_add(chunk_size);
+
+		chunk->size = chunk_size;
+		chunk->used = 0;
+
+		/*
+		 * Dedicated chunk is pushed after current chunk, so free space of
+		 * current chunk can be used still.
+		 */
+		if (chunk_size == size && arena->chunks)
+		{
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		}
+		else
+		{
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+
+		arena->allocated += chunk_size;
+		arena->nchunks += 1;
+
+		offset = 0;
+	}
+
+	chunk->used = offset + size;
+	arena->used += size;
+
+	return chunk->data + offset;
+}
+
+/*
+ * Returns zero filled aligned memory
+ */
+void *
+arena_alloc(MemArena *arena, size_t size)
+{
+	void	   *result;
+
+	result = _arena_alloc(arena, size, ARENA_ALIGN);
+	memset(result, 0, size);
+
+	return result;
+}
+
+/*
+ * Returns copy of string with specified size in bytes. The string
+ * is not aligned.
+ */
+char *
+arena_strndup(MemArena *arena, const char *str, size_t bytes)
+{
+	char	   *result;
+
+	result = _arena_alloc(arena, bytes + 1, 1);
+	memcpy(result, str, bytes);
+	result[bytes] = '\0';
+
+	return result;
+}
+
+/*
+ * Moves all chunks of src arena to dest arena, and releases src arena.
+ * The current chunk of dest arena is not changed.
+ */
+void
+arena_merge(MemArena *dest, MemArena *src)
+{
+	MemArenaChunk *last;
+
+	if (!src)
+		return;
+
+	if (src->chunks)
+	{
+		last = src->chunks;
+		while (last->next)
+			last = last->next;
+
+		if (dest->chunks)
+		{
+			last->next = dest->chunks->next;
+			dest->chunks->next = src->chunks;
+		}
+		else
+			dest->chunks = src->chunks;
+
+		dest->allocated += src->allocated;
+		dest->used += src->used;
+		dest->nchunks += src->nchunks;
+	}
+
+	free(src);
+}
+
+/*
+ * Release all memory of arena
+ */
+void
+arena_free(MemArena *arena)
+{
+	MemArenaChunk *chunk;
+
+	if (!arena)
+		return;
+
+	chunk = arena->chunks;
+
+	while (chunk)
+	{
+		MemArenaChunk *next = chunk->next;
+
+		free(chunk);
+		chunk = next;
+	}
+
+	free(arena);
+}
+
+#define MAX_PARALLEL_WORKERS		32
+
+/*
+ * Returns number of workers for processing of nitems items, when one
+ * worker should to process min_items items at least.
+ */
+int
+parallel_workers(long nitems, long min_items)
+{
+	static long ncpus = -1;
+	long		nworkers;
+
+	if (ncpus == -1)
+	{
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (ncpus < 1)
+			ncpus = 1;
+	}
+
+	nworkers = nitems / min_items;
+
+	if (nworkers > ncpus)
+		nworkers = ncpus;
+	if (nworkers > MAX_PARALLEL_WORKERS)
+		nworkers = MAX_PARALLEL_WORKERS;
+
+	return nworkers > 1 ? (int) nworkers : 1;
+}
+
+/*
+ * Executes routine for every task. First task is executed by current
+ * thread, others by new threads. Returns after finishing of all tasks.
+ * The routine should not to use ncurses.
+ */
+void
+run_parallel_tasks(void *(*routine)(void *), void *tasks, size_t task_size, int ntasks)
+{
+	pthread_t  *threads = NULL;
+	int			nthreads = 0;
+	int			i;
+
+	if (ntasks > 1)
+	{
+		sigset_t	sigset,
+					old_sigset;
+
+		threads = smalloc((ntasks - 1) * sizeof(pthread_t));
+
+		/* signals should be handled by main thread */
+		sigfillset(&sigset);
+		pthread_sigmask(SIG_SETMASK, &sigset, &old_sigset);
+
+		for (i = 1; i < ntasks; i++)
+		{
+			if (pthread_create(&threads[nthreads], NULL, routine,
+							   (char *) tasks + i * task_size) != 0)
+				break;
+
+			nthreads += 1;
+		}
+
+		pthread_sigmask(SIG_SETMASK, &old_sigset, NULL);
+	}
+
+	/* tasks without thread are executed here */
+	(void) routine(tasks);
+
+	for (i = nthreads + 1; i < ntasks; i++)
+		(void) routine((char *) tasks + i * task_size);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
 /*
  * Returns byte size of first char of string
  */
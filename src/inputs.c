@@ -167,6 +167,8 @@ _get_pspg_event(NCursesEventData *nced,
 	bool	first_loop = true;
 	bool	without_timeout = timeout == -1;
 	bool	zero_timeout = timeout == 0;
+	bool	poll_loader_fd = false;
+	bool	poll_query_fd = false;
 
 #if defined(HAVE_INOTIFY) || defined(HAVE_KQUEUE)
 
@@ -243,6 +245,20 @@ _get_pspg_event(NCursesEventData *nced,
 
 			nfds = 2;
 		}
+		else if (current_state->desc && current_state->desc->loader)
+		{
+			fds[1].fd = loader_get_fd(current_state->desc->loader);
+			fds[1].events = POLLIN;
+			poll_loader_fd = true;
+			nfds = 2;
+		}
+		else if (pg_query_socket() != -1)
+		{
+			fds[1].fd = pg_query_socket();
+			fds[1].events = POLLIN;
+			poll_query_fd = true;
+			nfds = 2;
+		}
 
 #if defined(HAVE_INOTIFY) || defined(HAVE_KQUEUE)
 
@@ -358,14 +374,36 @@ repeat_reading:
 
 				if (sigint)
 				{
-					if (!only_tty_events)
-						return PSPG_SIGINT_EVENT;
+					if (only_tty_events)
+					{
+						/* hold sigint for later processing */
+						handle_sigint = true;
+						return PSPG_NOTHING_VALID_EVENT;
+					}
+
+					return PSPG_SIGINT_EVENT;
 				}
 			}
 			else if (fds[1].revents)
 			{
 				short revents = fds[1].revents;
 
+				/* loader thread has new data */
+				if (poll_loader_fd)
+				{
+					loader_ack_wakeup(current_state->desc->loader);
+					return PSPG_READ_DATA_EVENT;
+				}
+
+				/* wait until first rows of sent query are available */
+				if (poll_query_fd)
+				{
+					if (pg_query_is_ready())
+						return PSPG_QUERY_READY_EVENT;
+
+					continue;
+				}
+
 				if (revents & POLLHUP)
 				{
 					/* The pipe cannot be reopened */
@@ -529,6 +567,9 @@ get_pspg_event(NCursesEventData *nced,
 		case PSPG_NOTHING_VALID_EVENT:
 			event_name = "NOTHING VALID EVENT";
 			break;
+		case PSPG_QUERY_READY_EVENT:
+			event_name = "QUERY READY";
+			break;
 		default:
 			event_name = "undefined event";
 	}
@@ -50,6 +50,7 @@ typedef enum
 	PSPG_FATAL_EVENT,						/* got a fatal error */
 	PSPG_ERROR_EVENT,						/* got a error with error message */
 	PSPG_NOTHING_VALID_EVENT,				/* got an error, but this error can be ignored */
+	PSPG_QUERY_READY_EVENT,					/* result of sent query is available */
 } PspgEventType;
 
 enum
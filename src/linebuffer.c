@@ -12,9 +12,28 @@
  */
 
 #include "pspg.h"
+#include "unicode.h"
 
+#include <ctype.h>
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Rows of line buffers, that can be evicted, are allocated in smaller
+ * chunks, because they are released often.
+ */
+#define LB_SPILL_CHUNK_SIZE			(64 * 1024)
+#define LB_SPILL_MAPS_CHUNK_SIZE	(4 * 1024)
+
+static void lb_spill_save(LineBuffer *lb);
+static void lb_spill_free(DataDesc *desc);
 
 /*
  * Initialize line buffer iterator
@@ -22,11 +41,15 @@
 inline void
 init_lbi(LineBufferIter *lbi,
 		 LineBuffer *lb,
+		 LineBuffer **lb_dir,
+		 int lb_dir_items,
 		 MappedLine *order_map,
 		 int order_map_items,
 		 int init_pos)
 {
 	lbi->start_lb = lb;
+	lbi->lb_dir = lb_dir;
+	lbi->lb_dir_items = lb_dir_items;
 
 	lbi->order_map = order_map;
 	lbi->order_map_items = order_map_items;
@@ -45,11 +68,35 @@ init_lbi_ddesc(LineBufferIter *lbi,
 {
 	init_lbi(lbi,
 			 &desc->rows,
+			 desc->lb_dir,
+			 desc->lb_dir_items,
 			 desc->order_map,
 			 desc->order_map_items,
 			 init_pos);
 }
 
+/*
+ * Returns line buffer that holds row on position pos. When there
+ * is not this line buffer, returns last line buffer. lbno is number
+ * of returned line buffer.
+ */
+static inline LineBuffer *
+lb_dir_seek(LineBuffer *first,
+			LineBuffer **lb_dir,
+			int lb_dir_items,
+			int pos,
+			int *lbno)
+{
+	int		n = pos > 0 ? pos / LINEBUFFER_LINES : 0;
+
+	if (n > lb_dir_items)
+		n = lb_dir_items;
+
+	*lbno = n;
+
+	return n > 0 ? lb_dir[n - 1] : first;
+}
+
 /*
  * Set iterator to absolute position in line buffer
  */
@@ -75,31 +122,25 @@ lbi_set_lineno(LineBufferIter *lbi, int pos)
 	}
 	else
 	{
-		int		lineno_offset = 0;
+		int		lbno;
 
-		lbi->current_lb = lbi->start_lb;
+		lbi->current_lb = lb_dir_seek(lbi->start_lb,
+									  lbi->lb_dir,
+									  lbi->lb_dir_items,
+									  pos,
+									  &lbno);
 
-		while (lbi->current_lb && pos >= LINEBUFFER_LINES)
-		{
-			pos -= LINEBUFFER_LINES;
-			lineno_offset += lbi->current_lb->nrows;
-
-			lbi->current_lb = lbi->current_lb->next;
-		}
+		/* all line buffers before last one are full */
+		pos -= lbno * LINEBUFFER_LINES;
 
-		if (lbi->current_lb)
+		if (pos < lbi->current_lb->nrows)
 		{
-			if (pos < lbi->current_lb->nrows)
-			{
-				lbi->current_lb_rowno = pos;
+			lbi->current_lb_rowno = pos;
 
-				return true;
-			}
-			else
-				lbi->lineno = lineno_offset + lbi->current_lb->nrows;
+			return true;
 		}
 		else
-			lbi->lineno = lineno_offset;
+			lbi->lineno = lbno * LINEBUFFER_LINES + lbi->current_lb->nrows;
 	}
 
 	lbi->current_lb = NULL;
@@ -155,17 +196,20 @@ ddesc_set_mark(LineBufferMark *lbm, DataDesc *desc, int pos)
 			return true;
 		}
 	}
-	else
+	else if (pos >= 0)
 	{
-		LineBuffer *lb = &desc->rows;
+		LineBuffer *lb;
+		int			lbno;
 
-		while (lb && pos >= LINEBUFFER_LINES)
-		{
-			lb = lb->next;
-			pos -= LINEBUFFER_LINES;
-		}
+		lb = lb_dir_seek(&desc->rows,
+						 desc->lb_dir,
+						 desc->lb_dir_items,
+						 pos,
+						 &lbno);
+
+		pos -= lbno * LINEBUFFER_LINES;
 
-		if (lb && pos < lb->nrows)
+		if (pos < lb->nrows)
 		{
 			lbm->lb = lb;
 			lbm->lb_rowno = pos;
@@ -177,40 +221,360 @@ ddesc_set_mark(LineBufferMark *lbm, DataDesc *desc, int pos)
 	return false;
 }
 
+/*
+ * Allocate new line buffer and append it after prev line buffer (that
+ * should be last line buffer of desc). Line buffers are allocated from
+ * the arena of previous line buffer, and they are registered in desc's
+ * directory of line buffers. In follow mode, every line buffer has own
+ * arena, so it can be released, when it is recycled. When spill storage
+ * is used, the rows of line buffer are in own arena, and previous (full)
+ * line buffer is saved to spill storage, so it can be evicted later.
+ */
+LineBuffer *
+lb_alloc(DataDesc *desc, LineBuffer *prev)
+{
+	LineBuffer *lb;
+
+	if (desc->lb_own_arenas)
+	{
+		MemArena   *arena = arena_create();
+
+		lb = arena_alloc(arena, sizeof(LineBuffer));
+		lb->arena = arena;
+	}
+	else
+	{
+		lb = arena_alloc(prev->arena, sizeof(LineBuffer));
+		lb->arena = prev->arena;
+	}
+
+	lb->first_row = prev->first_row + LINEBUFFER_LINES;
+	lb->prev = prev;
+	prev->next = lb;
+
+	if (desc->spill)
+	{
+		lb->spill = desc->spill;
+		lb->rows_arena = arena_create_sized(LB_SPILL_CHUNK_SIZE);
+		lb->spill_offset = -1;
+
+		/* first line buffer holds header, and it is never evicted */
+		if (prev->spill)
+			lb_spill_save(prev);
+	}
+
+	lb_alloc_rows(lb);
+
+	if (desc->lb_dir_items >= desc->lb_dir_size)
+	{
+		desc->lb_dir_size = desc->lb_dir_size > 0 ? 2 * desc->lb_dir_size : 64;
+		desc->lb_dir = srealloc(desc->lb_dir,
+								desc->lb_dir_size * sizeof(LineBuffer *));
+	}
+
+	desc->lb_dir[desc->lb_dir_items++] = lb;
+
+	return lb;
+}
+
+/*
+ * Allocates array of pointers to rows. The array is in rows arena, so it
+ * is released together with evicted rows.
+ */
+void
+lb_alloc_rows(LineBuffer *lb)
+{
+	lb->rows = arena_alloc(LB_ROWS_ARENA(lb), LINEBUFFER_LINES * sizeof(char *));
+}
+
+/*
+ * Returns zero filled array of line infos for line buffer
+ */
+LineInfo *
+lb_alloc_lineinfo(LineBuffer *lb)
+{
+	return arena_alloc(lb->arena, LINEBUFFER_LINES * sizeof(LineInfo));
+}
+
 void
 lbm_xor_mask(LineBufferMark *lbm, char mask)
 {
+	/* returns zero fill memory already */
 	if (!lbm->lb->lineinfo)
+		lbm->lb->lineinfo = lb_alloc_lineinfo(lbm->lb);
+
+	lbm->lb->lineinfo[lbm->lb_rowno].mask ^= mask;
+}
+
+/*
+ * Returns record number of data row. Rows of multiline record has same
+ * record number. Requires multilines detection.
+ */
+int
+lb_get_recno(DataDesc *desc, LineBuffer *lb, int rowno)
+{
+	int		start = desc->first_data_row - lb->first_row;
+	int		recno;
+	int		i;
+
+	if (start < 0)
+		start = 0;
+
+	recno = lb->first_recno + rowno - start;
+
+	if (lb->continuation_bits)
+	{
+		for (i = start; i < rowno; i++)
+			if (LB_IS_CONTINUED(lb, i))
+				recno -= 1;
+	}
+
+	return recno;
+}
+
+
+/*
+ * Map of row without usable checkpoints (the row contains chars with
+ * negative display width or broken multibyte chars). Such row should
+ * be walked from start.
+ */
+static DspPosCheckpoints no_checkpoints = {0};
+
+/*
+ * Walks row and stores display positions of chars nearest after
+ * multiplies of DSPPOS_CHECKPOINT_STEP. When items is NULL, only
+ * counts checkpoints. Returns -1 if the row cannot be mapped.
+ */
+static int
+walk_dsppos(const char *str, DspPosCheckpoint *items)
+{
+	const char *ptr = str;
+	int			pos = 0;
+	int			next_pos = DSPPOS_CHECKPOINT_STEP;
+	int			nitems = 0;
+
+	while (*ptr != '\0' && *ptr != '\n')
 	{
+		int		dlen = dsplen(ptr);
+		int		clen = charlen(ptr);
 		int		i;
 
-		/* smalloc returns zero fill memory already */
-		lbm->lb->lineinfo = smalloc(LINEBUFFER_LINES * sizeof(LineInfo));
+		if (dlen < 0)
+			return -1;
 
-		for (i = 0; i < LINEBUFFER_LINES; i++)
-			lbm->lb->lineinfo[i].recno_offset = SHRT_MIN;
+		for (i = 1; i < clen; i++)
+			if (ptr[i] == '\0')
+				return -1;
+
+		pos += dlen;
+		ptr += clen;
+
+		if (pos >= next_pos)
+		{
+			if (items)
+			{
+				items[nitems].bytes = ptr - str;
+				items[nitems].pos = pos;
+			}
+
+			nitems += 1;
+			next_pos = (pos / DSPPOS_CHECKPOINT_STEP + 1) * DSPPOS_CHECKPOINT_STEP;
+		}
 	}
 
-	lbm->lb->lineinfo[lbm->lb_rowno].mask ^= mask;
+	return nitems;
+}
+
+/*
+ * Returns pointer to the char of row, that starts on display position
+ * not higher than pos, and its display position in seek_pos. When build
+ * is true, then missing map of the row is created. Without build
+ * (can be used from worker threads), the map is used only if it exists
+ * already. The rows should be in memory (by LB_PAGE_IN or by lb_pin in
+ * workers), because page in is not safe in workers.
+ */
+char *
+lb_seek_dsppos(LineBuffer *lb, int rowno, int pos, bool build, int *seek_pos)
+{
+	DspPosCheckpoints *cps = NULL;
+	char	   *str;
+	int			k;
+
+	str = lb->rows[rowno];
+	*seek_pos = 0;
+
+	if (pos < DSPPOS_CHECKPOINT_STEP)
+		return str;
+
+	if (lb->checkpoints)
+		cps = lb->checkpoints[rowno];
+
+	if (!cps)
+	{
+		int		nitems;
+
+		if (!build || !lb->arena)
+			return str;
+
+		/* maps are evicted together with rows */
+		if (!lb->checkpoints)
+			lb->checkpoints = arena_alloc(LB_ROWS_ARENA(lb), LINEBUFFER_LINES * sizeof(DspPosCheckpoints *));
+
+		nitems = walk_dsppos(str, NULL);
+		if (nitems > 0)
+		{
+			cps = arena_alloc(LB_ROWS_ARENA(lb),
+							  offsetof(DspPosCheckpoints, items) +
+							  nitems * sizeof(DspPosCheckpoint));
+
+			cps->nitems = walk_dsppos(str, cps->items);
+		}
+		else
+			cps = &no_checkpoints;
+
+		lb->checkpoints[rowno] = cps;
+	}
+
+	/* k-th item is at position k * STEP or after */
+	k = pos / DSPPOS_CHECKPOINT_STEP - 1;
+	if (k >= cps->nitems)
+		k = cps->nitems - 1;
+
+	while (k >= 0 && cps->items[k].pos > pos)
+		k -= 1;
+
+	if (k < 0)
+		return str;
+
+	*seek_pos = cps->items[k].pos;
+
+	return str + cps->items[k].bytes;
 }
 
+/*
+ * Offsets of columns are stored only for tables with more columns. For
+ * less columns the walk from start of row is cheap.
+ */
+#define COLUMN_OFFSETS_MIN_COLUMNS		8
+
+/*
+ * The tables of offsets are not in arena (and are not counted by memory
+ * limit), so their size is limited. When they would be larger, the walk
+ * to the column uses display position checkpoints only.
+ */
+#define COLUMN_OFFSETS_MAX_BYTES		(64 * 1024 * 1024)
+
+#define COLUMN_OFFSET_UNKNOWN			UINT32_MAX
+#define COLUMN_OFFSET_INVALID			(UINT32_MAX - 1)
+
+/*
+ * Releases tables of offsets of columns of all line buffers
+ */
 void
-lbm_recno_offset(LineBufferMark *lbm, short int recno_offset)
+lb_free_column_offsets(DataDesc *desc)
 {
-	if (!lbm->lb->lineinfo)
+	int			i;
+
+	free(desc->rows.column_offsets);
+	desc->rows.column_offsets = NULL;
+
+	for (i = 0; i < desc->lb_dir_items; i++)
+	{
+		free(desc->lb_dir[i]->column_offsets);
+		desc->lb_dir[i]->column_offsets = NULL;
+	}
+}
+
+/*
+ * Returns true, when lb_seek_column can be used for all rows. Should be
+ * called by main thread before workers starts. When tables of offsets
+ * are not allowed for current data, then already built tables are
+ * released. When rows can be evicted, then the memory of rows is limited,
+ * and the tables of offsets are not used.
+ */
+bool
+lb_column_offsets_enabled(DataDesc *desc)
+{
+	if (desc->columns < COLUMN_OFFSETS_MIN_COLUMNS)
+		return false;
+
+	if (desc->spill ||
+		(size_t) (desc->lb_dir_items + 1) * LINEBUFFER_LINES *
+			desc->columns * sizeof(uint32_t) > COLUMN_OFFSETS_MAX_BYTES)
+	{
+		lb_free_column_offsets(desc);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Returns pointer to the char of row, that starts on display position
+ * xmin of column (counted from zero), and this position in seek_pos.
+ * The offsets of all columns of row are calculated by one walk, and they
+ * are stored in line buffer, so access to any column of row doesn't
+ * depend on width of row. When the char on xmin doesn't start there
+ * (wide char), then returns start of row. Can be used from worker
+ * threads, when the line buffer is used only by one thread, and only
+ * when lb_column_offsets_enabled returned true. The line buffer should
+ * be pinned.
+ */
+char *
+lb_seek_column(DataDesc *desc, LineBuffer *lb, int rowno, int colno, int *seek_pos)
+{
+	char	   *str;
+	uint32_t   *offsets;
+	int			columns = desc->columns;
+
+	str = lb->rows[rowno];
+	*seek_pos = 0;
+
+	if (!str || columns < COLUMN_OFFSETS_MIN_COLUMNS || colno >= columns)
+		return str;
+
+	if (!lb->column_offsets || lb->column_offsets_columns != columns)
 	{
 		int		i;
 
-		/* smalloc returns zero fill memory already */
-		lbm->lb->lineinfo = smalloc(LINEBUFFER_LINES * sizeof(LineInfo));
+		free(lb->column_offsets);
+
+		lb->column_offsets = smalloc(LINEBUFFER_LINES * columns * sizeof(uint32_t));
+		lb->column_offsets_columns = columns;
 
 		for (i = 0; i < LINEBUFFER_LINES; i++)
-			lbm->lb->lineinfo[i].recno_offset = SHRT_MIN;
+			lb->column_offsets[i * columns] = COLUMN_OFFSET_UNKNOWN;
 	}
 
-	lbm->lb->lineinfo[lbm->lb_rowno].recno_offset = recno_offset;
-}
+	offsets = lb->column_offsets + rowno * columns;
+
+	if (offsets[0] == COLUMN_OFFSET_UNKNOWN)
+	{
+		const char *ptr = str;
+		int			pos = 0;
+		int			i;
+
+		for (i = 0; i < columns; i++)
+		{
+			int		xmin = desc->cranges[i].xmin;
+
+			while (*ptr && pos < xmin)
+			{
+				pos += dsplen(ptr);
+				ptr += charlen(ptr);
+			}
+
+			offsets[i] = pos == xmin ? (uint32_t) (ptr - str) : COLUMN_OFFSET_INVALID;
+		}
+	}
+
+	if (offsets[colno] == COLUMN_OFFSET_INVALID)
+		return str;
 
+	*seek_pos = desc->cranges[colno].xmin;
+
+	return str + offsets[colno];
+}
 
 /*
  * Working horse of lbm_get_line and lbi_get_line routines
@@ -229,7 +593,10 @@ lb_get_line(LineBuffer *lb,
 	if (lb && rowno >= 0 && rowno < lb->nrows)
 	{
 		if (line)
+		{
+			LB_PAGE_IN(lb);
 			*line = lb->rows[rowno];
+		}
 
 		if (linfo)
 			*linfo = lb->lineinfo ? &lb->lineinfo[rowno] : NULL;
@@ -459,7 +826,10 @@ slbi_get_line_next(SimpleLineBufferIter *slbi,
 			*linfo = lb->lineinfo ? &lb->lineinfo[slbi->lb_rowno] : NULL;
 
 		if (line)
+		{
+			LB_PAGE_IN(lb);
 			*line = lb->rows[slbi->lb_rowno];
+		}
 
 		slbi->lb_rowno += 1;
 
@@ -487,28 +857,71 @@ slbi_get_line_next(SimpleLineBufferIter *slbi,
 
 /*
  * Free all lines stored in line buffer. An argument is data desc,
- * because first chunk of line buffer is owned by data desc.
+ * because first chunk of line buffer is owned by data desc. Rows
+ * (when they are not mapped from file), line buffers and line infos
+ * are stored in arena, and they are released together.
  */
 void
 lb_free(DataDesc *desc)
 {
-	LineBuffer   *lb = &desc->rows;
-	LineBuffer   *next;
-	int		i;
+	int			i;
+
+	/* loader holds rows in own arena */
+	loader_free(desc);
+
+	csv_stream_free(desc);
+
+	/* cached sort keys holds pointers to line buffers */
+	sort_cache_free(desc);
 
-	while (lb)
+	found_rows_free(desc);
+
+	/* offsets of columns are not allocated in arena */
+	lb_free_column_offsets(desc);
+
+	lb_spill_free(desc);
+
+	/* rows of line buffers, that can be evicted, are in own arenas */
+	for (i = 0; i < desc->lb_dir_items; i++)
 	{
-		for (i = 0; i < lb->nrows; i++)
-			free(lb->rows[i]);
+		arena_free(desc->lb_dir[i]->rows_arena);
+		free(desc->lb_dir[i]->spill_data);
+	}
+	snapshot_free(desc);
+
+	/* line buffers are released together with own arenas */
+	if (desc->lb_own_arenas)
+	{
+		for (i = 0; i < desc->lb_dir_items; i++)
+			arena_free(desc->lb_dir[i]->arena);
+	}
 
-		free(lb->lineinfo);
-		next = lb->next;
+	arena_free(desc->arena);
+	desc->arena = NULL;
 
-		if (lb != &desc->rows)
-			free(lb);
+	desc->rows.next = NULL;
+	desc->rows.rows = NULL;
+	desc->rows.lineinfo = NULL;
+	desc->rows.checkpoints = NULL;
+	desc->rows.continuation_bits = NULL;
+	desc->rows.arena = NULL;
 
-		lb = next;
+	if (desc->mmap_addr)
+	{
+		munmap(desc->mmap_addr, desc->mmap_size);
+
+		desc->mmap_addr = NULL;
+		desc->mmap_size = 0;
 	}
+
+	free(desc->lb_offsets);
+	desc->lb_offsets = NULL;
+	desc->lb_offsets_size = 0;
+
+	free(desc->lb_dir);
+	desc->lb_dir = NULL;
+	desc->lb_dir_items = 0;
+	desc->lb_dir_size = 0;
 }
 
 /*
@@ -546,3 +959,993 @@ getline_ddesc(DataDesc *desc, int pos)
 
 	return NULL;
 }
+
+/*
+ * Search filter. Every full line buffer can have bloom filter of
+ * trigrams of case folded chars of its rows. The line buffer, that
+ * has not some trigram of case folded pattern, cannot to contain the
+ * pattern in any search mode, and it can be skipped. The filter is
+ * created when it is used first time.
+ */
+#define SEARCH_FILTER_MIN_BITS		12
+#define SEARCH_FILTER_MAX_BITS		22
+
+static inline unsigned int
+trigram_hash(int c1, int c2, int c3)
+{
+	uint64_t	key;
+
+	key = ((uint64_t) c1 << 42) ^ ((uint64_t) c2 << 21) ^ (uint64_t) c3;
+
+	return (unsigned int) ((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/*
+ * Returns case folded char and moves pointer to next char. Returns -1
+ * when the string is not valid utf8 string.
+ */
+static inline int
+next_folded_char(const char **str)
+{
+	const char *ptr = *str;
+	int			c;
+
+	if (use_utf8)
+	{
+		int		len = utf8charlen(*ptr);
+		int		i;
+
+		/* the char boundaries should be same for strstr and for filter */
+		if (len == 1 && (*ptr & 0x80))
+			return -1;
+
+		for (i = 1; i < len; i++)
+			if ((ptr[i] & 0xC0) != 0x80)
+				return -1;
+
+		c = utf8_tofold(ptr);
+		*str = ptr + len;
+	}
+	else
+	{
+		c = toupper((unsigned char) *ptr);
+		*str = ptr + 1;
+	}
+
+	return c;
+}
+
+/*
+ * Creates bloom filter of trigrams of rows of line buffer.
+ */
+static void
+lb_create_search_filter(LineBuffer *lb)
+{
+	size_t		bytes = 0;
+	unsigned int mask;
+	int			bits = SEARCH_FILTER_MIN_BITS;
+	int			i;
+
+	LB_PAGE_IN(lb);
+
+	lb->search_filter_nrows = lb->nrows;
+	lb->search_filter_bits = 0;
+
+	for (i = 0; i < lb->nrows; i++)
+		bytes += strlen(lb->rows[i]);
+
+	while (bits < SEARCH_FILTER_MAX_BITS && ((size_t) 1 << bits) < bytes)
+		bits += 1;
+
+	lb->search_filter = arena_alloc(lb->arena, (1 << bits) / 8);
+
+	mask = (1U << bits) - 1;
+
+	for (i = 0; i < lb->nrows; i++)
+	{
+		const char *ptr = lb->rows[i];
+		int			c1 = -1, c2 = -1;
+
+		while (*ptr)
+		{
+			int		c3 = next_folded_char(&ptr);
+
+			if (c3 == -1)
+				return;
+
+			if (c1 != -1)
+			{
+				unsigned int h = trigram_hash(c1, c2, c3) & mask;
+
+				lb->search_filter[h >> 3] |= 1 << (h & 7);
+			}
+
+			c1 = c2;
+			c2 = c3;
+		}
+	}
+
+	lb->search_filter_bits = bits;
+}
+
+/*
+ * Prepare hashes of trigrams of searched pattern
+ */
+void
+init_search_filter(SearchFilter *sf, const char *pattern)
+{
+	const char *ptr = pattern;
+	int			c1 = -1, c2 = -1;
+
+	sf->ntrigrams = 0;
+
+	while (*ptr && sf->ntrigrams < 256)
+	{
+		int		c3 = next_folded_char(&ptr);
+
+		if (c3 == -1)
+		{
+			sf->ntrigrams = 0;
+			return;
+		}
+
+		if (c1 != -1)
+			sf->trigrams[sf->ntrigrams++] = trigram_hash(c1, c2, c3);
+
+		c1 = c2;
+		c2 = c3;
+	}
+}
+
+/*
+ * Returns false, when line buffer cannot to contain searched pattern.
+ * Last line buffer, that can be filled still, is not filtered.
+ */
+bool
+lb_may_contain(LineBuffer *lb, SearchFilter *sf)
+{
+	unsigned int mask;
+	int			i;
+
+	if (sf->ntrigrams == 0 || lb->nrows < LINEBUFFER_LINES || !lb->arena)
+		return true;
+
+	if (lb->search_filter_nrows != lb->nrows)
+		lb_create_search_filter(lb);
+
+	if (lb->search_filter_bits == 0)
+		return true;
+
+	mask = (1U << lb->search_filter_bits) - 1;
+
+	for (i = 0; i < sf->ntrigrams; i++)
+	{
+		unsigned int h = sf->trigrams[i] & mask;
+
+		if (!(lb->search_filter[h >> 3] & (1 << (h & 7))))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Moves iterator to nearest row, that is marked in bitmap of found rows.
+ * Without order map, the bitmap can be scanned by bytes. When bitmap is
+ * not valid, the iterator is not changed.
+ */
+void
+lbi_skip_not_found(LineBufferIter *lbi, DataDesc *desc, bool forward)
+{
+	unsigned char *found_rows = desc->found_rows;
+
+	if (!FOUND_ROWS_IS_VALID(desc))
+		return;
+
+	if (lbi->order_map)
+	{
+		while (lbi->current_lb)
+		{
+			int		rowno = lbi->current_lb->first_row + lbi->current_lb_rowno;
+
+			if (FOUND_ROWS_TEST(desc, rowno))
+				break;
+
+			if (forward)
+				(void) lbi_next(lbi);
+			else
+				(void) lbi_prev(lbi);
+		}
+	}
+	else if (lbi->current_lb)
+	{
+		int		rowno = lbi->lineno;
+
+		if (forward)
+		{
+			while (rowno < desc->found_rows_items)
+			{
+				if ((rowno & 7) == 0 && found_rows[rowno >> 3] == 0)
+					rowno += 8;
+				else if (FOUND_ROWS_TEST(desc, rowno))
+					break;
+				else
+					rowno += 1;
+			}
+		}
+		else
+		{
+			while (rowno >= 0)
+			{
+				if ((rowno & 7) == 7 && found_rows[rowno >> 3] == 0)
+					rowno -= 8;
+				else if (FOUND_ROWS_TEST(desc, rowno))
+					break;
+				else
+					rowno -= 1;
+			}
+		}
+
+		if (rowno != lbi->lineno)
+		{
+			if (rowno >= 0)
+				(void) lbi_set_lineno(lbi, rowno);
+			else
+			{
+				lbi->lineno = -1;
+				lbi->current_lb = NULL;
+				lbi->current_lb_rowno = 0;
+			}
+		}
+	}
+}
+
+/*
+ * Moves iterator over rows from line buffers, that cannot to contain
+ * searched pattern. Without order map, the whole line buffers are
+ * skipped.
+ */
+void
+lbi_skip_filtered(LineBufferIter *lbi, SearchFilter *sf, bool forward)
+{
+	if (sf->ntrigrams == 0)
+		return;
+
+	while (lbi->current_lb && !lb_may_contain(lbi->current_lb, sf))
+	{
+		if (lbi->order_map)
+		{
+			if (forward)
+				(void) lbi_next(lbi);
+			else
+				(void) lbi_prev(lbi);
+		}
+		else if (forward)
+		{
+			lbi->lineno += lbi->current_lb->nrows - lbi->current_lb_rowno;
+			lbi->current_lb = lbi->current_lb->next;
+			lbi->current_lb_rowno = 0;
+		}
+		else
+		{
+			lbi->lineno -= lbi->current_lb_rowno + 1;
+			lbi->current_lb = lbi->current_lb->prev;
+			lbi->current_lb_rowno = LINEBUFFER_LINES - 1;
+		}
+	}
+}
+
+/*
+ * Returns FNV-1a hash of rows of line buffer. The hash is calculated
+ * only once for same number of rows.
+ */
+static unsigned long long
+lb_rows_hash(LineBuffer *lb)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	int			i;
+
+	if (lb->rows_hash_nrows == lb->nrows)
+		return lb->rows_hash;
+
+	LB_PAGE_IN(lb);
+
+	for (i = 0; i < lb->nrows; i++)
+	{
+		const unsigned char *ptr = (const unsigned char *) lb->rows[i];
+
+		while (*ptr)
+		{
+			h ^= *ptr++;
+			h *= 1099511628211ULL;
+		}
+
+		/* end of row */
+		h ^= '\n';
+		h *= 1099511628211ULL;
+	}
+
+	lb->rows_hash = h;
+	lb->rows_hash_nrows = lb->nrows;
+
+	return h;
+}
+
+/*
+ * Copy bookmark and searching related info of row of previous data.
+ * The infos related to multilines depends on previous rows, and then
+ * they are not copied.
+ */
+static void
+lb_copy_lineinfo(LineBuffer *lb, int rowno, LineInfo *src)
+{
+	char		mask = LINEINFO_BOOKMARK | LINEINFO_FOUNDSTR |
+					   LINEINFO_FOUNDSTR_MULTI | LINEINFO_UNKNOWN;
+
+	if (!(src->mask & (LINEINFO_BOOKMARK | LINEINFO_FOUNDSTR)))
+		return;
+
+	if (!lb->lineinfo)
+	{
+		int		i;
+
+		lb->lineinfo = lb_alloc_lineinfo(lb);
+
+		for (i = 0; i < LINEBUFFER_LINES; i++)
+			lb->lineinfo[i].mask = LINEINFO_UNKNOWN;
+	}
+
+	lb->lineinfo[rowno].mask = (lb->lineinfo[rowno].mask & ~mask) | (src->mask & mask);
+	lb->lineinfo[rowno].start_char = src->start_char;
+}
+
+/*
+ * Copy maps of display positions and search filter of line buffer of
+ * previous data with same rows.
+ */
+static void
+lb_copy_caches(LineBuffer *lb, LineBuffer *plb)
+{
+	if (plb->checkpoints && !lb->checkpoints)
+	{
+		int		i;
+
+		lb->checkpoints = arena_alloc(lb->arena, LINEBUFFER_LINES * sizeof(DspPosCheckpoints *));
+
+		for (i = 0; i < lb->nrows; i++)
+		{
+			DspPosCheckpoints *cps = plb->checkpoints[i];
+
+			if (cps && cps != &no_checkpoints)
+			{
+				size_t		size = offsetof(DspPosCheckpoints, items) +
+								   cps->nitems * sizeof(DspPosCheckpoint);
+
+				lb->checkpoints[i] = arena_alloc(lb->arena, size);
+				memcpy(lb->checkpoints[i], cps, size);
+			}
+			else
+				lb->checkpoints[i] = cps;
+		}
+	}
+
+	if (plb->search_filter_bits > 0 &&
+		plb->search_filter_nrows == plb->nrows &&
+		lb->search_filter_nrows != lb->nrows)
+	{
+		size_t		size = (1 << plb->search_filter_bits) / 8;
+
+		lb->search_filter = arena_alloc(lb->arena, size);
+		memcpy(lb->search_filter, plb->search_filter, size);
+
+		lb->search_filter_bits = plb->search_filter_bits;
+		lb->search_filter_nrows = lb->nrows;
+	}
+}
+
+/*
+ * After reload of data (in watch mode), the line buffers of new data
+ * are compared with line buffers of previous data by hashes of rows.
+ * The bookmarks, searching infos, maps of display positions and search
+ * filters of not changed line buffers are reused. Inside changed line
+ * buffers, the rows are compared one by one, so the bookmarks and
+ * searching infos of not changed rows are not lost. Should be called
+ * before releasing of previous data. Returns number of reused line
+ * buffers.
+ */
+int
+lb_reuse_unchanged(DataDesc *desc, DataDesc *prev)
+{
+	LineBuffer *lb,
+			   *plb;
+	int			reused = 0;
+	int			nbuffers = 0;
+
+	for (lb = &desc->rows, plb = &prev->rows;
+		 lb && plb;
+		 lb = lb->next, plb = plb->next)
+	{
+		int		i;
+
+		if (!lb->arena || !plb->arena || lb->nrows == 0 || plb->nrows == 0)
+			break;
+
+		nbuffers += 1;
+
+		if (lb->nrows == plb->nrows &&
+			lb_rows_hash(lb) == lb_rows_hash(plb))
+		{
+			lb_copy_caches(lb, plb);
+
+			if (plb->lineinfo)
+				for (i = 0; i < lb->nrows; i++)
+					lb_copy_lineinfo(lb, i, &plb->lineinfo[i]);
+
+			reused += 1;
+		}
+		else if (plb->lineinfo)
+		{
+			LB_PAGE_IN(lb);
+			LB_PAGE_IN(plb);
+
+			for (i = 0; i < lb->nrows && i < plb->nrows; i++)
+			{
+				if ((plb->lineinfo[i].mask & (LINEINFO_BOOKMARK | LINEINFO_FOUNDSTR)) &&
+					strcmp(lb->rows[i], plb->rows[i]) == 0)
+					lb_copy_lineinfo(lb, i, &plb->lineinfo[i]);
+			}
+		}
+	}
+
+	log_row("reused %d of %d line buffers", reused, nbuffers);
+
+	return reused;
+}
+
+/*
+ * In follow mode only last rows of stream are hold. When number of rows
+ * is over max_rows, or size of line buffers is over max_bytes (zero is
+ * without limit), then oldest line buffers are released, and following
+ * line buffers are moved to begin. Only full line buffers are released,
+ * and the last line buffer is never released. Returns number of released
+ * rows.
+ */
+int
+lb_recycle(DataDesc *desc, int max_rows, size_t max_bytes)
+{
+	size_t		bytes = 0;
+	int			released = 0;
+	int			i;
+
+	if (!desc->lb_own_arenas)
+		return 0;
+
+	if (max_bytes > 0)
+	{
+		bytes = desc->arena ? desc->arena->allocated : 0;
+
+		for (i = 0; i < desc->lb_dir_items; i++)
+			bytes += desc->lb_dir[i]->arena->allocated;
+	}
+
+	while (desc->lb_dir_items > 0 &&
+		   ((max_rows > 0 && desc->total_rows - released - desc->rows.nrows >= max_rows) ||
+			(max_bytes > 0 && bytes > max_bytes)))
+	{
+		LineBuffer *next = desc->lb_dir[0];
+
+		if (max_bytes > 0)
+			bytes -= desc->arena->allocated;
+
+		released += desc->rows.nrows;
+
+		free(desc->rows.column_offsets);
+
+		/* first line buffer is part of desc, and arena of desc is its arena */
+		arena_free(desc->arena);
+
+		memcpy(&desc->rows, next, sizeof(LineBuffer));
+		desc->rows.prev = NULL;
+		desc->arena = desc->rows.arena;
+
+		if (desc->rows.next)
+			desc->rows.next->prev = &desc->rows;
+
+		if (desc->last_buffer == next)
+			desc->last_buffer = NULL;
+
+		desc->lb_dir_items -= 1;
+		memmove(desc->lb_dir, desc->lb_dir + 1,
+				desc->lb_dir_items * sizeof(LineBuffer *));
+	}
+
+	if (released == 0)
+		return 0;
+
+	desc->rows.first_row = 0;
+	for (i = 0; i < desc->lb_dir_items; i++)
+		desc->lb_dir[i]->first_row = (i + 1) * LINEBUFFER_LINES;
+
+	desc->total_rows -= released;
+	desc->recycled_rows += released;
+
+	if (desc->last_row != -1)
+		desc->last_row = desc->last_row >= released ? desc->last_row - released : -1;
+
+	if (desc->last_data_row != -1)
+		desc->last_data_row = desc->last_data_row >= released ? desc->last_data_row - released : -1;
+
+	/* these data are related to numbers of rows */
+	sort_cache_free(desc);
+	found_rows_free(desc);
+
+	log_row("recycled %d rows, hold %d rows", released, desc->total_rows);
+
+	return released;
+}
+
+/*
+ * Spill storage. The rows of cold line buffers can be evicted from memory,
+ * and they are restored, when they are used. Every full line buffer (except
+ * first line buffer, that holds header) is saved once, when next line buffer
+ * is allocated, so the eviction doesn't need any write. The rows are saved
+ * as sequence of zero terminated strings, optionally compressed. When memory
+ * limit is set, the saved rows are stored in temporary file (the offset
+ * and size of saved rows are stored in line buffer), else they are stored
+ * compressed in memory, and only small cache of decompressed line buffers
+ * is hold. Line infos, maps of display positions and search filters are
+ * small, and they stay in memory.
+ *
+ * Saved line buffers with rows in memory are in ring, and the victims
+ * are selected by clock algorithm - the line buffer that was used after
+ * last pass of clock hand gets second chance (so the line buffers near
+ * viewport are not evicted). Unlocked access to rows of line buffer is
+ * allowed only to main thread, when workers are not active, and only
+ * few last used line buffers are not evicted, so the pointers to rows
+ * should not be hold over more line buffers. Workers have to pin used
+ * line buffer.
+ */
+#define LB_SPILL_MIN_RESIDENT		4
+#define LB_COMPRESS_CACHE_SIZE		(8 * 1024 * 1024)
+
+typedef struct LbSpill
+{
+	int			fd;					/* spill file or -1, when rows are in memory */
+	off_t		file_size;
+	bool		compress;			/* saved rows are compressed */
+	size_t		limit;				/* max size of rows in memory */
+	size_t		resident;			/* size of rows of line buffers in ring */
+	size_t		saved_bytes;		/* size of rows before compression */
+	size_t		stored_bytes;		/* size of saved rows */
+	LineBuffer **ring;				/* saved line buffers with rows in memory */
+	int			nring;
+	int			ring_size;
+	int			hand;				/* position of clock hand in ring */
+	long		page_ins;
+	long		evictions;
+	pthread_mutex_t mutex;
+} LbSpill;
+
+/*
+ * Creates spill storage, when it is required by options. The spill file
+ * is removed immediately, so it is released by system when pspg ends.
+ * Returns false, when spill storage is not used, and then all rows are
+ * hold in memory.
+ */
+bool
+lb_spill_start(Options *opts, DataDesc *desc)
+{
+	LbSpill    *spill;
+	size_t		limit;
+	int			fd = -1;
+
+	if (opts->memory_limit_mb > 0)
+	{
+		const char *tmpdir = getenv("TMPDIR");
+		char		pathname[PATH_MAX];
+
+		snprintf(pathname, sizeof(pathname), "%s/pspg-spill-XXXXXX",
+				 tmpdir && *tmpdir ? tmpdir : "/tmp");
+
+		fd = mkstemp(pathname);
+		if (fd == -1)
+		{
+			log_row("cannot to create spill file \"%s\" (%s)", pathname, strerror(errno));
+			return false;
+		}
+
+		(void) unlink(pathname);
+
+		limit = (size_t) opts->memory_limit_mb * 1024 * 1024;
+	}
+	else if (opts->compress_rows)
+		limit = LB_COMPRESS_CACHE_SIZE;
+	else
+		return false;
+
+	spill = smalloc(sizeof(LbSpill));
+	spill->fd = fd;
+	spill->compress = opts->compress_rows;
+	spill->limit = limit;
+	pthread_mutex_init(&spill->mutex, NULL);
+
+	desc->spill = spill;
+
+	log_row("rows over %zu bytes are evicted to %s%s", limit,
+			fd != -1 ? "spill file" : "memory",
+			spill->compress ? " (compressed)" : "");
+
+	return true;
+}
+
+static void
+lb_spill_free(DataDesc *desc)
+{
+	LbSpill    *spill = desc->spill;
+	size_t		overhead = 0;
+	size_t		in_memory;
+	size_t		uncompressed;
+	int			nsaved = 0;
+	int			i;
+
+	if (!spill)
+		return;
+
+	/*
+	 * Only rows and pointers to rows are compressed or evicted. Line buffers,
+	 * line infos and search filters stay in memory, and the ratio of stored
+	 * rows doesn't show real saving of memory.
+	 */
+	for (i = 0; i < desc->lb_dir_items; i++)
+	{
+		LineBuffer *lb = desc->lb_dir[i];
+
+		if (lb->spill != spill)
+			continue;
+
+		overhead += sizeof(LineBuffer);
+
+		if (lb->rows_size > 0)
+			nsaved++;
+
+		if (lb->lineinfo)
+			overhead += LINEBUFFER_LINES * sizeof(LineInfo);
+		if (lb->search_filter)
+			overhead += (1 << lb->search_filter_bits) / 8;
+		if (lb->continuation_bits)
+			overhead += (LINEBUFFER_LINES + 7) / 8;
+	}
+
+	in_memory = spill->resident + overhead;
+	if (spill->fd == -1)
+		in_memory += spill->stored_bytes;
+
+	uncompressed = spill->saved_bytes + nsaved * LINEBUFFER_LINES * sizeof(char *) + overhead;
+
+	log_row("spill storage holds %zu bytes of %zu bytes of rows, %ld page ins, %ld evictions",
+			spill->stored_bytes, spill->saved_bytes, spill->page_ins, spill->evictions);
+	log_row("line buffers use %zu bytes of memory (%.1f%% of %zu bytes without spill storage)",
+			in_memory, uncompressed > 0 ? 100.0 * in_memory / uncompressed : 100.0,
+			uncompressed);
+
+	if (spill->fd != -1)
+		close(spill->fd);
+
+	pthread_mutex_destroy(&spill->mutex);
+	free(spill->ring);
+	free(spill);
+
+	desc->spill = NULL;
+}
+
+/*
+ * Evicts rows of line buffers from ring, until the size of rows in memory
+ * is under limit. Pinned line buffers, and the line buffer except (that
+ * is used just now) are not evicted. Should be called under lock.
+ */
+static void
+lb_spill_shrink(LbSpill *spill, LineBuffer *except)
+{
+	int		steps = 2 * spill->nring;
+
+	while (spill->resident > spill->limit &&
+		   spill->nring > LB_SPILL_MIN_RESIDENT &&
+		   steps-- > 0)
+	{
+		LineBuffer *lb;
+
+		if (spill->hand >= spill->nring)
+			spill->hand = 0;
+
+		lb = spill->ring[spill->hand];
+
+		if (lb == except || lb->pins > 0 ||
+			atomic_load_explicit(&lb->referenced, memory_order_relaxed))
+		{
+			if (lb != except)
+				atomic_store_explicit(&lb->referenced, false, memory_order_relaxed);
+
+			spill->hand += 1;
+			continue;
+		}
+
+		spill->resident -= lb->resident_size;
+
+		/* pointers to rows and maps of display positions are in rows arena */
+		arena_free(lb->rows_arena);
+		lb->rows_arena = NULL;
+		lb->rows = NULL;
+		lb->checkpoints = NULL;
+		lb->spilled = true;
+
+		/* last item of ring is moved to the place of evicted line buffer */
+		spill->ring[spill->hand] = spill->ring[--spill->nring];
+		spill->evictions += 1;
+	}
+}
+
+/*
+ * Adds saved line buffer with rows in memory to ring, and evicts other
+ * line buffers, when it is necessary. Should be called under lock.
+ */
+static void
+lb_spill_add(LbSpill *spill, LineBuffer *lb)
+{
+	if (spill->nring >= spill->ring_size)
+	{
+		spill->ring_size = spill->ring_size > 0 ? 2 * spill->ring_size : 64;
+		spill->ring = srealloc(spill->ring,
+							   spill->ring_size * sizeof(LineBuffer *));
+	}
+
+	spill->ring[spill->nring++] = lb;
+
+	/* the maps of display positions can be added later, and they are not counted */
+	lb->resident_size = lb->rows_arena->allocated;
+	spill->resident += lb->resident_size;
+
+	atomic_store_explicit(&lb->referenced, true, memory_order_relaxed);
+
+	lb_spill_shrink(spill, lb);
+}
+
+/*
+ * Saves rows of full line buffer to spill storage. When the rows cannot
+ * be saved, the line buffer is not added to ring, and it is never evicted.
+ */
+static void
+lb_spill_save(LineBuffer *lb)
+{
+	LbSpill    *spill = lb->spill;
+	size_t		size = 0;
+	size_t		stored_size;
+	char	   *buffer;
+	char	   *ptr;
+	bool		saved = false;
+	int			i;
+
+	for (i = 0; i < lb->nrows; i++)
+		size += strlen(lb->rows[i]) + 1;
+
+	buffer = malloc(size);
+	if (!buffer)
+		leave("out of memory");
+
+	ptr = buffer;
+	for (i = 0; i < lb->nrows; i++)
+	{
+		size_t		len = strlen(lb->rows[i]) + 1;
+
+		memcpy(ptr, lb->rows[i], len);
+		ptr += len;
+	}
+
+	stored_size = size;
+
+	/* compressed rows are used only when they are smaller */
+	if (spill->compress)
+	{
+		char	   *cbuffer = malloc(lz_compress_bound(size));
+		size_t		csize;
+
+		if (!cbuffer)
+			leave("out of memory");
+
+		csize = lz_compress(buffer, size, cbuffer);
+
+		if (csize < size)
+		{
+			free(buffer);
+			buffer = srealloc(cbuffer, csize);
+			stored_size = csize;
+		}
+		else
+			free(cbuffer);
+	}
+
+	pthread_mutex_lock(&spill->mutex);
+
+	if (spill->fd == -1)
+	{
+		lb->spill_data = buffer;
+		buffer = NULL;
+		saved = true;
+	}
+	else
+	{
+		size_t		written = 0;
+
+		while (written < stored_size)
+		{
+			ssize_t		rc;
+
+			rc = pwrite(spill->fd, buffer + written, stored_size - written,
+						spill->file_size + written);
+
+			if (rc < 0 && errno == EINTR)
+				continue;
+
+			if (rc <= 0)
+			{
+				log_row("cannot to write to spill file (%s)", rc < 0 ? strerror(errno) : "no space");
+				break;
+			}
+
+			written += rc;
+		}
+
+		if (written == stored_size)
+		{
+			lb->spill_offset = spill->file_size;
+			spill->file_size += stored_size;
+			saved = true;
+		}
+	}
+
+	if (saved)
+	{
+		lb->spill_size = stored_size;
+		lb->rows_size = size;
+
+		spill->saved_bytes += size;
+		spill->stored_bytes += stored_size;
+
+		lb_spill_add(spill, lb);
+	}
+
+	pthread_mutex_unlock(&spill->mutex);
+
+	free(buffer);
+}
+
+/*
+ * Reads saved rows from spill file to buffer
+ */
+static void
+lb_spill_read(LbSpill *spill, off_t offset, char *buffer, size_t size)
+{
+	size_t		done = 0;
+
+	while (done < size)
+	{
+		ssize_t		rc;
+
+		rc = pread(spill->fd, buffer + done, size - done, offset + done);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			leave("cannot to read from spill file (%s)", rc < 0 ? strerror(errno) : "unexpected end of file");
+
+		done += rc;
+	}
+}
+
+/*
+ * Restores evicted rows of line buffer. Should be called under lock.
+ * The rows cannot be lost, so read error is fatal.
+ */
+static void
+lb_spill_load(LineBuffer *lb)
+{
+	LbSpill    *spill = lb->spill;
+	char	   *ptr;
+	int			i;
+
+	if (!lb->spilled)
+		return;
+
+	/*
+	 * Size of rows is known, so pointers and rows are in one chunk of exact
+	 * size. Small chunks are used for maps of display positions.
+	 */
+	lb->rows_arena = arena_create_sized(LB_SPILL_MAPS_CHUNK_SIZE);
+	lb->rows = arena_alloc(lb->rows_arena,
+						   LINEBUFFER_LINES * sizeof(char *) + lb->rows_size);
+	ptr = (char *) (lb->rows + LINEBUFFER_LINES);
+
+	if (lb->spill_size < lb->rows_size)
+	{
+		char	   *data = lb->spill_data;
+
+		if (!data)
+		{
+			data = malloc(lb->spill_size);
+			if (!data)
+				leave("out of memory");
+
+			lb_spill_read(spill, lb->spill_offset, data, lb->spill_size);
+		}
+
+		if (!lz_decompress(data, lb->spill_size, ptr, lb->rows_size))
+			leave("cannot to decompress rows (broken data)");
+
+		if (data != lb->spill_data)
+			free(data);
+	}
+	else if (lb->spill_data)
+		memcpy(ptr, lb->spill_data, lb->rows_size);
+	else
+		lb_spill_read(spill, lb->spill_offset, ptr, lb->rows_size);
+
+	for (i = 0; i < lb->nrows; i++)
+	{
+		lb->rows[i] = ptr;
+		ptr += strlen(ptr) + 1;
+	}
+
+	lb->spilled = false;
+	spill->page_ins += 1;
+
+	lb_spill_add(spill, lb);
+}
+
+/*
+ * Restores evicted rows of line buffer. Usually it is used by macro
+ * LB_PAGE_IN, that is not active, when spill storage is not used.
+ */
+void
+lb_page_in(LineBuffer *lb)
+{
+	/* the flag can be cleared by other thread under lock */
+	atomic_store_explicit(&lb->referenced, true, memory_order_relaxed);
+
+	if (!lb->spilled)
+		return;
+
+	pthread_mutex_lock(&lb->spill->mutex);
+	lb_spill_load(lb);
+	pthread_mutex_unlock(&lb->spill->mutex);
+}
+
+/*
+ * Pinned line buffer is not evicted, so its rows can be used by workers
+ * safely. Every pin should be released by lb_unpin.
+ */
+void
+lb_pin(LineBuffer *lb)
+{
+	if (!lb->spill)
+		return;
+
+	pthread_mutex_lock(&lb->spill->mutex);
+
+	lb->pins += 1;
+	atomic_store_explicit(&lb->referenced, true, memory_order_relaxed);
+
+	lb_spill_load(lb);
+
+	pthread_mutex_unlock(&lb->spill->mutex);
+}
+
+void
+lb_unpin(LineBuffer *lb)
+{
+	if (!lb->spill)
+		return;
+
+	pthread_mutex_lock(&lb->spill->mutex);
+	lb->pins -= 1;
+	pthread_mutex_unlock(&lb->spill->mutex);
+}
@@ -0,0 +1,485 @@
+/*-------------------------------------------------------------------------
+ *
+ * loader.c
+ *	  reading of input in background thread
+ *
+ * Portions Copyright (c) 2017-2021 Pavel Stehule
+ *
+ * IDENTIFICATION
+ *	  src/loader.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "inputs.h"
+#include "pspg.h"
+
+/*
+ * The loader thread only reads lines. All processing of lines and all
+ * updates of DataDesc are done by main thread inside readfile, so the
+ * data used by rendering are never modified by other thread.
+ *
+ * The lines are passed by single producer, single consumer queue. The
+ * producer publishes new lines by release store of head, the consumer
+ * releases slots by release store of tail. The mutex and condition
+ * variable are used only when the queue is full. The main thread is
+ * woken by pipe, that is polled together with tty.
+ */
+#define LOADER_QUEUE_SIZE		(64 * 1024)
+#define LOADER_READ_SIZE		(64 * 1024)
+
+typedef struct
+{
+	char	   *line;
+	ssize_t		len;
+} LoaderLine;
+
+typedef struct Loader
+{
+	pthread_t	thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t	cond;			/* signalled when consumer releases slots */
+	int			fd;					/* input file descriptor */
+	int			wakeup_fd[2];		/* loader -> main thread */
+	int			stop_fd[2];			/* main thread -> loader */
+	MemArena   *arena;				/* memory of loaded lines, owned by thread */
+	int			_errno;				/* errno of failed read */
+	atomic_bool	stop;
+	atomic_bool	finished;
+	atomic_bool	wakeup_pending;
+	atomic_size_t head;				/* number of published lines */
+	atomic_size_t tail;				/* number of consumed lines */
+	LoaderLine	queue[LOADER_QUEUE_SIZE];
+} Loader;
+
+/*
+ * Ensure so main thread will be woken. Only one byte is in pipe.
+ */
+static void
+loader_wakeup(Loader *loader)
+{
+	if (!atomic_exchange(&loader->wakeup_pending, true))
+	{
+		ssize_t		rc;
+
+		rc = write(loader->wakeup_fd[1], "", 1);
+		UNUSED(rc);
+	}
+}
+
+/*
+ * Push line to queue. When queue is full, wait until consumer
+ * releases some slots. Returns false when loader should be stopped.
+ */
+static bool
+loader_push(Loader *loader, char *line, ssize_t len)
+{
+	size_t		head = atomic_load_explicit(&loader->head, memory_order_relaxed);
+	LoaderLine *slot;
+
+	if (head - atomic_load_explicit(&loader->tail, memory_order_acquire) == LOADER_QUEUE_SIZE)
+	{
+		loader_wakeup(loader);
+
+		pthread_mutex_lock(&loader->mutex);
+
+		while (head - atomic_load_explicit(&loader->tail, memory_order_acquire) == LOADER_QUEUE_SIZE &&
+			   !atomic_load(&loader->stop))
+			pthread_cond_wait(&loader->cond, &loader->mutex);
+
+		pthread_mutex_unlock(&loader->mutex);
+	}
+
+	if (atomic_load(&loader->stop))
+		return false;
+
+	slot = &loader->queue[head % LOADER_QUEUE_SIZE];
+	slot->line = line;
+	slot->len = len;
+
+	atomic_store_explicit(&loader->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+/*
+ * Wait on data or on stop request. Returns false when loader should
+ * be stopped.
+ */
+static bool
+loader_wait_on_data(Loader *loader)
+{
+	struct pollfd fds[2];
+
+	fds[0].fd = loader->fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = loader->stop_fd[0];
+	fds[1].events = POLLIN;
+
+	while (poll(fds, 2, -1) == -1)
+	{
+		if (errno != EINTR)
+			return false;
+	}
+
+	return !fds[1].revents;
+}
+
+static void *
+loader_main(void *arg)
+{
+	Loader	   *loader = (Loader *) arg;
+	char	   *readbuf;
+	char	   *partial = NULL;
+	size_t		partial_size = 0;
+	size_t		partial_len = 0;
+
+	readbuf = malloc(LOADER_READ_SIZE);
+	if (!readbuf)
+	{
+		loader->_errno = ENOMEM;
+		goto finish;
+	}
+
+	for (;;)
+	{
+		ssize_t		rc;
+		char	   *ptr;
+		char	   *endptr;
+		bool		pushed = false;
+
+		if (!loader_wait_on_data(loader))
+			break;
+
+		rc = read(loader->fd, readbuf, LOADER_READ_SIZE);
+		if (rc == -1)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+
+			loader->_errno = errno;
+			break;
+		}
+
+		/* push last line without new line char */
+		if (rc == 0)
+		{
+			if (partial_len > 0)
+				(void) loader_push(loader,
+								   arena_strndup(loader->arena, partial, partial_len),
+								   partial_len);
+			break;
+		}
+
+		ptr = readbuf;
+		endptr = readbuf + rc;
+
+		while (ptr < endptr)
+		{
+			char	   *nl = memchr(ptr, '\n', endptr - ptr);
+			size_t		bytes = (nl ? nl + 1 : endptr) - ptr;
+
+			if (!nl || partial_len > 0)
+			{
+				if (partial_len + bytes > partial_size)
+				{
+					partial_size = (partial_len + bytes) * 2;
+					partial = srealloc(partial, partial_size);
+				}
+
+				memcpy(partial + partial_len, ptr, bytes);
+				partial_len += bytes;
+			}
+
+			if (nl)
+			{
+				char	   *line;
+				size_t		len;
+
+				if (partial_len > 0)
+				{
+					line = arena_strndup(loader->arena, partial, partial_len);
+					len = partial_len;
+					partial_len = 0;
+				}
+				else
+				{
+					line = arena_strndup(loader->arena, ptr, bytes);
+					len = bytes;
+				}
+
+				if (!loader_push(loader, line, len))
+					goto finish;
+
+				pushed = true;
+			}
+
+			ptr += bytes;
+		}
+
+		if (pushed)
+			loader_wakeup(loader);
+	}
+
+finish:
+
+	free(readbuf);
+	free(partial);
+
+	atomic_store_explicit(&loader->finished, true, memory_order_release);
+
+	/* finish should be signalled every time */
+	atomic_store(&loader->wakeup_pending, false);
+	loader_wakeup(loader);
+
+	return NULL;
+}
+
+static bool
+create_nonblocking_pipe(int fds[2])
+{
+	if (pipe(fds) != 0)
+		return false;
+
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	return true;
+}
+
+/*
+ * Starts background reading of input, when it has a sense. The input
+ * should not be read by stdio before, because the thread reads directly
+ * from file descriptor.
+ */
+bool
+loader_start(Options *opts, DataDesc *desc, StateData *state)
+{
+	Loader	   *loader;
+	sigset_t	sigset,
+				old_sigset;
+	int			rc;
+
+	if (!opts->background_load ||
+		!opts->progressive_load_mode ||
+		desc->spill ||
+		!f_data ||
+		(f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE) ||
+		state->stream_mode ||
+		opts->querystream ||
+		opts->watch_time > 0 ||
+		opts->watch_file)
+		return false;
+
+	loader = smalloc(sizeof(Loader));
+
+	loader->fd = fileno(f_data);
+	loader->arena = arena_create();
+
+	if (!create_nonblocking_pipe(loader->wakeup_fd))
+	{
+		log_row("cannot to create pipe (%s)", strerror(errno));
+		goto error;
+	}
+
+	if (!create_nonblocking_pipe(loader->stop_fd))
+	{
+		log_row("cannot to create pipe (%s)", strerror(errno));
+		close(loader->wakeup_fd[0]);
+		close(loader->wakeup_fd[1]);
+		goto error;
+	}
+
+	pthread_mutex_init(&loader->mutex, NULL);
+	pthread_cond_init(&loader->cond, NULL);
+
+	/* signals should be handled by main thread */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &old_sigset);
+
+	rc = pthread_create(&loader->thread, NULL, loader_main, loader);
+
+	pthread_sigmask(SIG_SETMASK, &old_sigset, NULL);
+
+	if (rc != 0)
+	{
+		log_row("cannot to create loader thread");
+
+		pthread_mutex_destroy(&loader->mutex);
+		pthread_cond_destroy(&loader->cond);
+
+		close(loader->wakeup_fd[0]);
+		close(loader->wakeup_fd[1]);
+		close(loader->stop_fd[0]);
+		close(loader->stop_fd[1]);
+		goto error;
+	}
+
+	desc->loader = loader;
+
+	log_row("input is read by background thread");
+
+	return true;
+
+error:
+
+	arena_free(loader->arena);
+	free(loader);
+
+	return false;
+}
+
+/*
+ * Releases processed slots of queue
+ */
+static void
+loader_release_slots(Loader *loader)
+{
+	pthread_mutex_lock(&loader->mutex);
+	pthread_cond_signal(&loader->cond);
+	pthread_mutex_unlock(&loader->mutex);
+}
+
+/*
+ * getline like API over loader's queue. Returned lines are allocated
+ * in loader's arena, and should not be released by caller. When there
+ * are not available data and wait_on_data is false, then returns -1
+ * with errno EAGAIN. At the end of input returns -1 with errno 0 or
+ * with errno of failed read.
+ */
+ssize_t
+loader_getline(Loader *loader, char **lineptr, size_t *n, bool wait_on_data)
+{
+	for (;;)
+	{
+		size_t		tail = atomic_load_explicit(&loader->tail, memory_order_relaxed);
+		bool		finished = atomic_load_explicit(&loader->finished, memory_order_acquire);
+		size_t		head = atomic_load_explicit(&loader->head, memory_order_acquire);
+
+		if (tail != head)
+		{
+			LoaderLine *slot = &loader->queue[tail % LOADER_QUEUE_SIZE];
+			ssize_t		len = slot->len;
+
+			/* the slot can be reused immediately after update of tail */
+			*lineptr = slot->line;
+			*n = len + 1;
+
+			atomic_store_explicit(&loader->tail, tail + 1, memory_order_release);
+
+			/* wake loader, when it can wait on free slots */
+			if ((tail + 1) % (LOADER_QUEUE_SIZE / 2) == 0)
+				loader_release_slots(loader);
+
+			errno = 0;
+
+			return len;
+		}
+
+		loader_release_slots(loader);
+
+		*lineptr = NULL;
+
+		if (finished)
+		{
+			errno = loader->_errno;
+			return -1;
+		}
+
+		if (!wait_on_data)
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+		else
+		{
+			struct pollfd fds;
+
+			fds.fd = loader->wakeup_fd[0];
+			fds.events = POLLIN;
+
+			(void) poll(&fds, 1, -1);
+
+			loader_ack_wakeup(loader);
+		}
+	}
+}
+
+bool
+loader_is_finished(Loader *loader)
+{
+	return atomic_load_explicit(&loader->finished, memory_order_acquire) &&
+		   atomic_load(&loader->head) == atomic_load(&loader->tail);
+}
+
+/*
+ * Returns file descriptor used for signalling new data
+ */
+int
+loader_get_fd(Loader *loader)
+{
+	return loader->wakeup_fd[0];
+}
+
+/*
+ * Should be called before reading of queue, after wakeup
+ * of main thread.
+ */
+void
+loader_ack_wakeup(Loader *loader)
+{
+	char		buffer[64];
+
+	atomic_store(&loader->wakeup_pending, false);
+
+	while (read(loader->wakeup_fd[0], buffer, sizeof(buffer)) > 0)
+		;
+}
+
+/*
+ * Stops loader thread and moves loaded lines to DataDesc's arena.
+ */
+void
+loader_free(DataDesc *desc)
+{
+	Loader	   *loader = desc->loader;
+	ssize_t		rc;
+
+	if (!loader)
+		return;
+
+	atomic_store(&loader->stop, true);
+
+	rc = write(loader->stop_fd[1], "", 1);
+	UNUSED(rc);
+
+	loader_release_slots(loader);
+
+	pthread_join(loader->thread, NULL);
+
+	pthread_mutex_destroy(&loader->mutex);
+	pthread_cond_destroy(&loader->cond);
+
+	close(loader->wakeup_fd[0]);
+	close(loader->wakeup_fd[1]);
+	close(loader->stop_fd[0]);
+	close(loader->stop_fd[1]);
+
+	if (desc->arena)
+		arena_merge(desc->arena, loader->arena);
+	else
+		arena_free(loader->arena);
+
+	free(loader);
+
+	desc->loader = NULL;
+}
@@ -91,15 +91,6 @@ column_type_class(Oid ftype)
 	return align;
 }
 
-
-#endif
-
-#define EXIT_OUT_OF_MEMORY()		do { PQclear(result); PQfinish(conn); leave("out of memory"); } while (0)
-#define RELEASE_AND_LEAVE(s)		do { PQclear(result); PQfinish(conn); *err = s; return false; } while (0)
-#define RELEASE_AND_EXIT(s)			do { PQclear(result); PQfinish(conn); leave(s); } while (0)
-
-#ifdef HAVE_POSTGRESQL
-
 static int
 field_info(char *str, bool *multiline)
 {
@@ -129,6 +120,133 @@ field_info(char *str, bool *multiline)
 		return utf_string_dsplen_multiline(str, strlen(str), multiline, false, &digits, &others);
 }
 
+#define FIELD_INFO_ROWS_PER_WORKER		20000
+
+/*
+ * Widths and multiline flags of columns calculated by one worker
+ * for a range of rows.
+ */
+typedef struct
+{
+	RowBucketType *rb;				/* bucket of first row */
+	int			rowno;				/* first row in bucket */
+	int			nrows;				/* number of rows */
+	int			nfields;			/* number of visible columns */
+	int			widths[1024];
+	bool		multilines[1024];
+} FieldInfoTask;
+
+static void *
+field_info_task(void *arg)
+{
+	FieldInfoTask *task = (FieldInfoTask *) arg;
+	RowBucketType *rb = task->rb;
+	int			rowno = task->rowno;
+	int			i, j;
+
+	for (i = 0; i < task->nrows; i++)
+	{
+		RowType	   *row;
+		bool		multiline_row = false;
+
+		if (rowno >= rb->nrows)
+		{
+			rb = rb->next_bucket;
+			rowno = 0;
+		}
+
+		row = rb->rows[rowno];
+
+		for (j = 0; j < task->nfields; j++)
+		{
+			bool		multiline_col = false;
+			int			width;
+
+			width = field_info(row->fields[j], &multiline_col);
+
+			task->widths[j] = max_int(task->widths[j], width);
+			task->multilines[j] |= multiline_col;
+			multiline_row |= multiline_col;
+		}
+
+		rb->multilines[rowno++] = multiline_row;
+	}
+
+	return NULL;
+}
+
+/*
+ * Calculates widths of columns and multiline flags of nrows rows
+ * starting by first row of rb. The rows are divided between parallel
+ * workers.
+ */
+static void
+calculate_fields_info(RowBucketType *rb, int nrows, PrintDataDesc *pdesc)
+{
+	FieldInfoTask *tasks;
+	int			nworkers;
+	int			rowno = 0;
+	int			i, j;
+
+	nworkers = parallel_workers(nrows, FIELD_INFO_ROWS_PER_WORKER);
+	tasks = smalloc(nworkers * sizeof(FieldInfoTask));
+
+	for (i = 0; i < nworkers; i++)
+	{
+		int			task_rows = (int) ((long) nrows * (i + 1) / nworkers - (long) nrows * i / nworkers);
+
+		if (rowno >= rb->nrows)
+		{
+			rb = rb->next_bucket;
+			rowno = 0;
+		}
+
+		tasks[i].rb = rb;
+		tasks[i].rowno = rowno;
+		tasks[i].nrows = task_rows;
+		tasks[i].nfields = pdesc->nfields;
+
+		if (i == nworkers - 1)
+			break;
+
+		/* move to first row of next task */
+		while (task_rows > 0)
+		{
+			int			step;
+
+			if (rowno >= rb->nrows)
+			{
+				rb = rb->next_bucket;
+				rowno = 0;
+			}
+
+			step = rb->nrows - rowno < task_rows ? rb->nrows - rowno : task_rows;
+
+			rowno += step;
+			task_rows -= step;
+		}
+	}
+
+	if (nworkers > 1)
+		log_row("widths of columns are calculated by %d workers", nworkers);
+
+	run_parallel_tasks(field_info_task, tasks, sizeof(FieldInfoTask), nworkers);
+
+	for (j = 0; j < pdesc->nfields; j++)
+	{
+		pdesc->widths[j] = 0;
+		pdesc->multilines[j] = false;
+
+		for (i = 0; i < nworkers; i++)
+		{
+			pdesc->widths[j] = max_int(pdesc->widths[j], tasks[i].widths[j]);
+			pdesc->multilines[j] |= tasks[i].multilines[j];
+		}
+	}
+
+	free(tasks);
+}
+
 /*
  * Returns true, when some column should be hidden.
  */
@@ -207,44 +325,289 @@ mark_hidden_columns(PGresult *result,
 #endif
 
 
+#ifdef HAVE_POSTGRESQL
+
 /*
- * exit on fatal error, or return error
+ * The result is received in single row mode, so libpq doesn't hold
+ * the complete result, and the rows can be received by chunks.
  */
-bool
-pg_exec_query(Options *opts, char *query, RowBucketType *rb, PrintDataDesc *pdesc, const char **err)
+typedef struct PgQueryStream
 {
+	PGconn	   *conn;
+	bool		persistent;			/* conn is persistent connection */
+	int			nfields;			/* number of columns of result */
+	int			visible_fields;		/* number of not hidden columns */
+	bool		has_header;			/* header was processed already */
+	bool		finished;			/* all rows was received */
+	bool		hidden[1024];
+} PgQueryStream;
 
-	log_row("execute query \"%s\"", query);
+#define PREPARED_QUERY_NAME		"pspg_query"
 
-#ifdef HAVE_POSTGRESQL
+/*
+ * In watch mode the connection is not closed after execution of query,
+ * and it is reused by next execution.
+ */
+typedef struct
+{
+	PGconn	   *conn;
+	bool		busy;				/* used by not finished result */
+	bool		prepared;			/* query is prepared on this connection */
+	bool		cannot_prepare;		/* don't try to prepare query again */
+} PersistentConnection;
 
-	PGconn	   *conn = NULL;
-	PGresult   *result = NULL;
+static PersistentConnection pconn;
 
-	int			nfields;
-	int			size;
-	int			i, j;
-	int			n;
+/*
+ * The query sent by pg_send_query. The result is received by
+ * next call of pg_exec_query.
+ */
+static PgQueryStream *pending_qs = NULL;
+static bool pending_reused = false;
+
+/*
+ * Copy row of result to new RowType. Returns NULL when there
+ * is not enough memory.
+ */
+static RowType *
+copy_row(PgQueryStream *qs, PGresult *result, int rowno)
+{
+	RowType	   *row;
 	char	   *locbuf;
+	int			size = 0;
+	int			i, n;
+
+	for (i = 0; i < qs->nfields; i++)
+		if (!qs->hidden[i])
+			size += strlen(PQgetvalue(result, rowno, i)) + 1;
+
+	locbuf = malloc(size);
+	if (!locbuf)
+		return NULL;
+
+	row = malloc(offsetof(RowType, fields) + (qs->visible_fields * sizeof(char *)));
+	if (!row)
+	{
+		free(locbuf);
+		return NULL;
+	}
+
+	row->nfields = qs->visible_fields;
+
+	n = 0;
+	for (i = 0; i < qs->nfields; i++)
+	{
+		char	   *value;
+
+		if (qs->hidden[i])
+			continue;
+
+		value = PQgetvalue(result, rowno, i);
+
+		strcpy(locbuf, value);
+		row->fields[n++] = locbuf;
+		locbuf += strlen(value) + 1;
+	}
+
+	return row;
+}
+
+/*
+ * Prepare description of columns and store header row.
+ */
+static void
+store_header(PgQueryStream *qs,
+			 PGresult *result,
+			 Options *opts,
+			 RowBucketType **rb,
+			 PrintDataDesc *pdesc)
+{
 	RowType	   *row;
-	bool		multiline_row;
-	bool		multiline_col;
+	char	   *locbuf;
+	int			size;
+	int			i, n;
+
+	if ((qs->nfields = PQnfields(result)) > 1024)
+		leave("too much columns");
+
+	qs->visible_fields = mark_hidden_columns(result, qs->nfields, opts, qs->hidden);
+
+	pdesc->nfields = qs->visible_fields;
+	pdesc->has_header = true;
+
+	n = 0;
+	for (i = 0; i < qs->nfields; i++)
+	{
+		if (!qs->hidden[i])
+		{
+			pdesc->types[n] = column_type_class(PQftype(result, i));
+			pdesc->columns_map[n] = n;
+			n += 1;
+		}
+	}
+
+	/* calculate necessary size of header data */
+	size = 0;
+	for (i = 0; i < qs->nfields; i++)
+		if (!qs->hidden[i])
+			size += strlen(PQfname(result, i)) + 1;
+
+	locbuf = malloc(size);
+	if (!locbuf)
+		leave("out of memory");
+
+	/* store header */
+	row = malloc(offsetof(RowType, fields) + (qs->visible_fields * sizeof(char *)));
+	if (!row)
+		leave("out of memory");
+
+	row->nfields = qs->visible_fields;
+
+	n = 0;
+	for (i = 0; i < qs->nfields; i++)
+	{
+		char   *name = PQfname(result, i);
+
+		if (qs->hidden[i])
+			continue;
+
+		strcpy(locbuf, name);
+		row->fields[n++] = locbuf;
+		locbuf += strlen(name) + 1;
+	}
+
+	*rb = push_row(*rb, row, false);
+	if (!*rb)
+		leave("out of memory");
+
+	qs->has_header = true;
+}
+
+/*
+ * Receive rows of result and store them to row buckets. When max_rows
+ * is positive, then receiving is stopped after max_rows rows. The rows
+ * of first result with tuples are used, following results are ignored.
+ */
+static bool
+receive_rows(PgQueryStream *qs,
+			 Options *opts,
+			 RowBucketType *rb,
+			 PrintDataDesc *pdesc,
+			 int max_rows,
+			 int *nrows,
+			 const char **err)
+{
+	PGresult   *result;
+
+	*nrows = 0;
+
+	while (!qs->finished && (max_rows <= 0 || *nrows < max_rows))
+	{
+		ExecStatusType status;
+		int			i;
+		uint64_t	start_wait = stats_clock();
+
+		result = PQgetResult(qs->conn);
+		stats_timer_stop(STATS_PGWAIT, start_wait);
+
+		if (!result)
+		{
+			qs->finished = true;
+
+			if (!qs->has_header)
+			{
+				*err = "Query doesn't return data";
+				return false;
+			}
+
+			break;
+		}
+
+		status = PQresultStatus(result);
+
+		/* commands before query, like SET, are ignored */
+		if (status == PGRES_COMMAND_OK && !qs->has_header)
+		{
+			PQclear(result);
+			continue;
+		}
+
+		if (status != PGRES_SINGLE_TUPLE && status != PGRES_TUPLES_OK)
+		{
+			sprintf(errmsg, "Query doesn't return data: %s", PQerrorMessage(qs->conn));
+			PQclear(result);
+
+			/* the query is finished, release other results */
+			while ((result = PQgetResult(qs->conn)))
+				PQclear(result);
+
+			qs->finished = true;
+
+			*err = errmsg;
+			return false;
+		}
+
+		if (!qs->has_header)
+			store_header(qs, result, opts, &rb, pdesc);
+
+		/* without single row mode the result can have more rows */
+		for (i = 0; i < PQntuples(result); i++)
+		{
+			RowType	   *row;
+
+			row = copy_row(qs, result, i);
+			if (!row)
+			{
+				PQclear(result);
+				leave("out of memory");
+			}
+
+			rb = push_row(rb, row, false);
+			if (!rb)
+			{
+				PQclear(result);
+				leave("out of memory");
+			}
+
+			*nrows += 1;
+		}
+
+		PQclear(result);
+
+		if (status == PGRES_TUPLES_OK)
+		{
+			/* release results of other statements */
+			while ((result = PQgetResult(qs->conn)))
+				PQclear(result);
+
+			qs->finished = true;
+		}
+	}
+
+	stats_counter_add(STATS_ROWS_READ, *nrows);
+
+	return true;
+}
+
+/*
+ * Returns new connection or NULL. The password can be prompted.
+ */
+static PGconn *
+pg_connect(Options *opts, const char **err)
+{
+	PGconn	   *conn;
 	char	   *password;
+	uint64_t	start_wait;
 
 	const char *keywords[8];
 	const char *values[8];
 
-	bool	   *hidden;
-
-	rb->nrows = 0;
-	rb->next_bucket = NULL;
-
 	if (opts->force_password_prompt && !opts->password)
 	{
 		password = getpass("Password: ");
 		opts->password = strdup(password);
 		if (!opts->password)
-			EXIT_OUT_OF_MEMORY();
+			leave("out of memory");
 	}
 
 	keywords[0] = "host"; values[0] = opts->host;
@@ -256,145 +619,251 @@ pg_exec_query(Options *opts, char *query, RowBucketType *rb, PrintDataDesc *pdes
 	keywords[6] = "client_encoding"; values[6] = getenv("PGCLIENTENCODING") ? NULL : "auto";
 	keywords[7] = NULL; values[7] = NULL;
 
+	start_wait = stats_clock();
 	conn = PQconnectdbParams(keywords, values, true);
+	stats_timer_stop(STATS_PGWAIT, start_wait);
 
 	if (PQstatus(conn) == CONNECTION_BAD &&
 		PQconnectionNeedsPassword(conn) &&
 		!opts->password)
 	{
+		PQfinish(conn);
+
 		password = getpass("Password: ");
 		opts->password = strdup(password);
 		if (!opts->password)
-				EXIT_OUT_OF_MEMORY();
+			leave("out of memory");
 
 		keywords[3] = "password"; values[3] = opts->password;
 
+		start_wait = stats_clock();
 		conn = PQconnectdbParams(keywords, values, true);
+		stats_timer_stop(STATS_PGWAIT, start_wait);
 	}
 
 	/* Check to see that the backend connection was successfully made */
 	if (PQstatus(conn) != CONNECTION_OK)
 	{
 		sprintf(errmsg, "Connection to database failed: %s", PQerrorMessage(conn));
-		RELEASE_AND_LEAVE(errmsg);
+		PQfinish(conn);
+
+		*err = errmsg;
+		return NULL;
+	}
+
+	return conn;
+}
+
+/*
+ * Reset persistent connection. Prepared statements are lost.
+ */
+static void
+reset_persistent_connection(void)
+{
+	PQreset(pconn.conn);
+
+	pconn.prepared = false;
+}
+
+/*
+ * Sends query in single row mode. The persistent connection can use
+ * prepared statement, when it is allowed.
+ */
+static bool
+send_query(PgQueryStream *qs, Options *opts, char *query, const char **err)
+{
+	int			rc;
+
+	if (qs->persistent && opts->prepared_query &&
+		!pconn.prepared && !pconn.cannot_prepare)
+	{
+		PGresult   *result;
+
+		result = PQprepare(qs->conn, PREPARED_QUERY_NAME, query, 0, NULL);
+
+		if (PQresultStatus(result) == PGRES_COMMAND_OK)
+		{
+			log_row("query is prepared");
+			pconn.prepared = true;
+		}
+		else if (PQstatus(qs->conn) == CONNECTION_OK)
+		{
+			/* query with more statements cannot be prepared */
+			log_row("cannot to prepare query: %s", PQerrorMessage(qs->conn));
+			pconn.cannot_prepare = true;
+		}
+
+		PQclear(result);
 	}
 
-	/*
-	 * ToDo: Because data are copied to local memory, the result can be fetched.
-	 * It can save 1/2 memory.
-	 */
-	result = PQexec(conn, query);
-	if (PQresultStatus(result) != PGRES_TUPLES_OK)
+	if (qs->persistent && pconn.prepared)
+		rc = PQsendQueryPrepared(qs->conn, PREPARED_QUERY_NAME, 0, NULL, NULL, NULL, 0);
+	else
+		rc = PQsendQuery(qs->conn, query);
+
+	if (!rc)
 	{
-		sprintf(errmsg, "Query doesn't return data: %s", PQerrorMessage(conn));
-		RELEASE_AND_LEAVE(errmsg);
+		sprintf(errmsg, "Query doesn't return data: %s", PQerrorMessage(qs->conn));
+		*err = errmsg;
+		return false;
 	}
 
-	if ((nfields = PQnfields(result)) > 1024)
-		RELEASE_AND_EXIT("too much columns");
+	/* rows are copied to local memory, so libpq doesn't need to hold them */
+	if (!PQsetSingleRowMode(qs->conn))
+		log_row("cannot to set single row mode");
 
-	hidden = smalloc(1024 * sizeof(bool));
+	return true;
+}
 
-	pdesc->nfields = mark_hidden_columns(result, nfields, opts, hidden);
+/*
+ * Returns query stream with sent query, or NULL. In watch mode the
+ * persistent connection is used. When the connection is used by
+ * previous not finished result, then an new connection is used.
+ */
+static PgQueryStream *
+start_query(Options *opts, char *query, bool *reused, const char **err)
+{
+	PgQueryStream *qs;
+	bool		persistent;
 
-	pdesc->has_header = true;
-	n = 0;
-	for (i = 0; i < nfields; i++)
-		if (!hidden[i])
-			pdesc->types[n++] = column_type_class(PQftype(result, i));
+	*reused = false;
 
-	/* calculate necessary size of header data */
-	size = 0;
-	for (i = 0; i < nfields; i++)
-		if (!hidden[i])
-			size += strlen(PQfname(result, i)) + 1;
+	persistent = opts->watch_time > 0 && !pconn.busy;
 
-	locbuf = malloc(size);
-	if (!locbuf)
-		EXIT_OUT_OF_MEMORY();
+	qs = smalloc(sizeof(PgQueryStream));
+	qs->persistent = persistent;
 
-	/* store header */
-	row = malloc(offsetof(RowType, fields) + (pdesc->nfields * sizeof(char *)));
-	if (!row)
-		EXIT_OUT_OF_MEMORY();
+	if (persistent && pconn.conn)
+	{
+		if (PQstatus(pconn.conn) != CONNECTION_OK)
+			reset_persistent_connection();
+
+		qs->conn = pconn.conn;
+		*reused = true;
+	}
+	else
+	{
+		qs->conn = pg_connect(opts, err);
+		if (!qs->conn)
+		{
+			free(qs);
+			return NULL;
+		}
+
+		if (persistent)
+		{
+			pconn.conn = qs->conn;
+			pconn.prepared = false;
+		}
+	}
 
-	row->nfields = nfields;
+	if (persistent)
+		pconn.busy = true;
 
-	multiline_row = false;
-	n = 0;
-	for (i = 0; i < nfields; i++)
+	if (!send_query(qs, opts, query, err))
 	{
-		char   *name = PQfname(result, i);
+		if (*reused && PQstatus(qs->conn) == CONNECTION_BAD)
+		{
+			log_row("connection is broken, try to reconnect");
 
-		if (hidden[i])
-			continue;
+			reset_persistent_connection();
+			*reused = false;
 
-		strcpy(locbuf, name);
-		row->fields[n] = locbuf;
-		locbuf += strlen(name) + 1;
+			if (PQstatus(qs->conn) == CONNECTION_OK &&
+				send_query(qs, opts, query, err))
+				return qs;
+		}
 
-		pdesc->widths[n] = field_info(row->fields[n], &multiline_col);
-		pdesc->multilines[n++] = multiline_col;
+		qs->finished = true;
+		pg_query_stream_free(qs);
 
-		multiline_row |= multiline_col;
+		return NULL;
 	}
 
-	rb = push_row(rb, row, multiline_row);
-	if (!rb)
-		EXIT_OUT_OF_MEMORY();
+	return qs;
+}
 
-	/* calculate size for any row and store it */
-	for (i = 0; i < PQntuples(result); i++)
-	{
-		size = 0;
-		for (j = 0; j < nfields; j++)
-			if (!hidden[j])
-				size += strlen(PQgetvalue(result, i, j)) + 1;
+#endif
+
+/*
+ * exit on fatal error, or return error. When max_rows is positive,
+ * then only first max_rows rows are received, and when the result can
+ * have more rows, then qs is set, and other rows can be received by
+ * pg_fetch_rows.
+ */
+bool
+pg_exec_query(Options *opts,
+			  char *query,
+			  RowBucketType *rb,
+			  PrintDataDesc *pdesc,
+			  int max_rows,
+			  struct PgQueryStream **qsptr,
+			  const char **err)
+{
+
+	log_row("execute query \"%s\"", query);
 
-		locbuf = malloc(size);
-		if (!locbuf)
-			EXIT_OUT_OF_MEMORY();
+#ifdef HAVE_POSTGRESQL
 
-		/* store data */
-		row = malloc(offsetof(RowType, fields) + (pdesc->nfields * sizeof(char *)));
-		if (!row)
-			EXIT_OUT_OF_MEMORY();
+	PgQueryStream *qs;
+	bool		reused;
+	int			nrows;
 
-		row->nfields = pdesc->nfields;
+	rb->nrows = 0;
+	rb->next_bucket = NULL;
 
-		multiline_row = false;
-		n = 0;
-		for (j = 0; j < nfields; j++)
-		{
-			char	*value;
+	*qsptr = NULL;
 
-			if (hidden[j])
-				continue;
+	/* the query can be sent already by pg_send_query */
+	if (pending_qs)
+	{
+		qs = pending_qs;
+		reused = pending_reused;
 
-			value = PQgetvalue(result, i, j);
+		pending_qs = NULL;
+	}
+	else
+	{
+		qs = start_query(opts, query, &reused, err);
+		if (!qs)
+			return false;
+	}
 
-			strcpy(locbuf, value);
-			row->fields[n] = locbuf;
-			locbuf += strlen(value) + 1;
+	while (!receive_rows(qs, opts, rb, pdesc, max_rows, &nrows, err))
+	{
+		/*
+		 * The reused connection can be closed by server or by pooler
+		 * already. Then the connection is reset, and the query is sent
+		 * again (only once).
+		 */
+		if (reused && rb->nrows == 0 && PQstatus(qs->conn) == CONNECTION_BAD)
+		{
+			log_row("connection is broken, try to reconnect");
 
-			pdesc->widths[n] = max_int(pdesc->widths[n],
-									  field_info(row->fields[n], &multiline_col));
-			pdesc->multilines[n] |= multiline_col;
-			multiline_row |= multiline_col;
+			reset_persistent_connection();
+			reused = false;
 
-			pdesc->columns_map[n] = n;
-			n += 1;
+			qs->has_header = false;
+			qs->finished = false;
+
+			if (PQstatus(qs->conn) == CONNECTION_OK &&
+				send_query(qs, opts, query, err))
+				continue;
 		}
 
-		rb = push_row(rb, row, multiline_row);
-		if (!rb)
-			EXIT_OUT_OF_MEMORY();
+		qs->finished = true;
+		pg_query_stream_free(qs);
+
+		return false;
 	}
 
-	free(hidden);
+	/* widths and multiline flags of header and data rows */
+	calculate_fields_info(rb, nrows + 1, pdesc);
 
-	PQclear(result);
-	PQfinish(conn);
+	if (!qs->finished)
+		*qsptr = qs;
+	else
+		pg_query_stream_free(qs);
 
 	*err = NULL;
 
@@ -405,7 +874,63 @@ pg_exec_query(Options *opts, char *query, RowBucketType *rb, PrintDataDesc *pdes
 	(void) rb;
 	(void) pdesc;
 	(void) opts;
+	(void) max_rows;
+
+	*qsptr = NULL;
+	*err = "Query cannot be executed. The Postgres library was not available at compile time.";
+
+	return false;
+
+#endif
+
+}
+
+/*
+ * Receive next max_rows rows of result. The widths of columns are
+ * not calculated, only multiline flags of rows are set. more_data
+ * is false, when all rows of result was received.
+ */
+bool
+pg_fetch_rows(struct PgQueryStream *qs,
+			  RowBucketType *rb,
+			  int max_rows,
+			  bool *more_data,
+			  const char **err)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	PrintDataDesc pdesc;
+	int			nrows;
+
+	rb->nrows = 0;
+	rb->next_bucket = NULL;
+
+	*more_data = false;
+
+	if (!receive_rows(qs, NULL, rb, NULL, max_rows, &nrows, err))
+		return false;
 
+	if (nrows > 0)
+	{
+		pdesc.nfields = qs->visible_fields;
+		calculate_fields_info(rb, nrows, &pdesc);
+	}
+
+	*more_data = !qs->finished;
+	*err = NULL;
+
+	log_row("fetched %d rows", nrows);
+
+	return true;
+
+#else
+
+	(void) qs;
+	(void) rb;
+	(void) max_rows;
+
+	*more_data = false;
 	*err = "Query cannot be executed. The Postgres library was not available at compile time.";
 
 	return false;
@@ -413,3 +938,174 @@ pg_exec_query(Options *opts, char *query, RowBucketType *rb, PrintDataDesc *pdes
 #endif
 
 }
+
+/*
+ * Close connection. When the result was not received completely,
+ * then the query is canceled.
+ */
+void
+pg_query_stream_free(struct PgQueryStream *qs)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	if (!qs)
+		return;
+
+	if (!qs->finished)
+	{
+		PGcancel   *cancel = PQgetCancel(qs->conn);
+		PGresult   *result;
+		char		errbuf[256];
+
+		if (cancel)
+		{
+			if (!PQcancel(cancel, errbuf, sizeof(errbuf)))
+				log_row("cannot to cancel query: %s", errbuf);
+
+			PQfreeCancel(cancel);
+		}
+
+		while ((result = PQgetResult(qs->conn)))
+			PQclear(result);
+	}
+
+	if (qs->persistent)
+		pconn.busy = false;
+	else
+		PQfinish(qs->conn);
+
+	free(qs);
+
+#else
+
+	(void) qs;
+
+#endif
+
+}
+
+/*
+ * Close persistent connection
+ */
+void
+pg_close_connection(void)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	if (pconn.conn && !pconn.busy)
+	{
+		PQfinish(pconn.conn);
+		pconn.conn = NULL;
+	}
+
+#endif
+
+}
+
+/*
+ * Sends query without waiting on result. The result is received by
+ * next call of pg_exec_query, when pg_query_is_ready returns true.
+ */
+bool
+pg_send_query(Options *opts, char *query, const char **err)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	log_row("send query \"%s\"", query);
+
+	pending_qs = start_query(opts, query, &pending_reused, err);
+
+	return pending_qs != NULL;
+
+#else
+
+	(void) opts;
+	(void) query;
+
+	*err = "Query cannot be executed. The Postgres library was not available at compile time.";
+
+	return false;
+
+#endif
+
+}
+
+/*
+ * Returns socket of sent query, that is waiting on result, or -1.
+ */
+int
+pg_query_socket(void)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	return pending_qs ? PQsocket(pending_qs->conn) : -1;
+
+#else
+
+	return -1;
+
+#endif
+
+}
+
+/*
+ * Returns true, when the result of sent query (or an error) can
+ * be received without waiting.
+ */
+bool
+pg_query_is_ready(void)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	if (!pending_qs)
+		return false;
+
+	/* broken connection, the error is available */
+	if (!PQconsumeInput(pending_qs->conn))
+		return true;
+
+	return !PQisBusy(pending_qs->conn);
+
+#else
+
+	return false;
+
+#endif
+
+}
+
+/*
+ * Sends cancel request for sent query. The result (an error usually)
+ * should be received still.
+ */
+void
+pg_cancel_query(void)
+{
+
+#ifdef HAVE_POSTGRESQL
+
+	PGcancel   *cancel;
+	char		errbuf[256];
+
+	if (!pending_qs)
+		return;
+
+	cancel = PQgetCancel(pending_qs->conn);
+	if (cancel)
+	{
+		if (!PQcancel(cancel, errbuf, sizeof(errbuf)))
+			log_row("cannot to cancel query: %s", errbuf);
+		else
+			log_row("query is canceled");
+
+		PQfreeCancel(cancel);
+	}
+
+#endif
+
+}
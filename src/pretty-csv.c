@@ -11,6 +11,7 @@
  *-------------------------------------------------------------------------
  */
 #include <ctype.h>
+#include <errno.h>
 #include <libgen.h>
 #include <limits.h>
 #include <locale.h>
@@ -19,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #include "inputs.h"
 #include "pspg.h"
@@ -28,6 +30,20 @@
 #define offsetof(type, field)	((long) &((type *)0)->field)
 #endif							/* offsetof */
 
+#define CSV_INPUT_BLOCK_SIZE		(256 * 1024)
+
+/*
+ * Input of csv and tsv parsers is read by blocks, and the runs of
+ * ordinary chars are copied from this buffer at once.
+ */
+typedef struct
+{
+	char	   *data;
+	size_t		len;				/* number of valid bytes */
+	size_t		pos;				/* position of next byte */
+	bool		eof;
+} CsvInput;
+
 typedef struct
 {
 	char	   *buffer;
@@ -43,6 +59,10 @@ typedef struct
 	size_t		widths[1024];			/* column's display width */
 	bool		multilines[1024];		/* true if column has multiline row */
 	bool		hidden[1024];
+	bool		started;			/* true, when some data was read already */
+	char		sep;				/* csv separator detected by previous read */
+	bool		found_string;		/* csv parser state saved by previous read */
+	CsvInput	input;
 } LinebufType;
 
 typedef struct
@@ -51,8 +71,10 @@ typedef struct
 	int			used;
 	int			size;
 	int			free;
+	DataDesc   *desc;
 	LineBuffer *linebuf;
 	int			flushed_rows;		/* number of flushed rows */
+	int			printed_rows;		/* number of printed data rows (with header) */
 	int			maxbytes;
 	bool		printed_headline;
 } PrintbufType;
@@ -64,8 +86,38 @@ typedef struct
 	bool		double_header;
 	char		header_mode;
 	bool		ignore_short_rows;
+	bool		cut_long_fields;	/* widths are from sample, longer values are cut */
 } PrintConfigType;
 
+/*
+ * Number of rows formatted by one read_and_format_next call
+ */
+#define CSV_STREAM_CHUNK_ROWS		20000
+
+/*
+ * Minimal number of rows of completely read data, that are formatted
+ * by chunks. The first chunk is formatted immediately, and others when
+ * pspg waits on user.
+ */
+#define CSV_DEFERRED_FORMAT_MIN_ROWS	(2 * CSV_STREAM_CHUNK_ROWS)
+
+/*
+ * State of progressive formatting of csv or tsv document or of query
+ * result. The widths and types of columns are calculated from first rows,
+ * and the next rows are formatted immediately with these widths. Raw rows
+ * are released after formatting. When all data was read already, then
+ * widths are from all rows, and only formatting of parsed rows is deferred.
+ */
+typedef struct CsvStream
+{
+	LinebufType	linebuf;
+	PrintConfigType pconfig;
+	PrintDataDesc pdesc;
+	PrintbufType printbuf;
+	struct PgQueryStream *query_stream;	/* not received rows of query or NULL */
+	RowBucketType *parsed_rows;		/* parsed but not formatted rows or NULL */
+} CsvStream;
+
 /*
  * Add new row to LineBuffer
  */
@@ -75,19 +127,9 @@ pb_flush_line(PrintbufType *printbuf)
 	char	   *line;
 
 	if (printbuf->linebuf->nrows == LINEBUFFER_LINES)
-	{
-		LineBuffer *nb = smalloc2(sizeof(LineBuffer), "serialize csv output");
-
-		memset(nb, 0, sizeof(LineBuffer));
-
-		printbuf->linebuf->next = nb;
-		nb->prev = printbuf->linebuf;
-		printbuf->linebuf = nb;
-	}
+		printbuf->linebuf = lb_alloc(printbuf->desc, printbuf->linebuf);
 
-	line = smalloc2(printbuf->used + 1, "serialize csv output");
-	memcpy(line, printbuf->buffer, printbuf->used);
-	line[printbuf->used] = '\0';
+	line = arena_strndup(LB_ROWS_ARENA(printbuf->linebuf), printbuf->buffer, printbuf->used);
 
 	printbuf->linebuf->rows[printbuf->linebuf->nrows++] = line;
 
@@ -397,24 +439,59 @@ pb_put_line(char *str, bool multiline, PrintbufType *printbuf)
 }
 
 /*
- * Print formatted data loaded inside RowBuckets
+ * Writes the line of field cut to width display columns. Last column
+ * holds the mark of cut value. Returns pointer to next line of multiline
+ * field or NULL.
  */
-static void
-pb_print_rowbuckets(PrintbufType *printbuf,
-				   RowBucketType *rb,
-				   PrintConfigType *pconfig,
-				   PrintDataDesc *pdesc,
-				   char *title)
+static char *
+pb_put_cut_line(char *str, int width, PrintbufType *printbuf, char linestyle)
 {
-	bool	is_last_column_multiline = pdesc->multilines[pdesc->nfields - 1];
-	int		last_column_num = pdesc->nfields - 1;
-	int		printed_rows = 0;
-	char	linestyle = pconfig->linestyle;
-	int		border = pconfig->border;
-	char	buffer[20];
+	char   *ptr = str;
+	char   *nextline;
+	int		dsplen = 0;
+
+	if (width < 1)
+		return NULL;
+
+	while (*ptr && *ptr != '\n')
+	{
+		int		chrw = use_utf8 ? utf_dsplen(ptr) : 1;
+
+		if (chrw < 0)
+			chrw = 0;
+
+		if (dsplen + chrw > width - 1)
+			break;
+
+		dsplen += chrw;
+		ptr += charlen(ptr);
+	}
 
+	pb_write(printbuf, str, ptr - str);
+	pb_putc_repeat(printbuf, width - 1 - dsplen, ' ');
+
+	if (linestyle == 'a')
+		pb_putc(printbuf, '~');
+	else
+		pb_write(printbuf, "\342\200\246", 3);
+
+	nextline = strchr(ptr, '\n');
+
+	return nextline ? nextline + 1 : NULL;
+}
+
+/*
+ * Print title and top border
+ */
+static void
+pb_print_head(PrintbufType *printbuf,
+			  PrintConfigType *pconfig,
+			  PrintDataDesc *pdesc,
+			  char *title)
+{
 	printbuf->printed_headline = false;
 	printbuf->flushed_rows = 0;
+	printbuf->printed_rows = 0;
 	printbuf->maxbytes = 0;
 
 	if (title)
@@ -424,6 +501,21 @@ pb_print_rowbuckets(PrintbufType *printbuf,
 	}
 
 	pb_print_vertical_header(printbuf, pdesc, pconfig, 't');
+}
+
+/*
+ * Print formatted rows loaded inside RowBuckets
+ */
+static void
+pb_print_rows(PrintbufType *printbuf,
+			  RowBucketType *rb,
+			  PrintConfigType *pconfig,
+			  PrintDataDesc *pdesc)
+{
+	bool	is_last_column_multiline = pdesc->multilines[pdesc->nfields - 1];
+	int		last_column_num = pdesc->nfields - 1;
+	char	linestyle = pconfig->linestyle;
+	int		border = pconfig->border;
 
 	while (rb)
 	{
@@ -460,7 +552,7 @@ pb_print_rowbuckets(PrintbufType *printbuf,
 				else if (border == 1)
 					pb_write(printbuf, " ", 1);
 
-				isheader = printed_rows == 0 ? pdesc->has_header : false;
+				isheader = printbuf->printed_rows == 0 ? pdesc->has_header : false;
 
 				for (j = 0; j < pdesc->nfields; j++)
 				{
@@ -530,30 +622,42 @@ pb_print_rowbuckets(PrintbufType *printbuf,
 
 						spaces = pdesc->widths[j] - width;
 
-						/*
-						 * The display width can be canculated badly when labels or
-						 * displayed string has some special or invisible chars. Here
-						 * is simple ugly fix - the number of spaces cannot be negative.
-						 */
-						if (spaces < 0)
-							spaces = 0;
-
-						/* left spaces */
-						if (isheader)
-							pb_putc_repeat(printbuf, spaces / 2, ' ');
-						else if (!left_align)
-							pb_putc_repeat(printbuf, spaces, ' ');
-
-						if (multiline)
-							fields[j] = pb_put_line(field, multiline, printbuf);
+						/* the widths are from sample, and the value is too long */
+						if (spaces < 0 && pconfig->cut_long_fields)
+						{
+							char   *nextline;
+
+							nextline = pb_put_cut_line(field, pdesc->widths[j], printbuf, linestyle);
+							if (multiline)
+								fields[j] = nextline;
+						}
 						else
-							(void) pb_put_line(field, multiline, printbuf);
+						{
+							/*
+							 * The display width can be canculated badly when labels or
+							 * displayed string has some special or invisible chars. Here
+							 * is simple ugly fix - the number of spaces cannot be negative.
+							 */
+							if (spaces < 0)
+								spaces = 0;
+
+							/* left spaces */
+							if (isheader)
+								pb_putc_repeat(printbuf, spaces / 2, ' ');
+							else if (!left_align)
+								pb_putc_repeat(printbuf, spaces, ' ');
+
+							if (multiline)
+								fields[j] = pb_put_line(field, multiline, printbuf);
+							else
+								(void) pb_put_line(field, multiline, printbuf);
 
-						/* right spaces */
-						if (isheader)
-							pb_putc_repeat(printbuf, spaces - (spaces / 2), ' ');
-						else if (left_align)
-							pb_putc_repeat(printbuf, spaces, ' ');
+							/* right spaces */
+							if (isheader)
+								pb_putc_repeat(printbuf, spaces - (spaces / 2), ' ');
+							else if (left_align)
+								pb_putc_repeat(printbuf, spaces, ' ');
+						}
 					}
 					else
 						pb_putc_repeat(printbuf, pdesc->widths[j], ' ');
@@ -588,21 +692,47 @@ pb_print_rowbuckets(PrintbufType *printbuf,
 					printbuf->printed_headline = true;
 				}
 
-				printed_rows += 1;
+				printbuf->printed_rows += 1;
 				multiline_lineno += 1;
 			}
 		}
 
 		rb = rb->next_bucket;
 	}
+}
+
+/*
+ * Print bottom border and footer
+ */
+static void
+pb_print_tail(PrintbufType *printbuf,
+			  PrintConfigType *pconfig,
+			  PrintDataDesc *pdesc)
+{
+	char	buffer[20];
 
 	pb_print_vertical_header(printbuf, pdesc, pconfig, 'b');
 
-	snprintf(buffer, 20, "(%d rows)", printed_rows - (printbuf->printed_headline ? 1 : 0));
+	snprintf(buffer, 20, "(%d rows)", printbuf->printed_rows - (printbuf->printed_headline ? 1 : 0));
 	pb_puts(printbuf, buffer);
 	pb_flush_line(printbuf);
 }
 
+/*
+ * Print formatted data loaded inside RowBuckets
+ */
+static void
+pb_print_rowbuckets(PrintbufType *printbuf,
+				   RowBucketType *rb,
+				   PrintConfigType *pconfig,
+				   PrintDataDesc *pdesc,
+				   char *title)
+{
+	pb_print_head(printbuf, pconfig, pdesc, title);
+	pb_print_rows(printbuf, rb, pconfig, pdesc);
+	pb_print_tail(printbuf, pconfig, pdesc);
+}
+
 /*
  * Try to detect column type and prepare all data necessary for printing
  */
@@ -662,6 +792,27 @@ append_char(LinebufType *linebuf, char c)
 	linebuf->buffer[linebuf->used++] = c;
 }
 
+/*
+ * Save bytes to linebuffer
+ */
+inline static void
+append_bytes(LinebufType *linebuf, const char *str, int size)
+{
+	if (linebuf->used + size > linebuf->size)
+	{
+		while (linebuf->used + size > linebuf->size)
+			linebuf->size += linebuf->size < (10 * 1024) ? linebuf->size  : (10 * 1024);
+
+		linebuf->buffer = realloc(linebuf->buffer, linebuf->size);
+
+		if (!linebuf->buffer)
+			leave("out of memory while read csv or tsv data");
+	}
+
+	memcpy(linebuf->buffer + linebuf->used, str, size);
+	linebuf->used += size;
+}
+
 /*
  * Save string to linebuffer
  */
@@ -684,6 +835,22 @@ append_str(LinebufType *linebuf, char *str)
 }
 
 
+/*
+ * Returns allocated string, that holds all fields of row. It is first
+ * not hidden field (fields of hidden columns are NULL).
+ */
+static char *
+row_data(RowType *row)
+{
+	int		i;
+
+	for (i = 0; i < row->nfields; i++)
+		if (row->fields[i])
+			return row->fields[i];
+
+	return NULL;
+}
+
 /*
  * Ensure dynamicaly allocated structure is valid every time.
  */
@@ -706,36 +873,52 @@ prepare_RowBucket(RowBucketType *rb)
 	return rb;
 }
 
+#define COLUMN_STATS_ROWS_PER_WORKER		20000
+
+/*
+ * Widths and format statistics of columns calculated by one worker
+ * for a range of rows. The results of workers are merged to linebuf.
+ */
+typedef struct
+{
+	RowBucketType *rb;				/* bucket of first row */
+	int			rowno;				/* first row in bucket */
+	int			nrows;				/* number of rows */
+	int			maxfields;			/* maxfields before first row */
+	bool		skip_first_row;		/* first row can be header */
+	bool		ignore_short_rows;
+	bool	   *hidden;
+	long int	digits[1024];
+	long int	tsizes[1024];
+	int			firstdigit[1024];
+	size_t		widths[1024];
+	bool		multilines[1024];
+} ColumnStatsTask;
+
 /*
  * Calculate width of columns
  */
 static void
 postprocess_fields(int nfields,
 				   RowType *row,
-				   LinebufType *linebuf,
-				   bool ignore_short_rows,
-				   bool reduced_sizes,			/* the doesn't calculate ending zero */
+				   ColumnStatsTask *task,
+				   bool malformed,
+				   bool skip_stats,
 				   bool *is_multiline_row)
 {
-	bool		malformed;
 	size_t		width;
 	int		i;
 
-	if (ignore_short_rows)
-		malformed = linebuf->maxfields > 0 && nfields != linebuf->maxfields;
-	else
-		malformed = false;
-
 	*is_multiline_row = false;
 
 	for (i = 0; i < nfields; i++)
 	{
 		long int	digits = 0;
 		long int	total = 0;
-		bool		multiline;
+		bool		multiline = false;
 
 		/* don't calculate width for hidden columns */
-		if (linebuf->hidden[i])
+		if (task->hidden[i])
 			continue;
 
 		if (!use_utf8)
@@ -765,32 +948,87 @@ postprocess_fields(int nfields,
 			width = cw > width ? cw : width;
 		}
 		else
+			/* the fields are zero terminated */
 			width = utf_string_dsplen_multiline(row->fields[i],
-												linebuf->sizes[i] - (reduced_sizes ? 0 : 1),
+												SIZE_MAX,
 												&multiline,
 												false,
 												&digits,
 												&total);
 
 		/* skip first possible header row */
-		if (linebuf->processed > 0)
+		if (!skip_stats)
 		{
-			linebuf->tsizes[i] += total;
-			linebuf->digits[i] += digits;
+			task->tsizes[i] += total;
+			task->digits[i] += digits;
 
 			if (isdigit(*row->fields[i]))
-				linebuf->firstdigit[i]++;
+				task->firstdigit[i]++;
 		}
 
 		if (!malformed)
 		{
-			if (width > linebuf->widths[i])
-				linebuf->widths[i] = width;
+			if (width > task->widths[i])
+				task->widths[i] = width;
 
 			*is_multiline_row |= multiline;
-			linebuf->multilines[i] |= multiline;
+			task->multilines[i] |= multiline;
 		}
 	}
+}
+
+static void *
+column_stats_task(void *arg)
+{
+	ColumnStatsTask *task = (ColumnStatsTask *) arg;
+	RowBucketType *rb = task->rb;
+	int			rowno = task->rowno;
+	int			maxfields = task->maxfields;
+	int			i;
+
+	for (i = 0; i < task->nrows; i++)
+	{
+		RowType	   *row;
+		bool		malformed = false;
+
+		if (rowno >= rb->nrows)
+		{
+			rb = rb->next_bucket;
+			rowno = 0;
+		}
+
+		row = rb->rows[rowno];
+
+		if (task->ignore_short_rows)
+			malformed = maxfields > 0 && row->nfields != maxfields;
+
+		postprocess_fields(row->nfields,
+						   row,
+						   task,
+						   malformed,
+						   i == 0 && task->skip_first_row,
+						   &rb->multilines[rowno]);
+
+		if (row->nfields > maxfields)
+			maxfields = row->nfields;
+
+		rowno += 1;
+	}
+
+	return NULL;
+}
+
+/*
+ * Updates counters of linebuf for just read row. The widths of
+ * columns are calculated later by calculate_column_stats.
+ */
+static void
+register_row(LinebufType *linebuf, int nfields, bool ignore_short_rows)
+{
+	bool		malformed = false;
+
+	if (ignore_short_rows)
+		malformed = linebuf->maxfields > 0 && nfields != linebuf->maxfields;
 
 	if (nfields > linebuf->maxfields)
 		linebuf->maxfields = nfields;
@@ -799,6 +1037,104 @@ postprocess_fields(int nfields,
 		linebuf->processed += 1;
 }
 
+/*
+ * Calculates widths, multiline flags and format statistics of nrows
+ * rows starting by row rowno of bucket rb. The rows are divided between
+ * parallel workers, and partial results are merged to linebuf.
+ * The maxfields is number of fields before first row, and it is
+ * necessary for detection of malformed rows.
+ */
+static void
+calculate_column_stats(RowBucketType *rb,
+					   int rowno,
+					   int nrows,
+					   int maxfields,
+					   bool skip_first_row,
+					   LinebufType *linebuf,
+					   bool ignore_short_rows)
+{
+	ColumnStatsTask *tasks;
+	int			nworkers;
+	int			i, j;
+
+	if (nrows == 0)
+		return;
+
+	nworkers = parallel_workers(nrows, COLUMN_STATS_ROWS_PER_WORKER);
+	tasks = smalloc(nworkers * sizeof(ColumnStatsTask));
+
+	for (i = 0; i < nworkers; i++)
+	{
+		int			task_rows = (int) ((long) nrows * (i + 1) / nworkers - (long) nrows * i / nworkers);
+		int			n;
+
+		if (rowno >= rb->nrows)
+		{
+			rb = rb->next_bucket;
+			rowno = 0;
+		}
+
+		tasks[i].rb = rb;
+		tasks[i].rowno = rowno;
+		tasks[i].nrows = task_rows;
+		tasks[i].maxfields = maxfields;
+		tasks[i].skip_first_row = i == 0 && skip_first_row;
+		tasks[i].ignore_short_rows = ignore_short_rows;
+		tasks[i].hidden = linebuf->hidden;
+
+		if (i == nworkers - 1)
+			break;
+
+		/* move to first row of next task */
+		n = task_rows;
+		while (n > 0)
+		{
+			int			step;
+
+			if (rowno >= rb->nrows)
+			{
+				rb = rb->next_bucket;
+				rowno = 0;
+			}
+
+			step = rb->nrows - rowno < n ? rb->nrows - rowno : n;
+
+			/* maxfields is necessary only for detection of malformed rows */
+			if (ignore_short_rows)
+			{
+				for (j = rowno; j < rowno + step; j++)
+					if (rb->rows[j]->nfields > maxfields)
+						maxfields = rb->rows[j]->nfields;
+			}
+
+			rowno += step;
+			n -= step;
+		}
+	}
+
+	if (nworkers > 1)
+		log_row("widths of columns are calculated by %d workers", nworkers);
+
+	run_parallel_tasks(column_stats_task, tasks, sizeof(ColumnStatsTask), nworkers);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		for (j = 0; j < linebuf->maxfields; j++)
+		{
+			linebuf->digits[j] += tasks[i].digits[j];
+			linebuf->tsizes[j] += tasks[i].tsizes[j];
+			linebuf->firstdigit[j] += tasks[i].firstdigit[j];
+
+			if (tasks[i].widths[j] > linebuf->widths[j])
+				linebuf->widths[j] = tasks[i].widths[j];
+
+			linebuf->multilines[j] |= tasks[i].multilines[j];
+		}
+	}
+
+	free(tasks);
+}
+
 /*
  * Appends fields to rows without complete set of fields.
  * New fields holds null str.
@@ -869,8 +1205,7 @@ postprocess_rows(RowBucketType *rb,
 					}
 				}
 
-				if (oldrow->nfields > 0)
-					free(oldrow->fields[0]);
+				free(row_data(oldrow));
 
 				free(oldrow);
 
@@ -952,23 +1287,256 @@ mark_hidden_columns(LinebufType *linebuf,
 }
 
 /*
- * Read tsv format from ifile
+ * Reads next block of input. The file descriptor is read directly,
+ * so the read returns available data without waiting on full block.
+ */
+static bool
+input_fill(CsvInput *in, FILE *ifile)
+{
+	ssize_t		rc;
+
+	if (in->eof)
+		return false;
+
+	if (!in->data)
+		in->data = smalloc2(CSV_INPUT_BLOCK_SIZE, "import csv data");
+
+	do
+		rc = read(fileno(ifile), in->data, CSV_INPUT_BLOCK_SIZE);
+	while (rc == -1 && errno == EINTR);
+
+	in->pos = 0;
+
+	if (rc <= 0)
+	{
+		if (rc == -1 && errno != EAGAIN)
+			log_row("cannot to read csv or tsv data (%s)", strerror(errno));
+
+		in->len = 0;
+		in->eof = true;
+
+		return false;
+	}
+
+	in->len = rc;
+
+	stats_counter_add(STATS_BYTES_READ, rc);
+
+	return true;
+}
+
+static inline int
+input_getc(CsvInput *in, FILE *ifile)
+{
+	if (in->pos >= in->len && !input_fill(in, ifile))
+		return EOF;
+
+	return (unsigned char) in->data[in->pos++];
+}
+
+/*
+ * Returns last read char back to input
+ */
+static inline void
+input_ungetc(CsvInput *in, int c)
+{
+	if (c != EOF)
+		in->pos -= 1;
+}
+
+/*
+ * Word at a time classification of bytes
+ */
+#define SWAR_ONES			UINT64_C(0x0101010101010101)
+#define SWAR_HIGHS			UINT64_C(0x8080808080808080)
+#define SWAR_HAS_ZERO(v)	(((v) - SWAR_ONES) & ~(v) & SWAR_HIGHS)
+#define SWAR_HAS_BYTE(w, b)	SWAR_HAS_ZERO((w) ^ (SWAR_ONES * (unsigned char) (b)))
+
+/*
+ * Copy run of ordinary chars of tsv from input buffer. The first char
+ * of run was read by input_getc already. The chars of hidden column
+ * are only skipped. Returns size of copied run.
+ */
+static int
+tsv_copy_run(LinebufType *linebuf, bool hidden)
+{
+	CsvInput   *in = &linebuf->input;
+	const char *data = in->data;
+	size_t		start = in->pos - 1;
+	size_t		p = in->pos;
+
+	while (p + 8 <= in->len)
+	{
+		uint64_t	w;
+
+		memcpy(&w, data + p, 8);
+
+		if (SWAR_HAS_BYTE(w, '\t') | SWAR_HAS_BYTE(w, '\n') |
+			SWAR_HAS_BYTE(w, '\r') | SWAR_HAS_BYTE(w, '\\'))
+			break;
+
+		p += 8;
+	}
+
+	while (p < in->len)
+	{
+		char	c = data[p];
+
+		if (c == '\t' || c == '\n' || c == '\r' || c == '\\')
+			break;
+
+		p += 1;
+	}
+
+	in->pos = p;
+
+	if (hidden)
+		return 0;
+
+	append_bytes(linebuf, data + start, p - start);
+
+	return p - start;
+}
+
+/*
+ * Prepare table of chars, that stops run of ordinary chars of csv
  */
 static void
+init_csv_special(bool *special, char sep)
+{
+	memset(special, 0, 256 * sizeof(bool));
+
+	special['"'] = true;
+	special['\n'] = true;
+	special['\r'] = true;
+
+	if (sep == -1)
+	{
+		/* chars used by automatic separator detection */
+		special[','] = true;
+		special[';'] = true;
+		special['|'] = true;
+	}
+	else
+		special[(unsigned char) sep] = true;
+}
+
+/*
+ * Copy run of ordinary chars of csv from input buffer. The first char
+ * of run was read by input_getc already. The chars are processed same
+ * way like by read_csv - multibyte chars are copied as one char, and
+ * last_nw is moved after last non space char (or after any char inside
+ * string). The run doesn't cross the end of block, so it can be empty,
+ * when the first multibyte char is not complete. The chars of hidden
+ * column are only skipped. Returns true, when some chars were processed.
+ */
+static bool
+csv_copy_run(LinebufType *linebuf,
+			 const bool *special,
+			 char sep,
+			 bool instr,
+			 bool hidden,
+			 int *pos,
+			 int *last_nw)
+{
+	CsvInput   *in = &linebuf->input;
+	const char *data = in->data;
+	size_t		start = in->pos - 1;
+	size_t		p = start;
+	size_t		after_last_nw = 0;
+
+	while (p < in->len)
+	{
+		unsigned char c;
+
+		/* 8 ascii chars without spaces and special chars */
+		if (sep != -1 && p + 8 <= in->len)
+		{
+			uint64_t	w;
+
+			memcpy(&w, data + p, 8);
+
+			if (!((w & SWAR_HIGHS) |
+				  SWAR_HAS_BYTE(w, ' ') | SWAR_HAS_BYTE(w, '"') |
+				  SWAR_HAS_BYTE(w, '\n') | SWAR_HAS_BYTE(w, '\r') |
+				  SWAR_HAS_BYTE(w, sep)))
+			{
+				p += 8;
+				after_last_nw = p;
+				continue;
+			}
+		}
+
+		c = data[p];
+
+		if (special[c])
+			break;
+
+		if (use_utf8 && c >= 0x80)
+		{
+			int		l = utf8charlen(c);
+
+			if (p + l > in->len)
+				break;
+
+			p += l;
+			after_last_nw = p;
+		}
+		else
+		{
+			p += 1;
+			if (instr || c != ' ')
+				after_last_nw = p;
+		}
+	}
+
+	if (p == start)
+		return false;
+
+	if (hidden)
+	{
+		in->pos = p;
+		return true;
+	}
+
+	if (after_last_nw > 0)
+		*last_nw = *pos + (after_last_nw - start);
+
+	*pos += p - start;
+
+	append_bytes(linebuf, data + start, p - start);
+	in->pos = p;
+
+	return true;
+}
+
+/*
+ * Read tsv format from ifile. When max_rows is positive, then reading
+ * is stopped after max_rows rows, and returns true, when there can be
+ * more data. Next call continues by next row.
+ */
+static bool
 read_tsv(RowBucketType *rb,
 		 LinebufType *linebuf,
 		 FILE *ifile,
 		 bool ignore_short_rows,
+		 int max_rows,
 		 Options *opts)
 {
 	bool	closed = false;
 	int		size = 0;
 	int		nfields = 0;
+	int		nrows = 0;
 	int		c;
 	int		nullstr_size = opts->nullstr ? strlen(opts->nullstr) : 0;
 	char   *nullstr = opts->nullstr ? opts->nullstr : "";
+	RowBucketType *first_rb = rb;
+	int		first_rowno = rb->nrows;
+	int		first_maxfields = linebuf->maxfields;
+	bool	skip_first_row = false;
+	bool	skipped_chars = false;	/* some chars of hidden column were skipped */
 
-	c = fgetc(ifile);
+	c = input_getc(&linebuf->input, ifile);
 	do
 	{
 		if (c == '\r')
@@ -979,11 +1547,19 @@ read_tsv(RowBucketType *rb,
 			bool	backslash = false;
 			bool	translated = false;
 
+			/* copy run of ordinary chars at once */
+			if (c != '\\' && c != '\t')
+			{
+				size += tsv_copy_run(linebuf, linebuf->hidden[nfields]);
+				skipped_chars |= linebuf->hidden[nfields];
+				goto next_char;
+			}
+
 			if (c == '\\')
 			{
 				backslash = true;
 
-				c = fgetc(ifile);
+				c = input_getc(&linebuf->input, ifile);
 				if (c != EOF)
 				{
 					/* NULL */
@@ -1014,6 +1590,16 @@ read_tsv(RowBucketType *rb,
 			{
 				if (c == '\t' && !translated)
 				{
+					if (nfields >= 1023)
+						leave("too much columns");
+
+					/* only terminating zero is stored for hidden column */
+					if (linebuf->hidden[nfields])
+					{
+						linebuf->used -= size;
+						size = 0;
+					}
+
 					append_char(linebuf, '\0');
 					linebuf->sizes[nfields++] = size + 1;
 					size = 0;
@@ -1035,68 +1621,108 @@ read_tsv(RowBucketType *rb,
 		{
 			int		i;
 
-			if (linebuf->used > 0)
+			if (linebuf->used > 0 || skipped_chars)
 			{
 				char   *locbuf;
+				char   *src = linebuf->buffer;
+				int		data_size;
 				RowType	   *row;
-				bool	multiline = false;
+
+				if (linebuf->hidden[nfields])
+				{
+					linebuf->used -= size;
+					size = 0;
+				}
 
 				append_char(linebuf, '\0');
 				linebuf->sizes[nfields++] = size + 1;
 
 				rb = prepare_RowBucket(rb);
 
-				locbuf = smalloc2(linebuf->used, "import tsv data");
-				memcpy(locbuf, linebuf->buffer, linebuf->used);
+				data_size = 0;
+				for (i = 0; i < nfields; i++)
+					if (!linebuf->hidden[i])
+						data_size += linebuf->sizes[i];
+
+				locbuf = smalloc2(data_size, "import tsv data");
 
 				row = smalloc2(offsetof(RowType, fields) + (nfields * sizeof(char*)), "import csv data");
 				row->nfields = nfields;
 
+				/* only visible fields are copied */
 				for (i = 0; i < nfields; i++)
 				{
-					row->fields[i] = locbuf;
-					locbuf += linebuf->sizes[i];
+					if (!linebuf->hidden[i])
+					{
+						memcpy(locbuf, src, linebuf->sizes[i]);
+						row->fields[i] = locbuf;
+						locbuf += linebuf->sizes[i];
+					}
+					else
+						row->fields[i] = NULL;
+
+					src += linebuf->sizes[i];
 				}
 
-				if (linebuf->processed == 0 && opts->csv_skip_columns_like)
-					mark_hidden_columns(linebuf, row, nfields, opts);
+				if (linebuf->processed == 0)
+				{
+					if (opts->csv_skip_columns_like)
+						mark_hidden_columns(linebuf, row, nfields, opts);
+
+					skip_first_row = true;
+				}
 
-				postprocess_fields(nfields,
-								   row,
-								   linebuf,
-								   ignore_short_rows,
-								   false,
-								   &multiline);
+				register_row(linebuf, nfields, ignore_short_rows);
 
-				rb->multilines[rb->nrows] = multiline;
+				rb->multilines[rb->nrows] = false;
 				rb->rows[rb->nrows++] = row;
 
 				linebuf->processed += 1;
+				nrows += 1;
 			}
 
 			nfields = 0;
 			linebuf->used = 0;
 			size = 0;
+			skipped_chars = false;
 
 			closed = c == EOF;
+
+			if (!closed && max_rows > 0 && nrows >= max_rows)
+				break;
 		}
 
 next_char:
-		c = fgetc(ifile);
+		c = input_getc(&linebuf->input, ifile);
 
 	} while (!closed);
 
+	calculate_column_stats(first_rb, first_rowno, nrows,
+						   first_maxfields, skip_first_row,
+						   linebuf, ignore_short_rows);
+
+	stats_counter_add(STATS_ROWS_READ, nrows);
+
 	/* append nullstr to missing columns */
 	if (nullstr_size > 0 && !ignore_short_rows)
 		postprocess_rows(rb, linebuf, nullstr);
+
+	linebuf->started = true;
+
+	return !closed;
 }
 
-static void
+/*
+ * Read csv format from ifile. Reading can be stopped after max_rows
+ * rows like read_tsv.
+ */
+static bool
 read_csv(RowBucketType *rb,
 		 LinebufType *linebuf,
 		 char sep,
 		 FILE *ifile,
 		 bool ignore_short_rows,
+		 int max_rows,
 		 Options *opts)
 {
 	bool	skip_initial = true;
@@ -1110,15 +1736,34 @@ read_csv(RowBucketType *rb,
 	int		c;
 	int		nullstr_size = opts->nullstr ? strlen(opts->nullstr) : 0;
 	char   *nullstr = opts->nullstr ? opts->nullstr : "";
+	int		nrows = 0;
+	bool	special[256];
+	char	special_sep;
+	RowBucketType *first_rb = rb;
+	int		first_rowno = rb->nrows;
+	int		first_maxfields = linebuf->maxfields;
+	bool	skip_first_row = false;
+	bool	skipped_chars = false;	/* some chars of hidden column were skipped */
+	bool	hidden;
+
+	/* continue with state of previous read */
+	if (linebuf->started)
+	{
+		sep = linebuf->sep;
+		found_string = linebuf->found_string;
+	}
 
-	c = fgetc(ifile);
+	init_csv_special(special, sep);
+	special_sep = sep;
 
-	if (opts->pgcli_fix && c == '>')
+	c = input_getc(&linebuf->input, ifile);
+
+	if (opts->pgcli_fix && c == '>' && !linebuf->started)
 	{
 		while (c != '\n' && c != EOF)
 		{
 			fputc(c, stdout);
-			c = fgetc(ifile);
+			c = input_getc(&linebuf->input, ifile);
 		}
 
 		fputc('\n', stdout);
@@ -1134,6 +1779,25 @@ read_csv(RowBucketType *rb,
 		{
 			int		l;
 
+			/* copy run of ordinary chars at once */
+			if (!skip_initial && !special[c])
+			{
+				if (sep != special_sep)
+				{
+					init_csv_special(special, sep);
+					special_sep = sep;
+				}
+
+				hidden = nfields < 1024 && linebuf->hidden[nfields];
+
+				if (!special[c] &&
+					csv_copy_run(linebuf, special, sep, instr, hidden, &pos, &last_nw))
+				{
+					skipped_chars |= hidden;
+					goto next_char;
+				}
+			}
+
 			if (skip_initial)
 			{
 				if (c == ' ')
@@ -1147,7 +1811,7 @@ read_csv(RowBucketType *rb,
 			{
 				if (instr)
 				{
-					int		c2 = fgetc(ifile);
+					int		c2 = input_getc(&linebuf->input, ifile);
 
 					if (c2 == '"')
 					{
@@ -1158,7 +1822,7 @@ read_csv(RowBucketType *rb,
 					else
 					{
 						/* start of end of string */
-						ungetc(c2, ifile);
+						input_ungetc(&linebuf->input, c2);
 						instr = false;
 					}
 				}
@@ -1196,7 +1860,17 @@ read_csv(RowBucketType *rb,
 				if (skip_initial)
 					leave("internal error - unexpected value of variable: \"skip_initial\"");
 
-				if (last_nw - first_nw > 0 || found_string || nullstr_size == 0)
+				if (linebuf->hidden[nfields])
+				{
+					/* the chars of hidden column are not stored */
+					linebuf->sizes[nfields] = 0;
+					linebuf->starts[nfields++] = -1;
+
+					skipped_chars = true;
+					linebuf->used = first_nw;
+					pos = first_nw;
+				}
+				else if (last_nw - first_nw > 0 || found_string || nullstr_size == 0)
 				{
 					linebuf->sizes[nfields] = last_nw - first_nw;
 					linebuf->starts[nfields++] = first_nw;
@@ -1228,7 +1902,7 @@ read_csv(RowBucketType *rb,
 				/* read other chars */
 				for (i = 1; i < l; i++)
 				{
-					c = fgetc(ifile);
+					c = input_getc(&linebuf->input, ifile);
 					if (c == EOF)
 					{
 						log_row("unexpected quit, broken unicode char");
@@ -1247,14 +1921,13 @@ read_csv(RowBucketType *rb,
 			RowType	   *row;
 			int			i;
 			int			data_size;
-			bool		multiline;
 
 			if (c == '\n')
 			{
 				/* try to process \nEOF as one symbol */
-				c = fgetc(ifile);
+				c = input_getc(&linebuf->input, ifile);
 				if (c != EOF)
-					ungetc(c, ifile);
+					input_ungetc(&linebuf->input, c);
 			}
 
 			if (!skip_initial && (last_nw - first_nw > 0 || found_string || nullstr_size == 0))
@@ -1279,7 +1952,7 @@ read_csv(RowBucketType *rb,
 				linebuf->starts[nfields++] = -1;
 			}
 
-			if (!linebuf->used)
+			if (!linebuf->used && !skipped_chars)
 				goto next_row;
 
 			rb = prepare_RowBucket(rb);
@@ -1295,8 +1968,6 @@ read_csv(RowBucketType *rb,
 			row = smalloc2(offsetof(RowType, fields) + (nfields * sizeof(char*)), "import csv data");
 			row->nfields = nfields;
 
-			multiline = false;
-
 			for (i = 0; i < nfields; i++)
 			{
 				if (!linebuf->hidden[i])
@@ -1313,23 +1984,26 @@ read_csv(RowBucketType *rb,
 					row->fields[i] = NULL;
 			}
 
-			if (linebuf->processed == 0 && opts->csv_skip_columns_like)
-				mark_hidden_columns(linebuf, row, nfields, opts);
+			if (linebuf->processed == 0)
+			{
+				if (opts->csv_skip_columns_like)
+					mark_hidden_columns(linebuf, row, nfields, opts);
+
+				skip_first_row = true;
+			}
 
-			postprocess_fields(nfields,
-							   row,
-							   linebuf,
-							   ignore_short_rows,
-							   true,
-							   &multiline);
+			register_row(linebuf, nfields, ignore_short_rows);
 
-			rb->multilines[rb->nrows] = multiline;
+			rb->multilines[rb->nrows] = false;
 			rb->rows[rb->nrows++] = row;
 
+			nrows += 1;
+
 next_row:
 
 			linebuf->used = 0;
 			nfields = 0;
+			skipped_chars = false;
 
 			linebuf->processed += 1;
 
@@ -1339,19 +2013,137 @@ next_row:
 			pos = 0;
 
 			closed = c == EOF;
+
+			/* the char after row is not read yet */
+			if (!closed && max_rows > 0 && nrows >= max_rows)
+				break;
 		}
 
 next_char:
 
 		if (!closed)
-			c = fgetc(ifile);
+			c = input_getc(&linebuf->input, ifile);
 
 	}
 	while (!closed);
 
+	calculate_column_stats(first_rb, first_rowno, nrows,
+						   first_maxfields, skip_first_row,
+						   linebuf, ignore_short_rows);
+
+	stats_counter_add(STATS_ROWS_READ, nrows);
+
 	/* append nullstr to missing columns */
 	if (nullstr_size > 0 && !ignore_short_rows)
 		postprocess_rows(rb, linebuf, nullstr);
+
+	linebuf->started = true;
+	linebuf->sep = sep;
+	linebuf->found_string = found_string;
+
+	return !closed;
+}
+
+/*
+ * Release rows stored in row buckets. The first bucket is not released.
+ */
+static void
+free_rowbuckets(RowBucketType *rb)
+{
+	while (rb)
+	{
+		RowBucketType	*nextrb;
+		int		i;
+
+		for (i = 0; i < rb->nrows; i++)
+		{
+			RowType	   *r = rb->rows[i];
+
+			free(row_data(r));
+			free(r);
+		}
+
+		nextrb = rb->next_bucket;
+		if (rb->allocated)
+			free(rb);
+		rb = nextrb;
+	}
+}
+
+/*
+ * Cut chain of row buckets after bucket, that holds nrows-th row.
+ * Returns the rest of chain or NULL. Only first bucket of chain can
+ * be not allocated, so the rest can be released by free_rowbuckets.
+ */
+static RowBucketType *
+split_rowbuckets(RowBucketType *rb, int nrows)
+{
+	RowBucketType *rest;
+
+	while (rb->next_bucket && rb->nrows < nrows)
+	{
+		nrows -= rb->nrows;
+		rb = rb->next_bucket;
+	}
+
+	rest = rb->next_bucket;
+	rb->next_bucket = NULL;
+
+	return rest;
+}
+
+/*
+ * Returns number of rows stored in chain of row buckets
+ */
+static int
+rowbuckets_nrows(RowBucketType *rb)
+{
+	int		nrows = 0;
+
+	while (rb)
+	{
+		nrows += rb->nrows;
+		rb = rb->next_bucket;
+	}
+
+	return nrows;
+}
+
+/*
+ * Set positions of formatted rows. When the document is not completed,
+ * then bottom border and footer are not known yet.
+ */
+static void
+set_desc_rows(DataDesc *desc,
+			  PrintbufType *printbuf,
+			  PrintConfigType *pconfig,
+			  bool completed)
+{
+	desc->maxy = printbuf->flushed_rows - 1;
+	desc->total_rows = printbuf->flushed_rows;
+	desc->last_row = desc->total_rows - 1;
+
+	if (!completed)
+	{
+		desc->footer_row = -1;
+		desc->border_bottom_row = -1;
+		desc->last_data_row = desc->last_row;
+	}
+	else
+	{
+		desc->footer_row = desc->last_row;
+
+		if (pconfig->border == 2)
+		{
+			desc->last_data_row = desc->total_rows - 2 - 1;
+			desc->border_bottom_row = desc->last_data_row + 1;
+		}
+		else
+		{
+			desc->border_bottom_row = -1;
+			desc->last_data_row = desc->total_rows - 1 - 1;
+		}
+	}
 }
 
 /*
@@ -1362,12 +2154,17 @@ bool
 read_and_format(Options *opts, DataDesc *desc, StateData *state)
 {
 	LinebufType		linebuf;
-	RowBucketType	rowbuckets, *rb;
+	RowBucketType	rowbuckets;
 	PrintConfigType	pconfig;
 	PrintbufType	printbuf;
 	PrintDataDesc	pdesc;
 	char	   *query = opts->query;
 	char	   *name;
+	int			max_rows = -1;
+	bool		more_data = false;
+	struct PgQueryStream *query_stream = NULL;
+	RowBucketType *parsed_rows = NULL;
+	uint64_t	start_parse = stats_clock();
 
 	state->errstr = NULL;
 	state->_errno = 0;
@@ -1425,20 +2222,33 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 	desc->namesline = NULL;
 	desc->order_map = NULL;
 	desc->total_rows = 0;
-	desc->multilines_already_tested = false;
+	desc->multilines_tested_rows = 0;
 
 	desc->maxbytes = -1;
 	desc->maxx = -1;
 
 	/*
-	 * This format doesn't support progressive load
+	 * Only query result, and csv and tsv documents from blocking stream
+	 * can be loaded progressively, when it is enabled.
 	 */
 	desc->initialized = true;
 	desc->completed = true;
 
+	if (opts->csv_sample_rows > 0 &&
+		opts->progressive_load_mode &&
+		!state->stream_mode &&
+		(query || !(f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE)))
+		max_rows = opts->csv_sample_rows;
+
 	memset(&desc->rows, 0, sizeof(LineBuffer));
 	desc->rows.prev = NULL;
 
+	desc->arena = arena_create();
+	desc->rows.arena = desc->arena;
+	lb_alloc_rows(&desc->rows);
+
+	(void) lb_spill_start(opts, desc);
+
 	memset(&linebuf, 0, sizeof(LinebufType));
 
 	linebuf.buffer = malloc(10 * 1024);
@@ -1463,6 +2273,8 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 						   query,
 						   &rowbuckets,
 						   &pdesc,
+						   max_rows,
+						   &query_stream,
 						   &state->errstr))
 		{
 			log_row("pgclient error: %s\n", state->errstr);
@@ -1472,6 +2284,8 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 
 			return false;
 		}
+
+		more_data = query_stream != NULL;
 	}
 	else if (opts->csv_format)
 	{
@@ -1481,11 +2295,12 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 			return false;
 		}
 
-		read_csv(&rowbuckets,
-				 &linebuf,
-				 opts->csv_separator,
-				 f_data, opts->ignore_short_rows,
-				 opts);
+		more_data = read_csv(&rowbuckets,
+							 &linebuf,
+							 opts->csv_separator,
+							 f_data, opts->ignore_short_rows,
+							 max_rows,
+							 opts);
 
 		prepare_pdesc(&rowbuckets, &linebuf, &pdesc, &pconfig);
 	}
@@ -1497,11 +2312,12 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 			return false;
 		}
 
-		read_tsv(&rowbuckets,
-				 &linebuf,
-				 f_data,
-				 opts->ignore_short_rows,
-				 opts);
+		more_data = read_tsv(&rowbuckets,
+							 &linebuf,
+							 f_data,
+							 opts->ignore_short_rows,
+							 max_rows,
+							 opts);
 
 		prepare_pdesc(&rowbuckets, &linebuf, &pdesc, &pconfig);
 	}
@@ -1511,6 +2327,7 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 	printbuf.size = linebuf.size;
 	printbuf.free = linebuf.size;
 	printbuf.used = 0;
+	printbuf.desc = desc;
 	printbuf.linebuf = &desc->rows;
 
 	/* init other printbuf fields */
@@ -1522,7 +2339,36 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 	linebuf.buffer = NULL;
 	linebuf.size = 0;
 
-	pb_print_rowbuckets(&printbuf, &rowbuckets, &pconfig, &pdesc, NULL);
+	if (more_data)
+	{
+		/* rows after sample can be longer than calculated widths */
+		pconfig.cut_long_fields = true;
+
+		pb_print_head(&printbuf, &pconfig, &pdesc, NULL);
+		pb_print_rows(&printbuf, &rowbuckets, &pconfig, &pdesc);
+	}
+	else if (opts->progressive_load_mode &&
+			 !state->stream_mode &&
+			 rowbuckets_nrows(&rowbuckets) >= CSV_DEFERRED_FORMAT_MIN_ROWS)
+	{
+		/*
+		 * All rows are parsed, and widths are known. Only first chunk is
+		 * formatted now, and others are formatted by read_and_format_next,
+		 * so time to first paint doesn't depend on size of data.
+		 */
+		pconfig.cut_long_fields = false;
+
+		parsed_rows = split_rowbuckets(&rowbuckets, CSV_STREAM_CHUNK_ROWS);
+
+		pb_print_head(&printbuf, &pconfig, &pdesc, NULL);
+		pb_print_rows(&printbuf, &rowbuckets, &pconfig, &pdesc);
+	}
+	else
+	{
+		pconfig.cut_long_fields = false;
+
+		pb_print_rowbuckets(&printbuf, &rowbuckets, &pconfig, &pdesc, NULL);
+	}
 
 	desc->border_type = pconfig.border;
 	desc->linestyle = pconfig.linestyle;
@@ -1548,25 +2394,9 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 				desc->headline_char_size = desc->headline_size;
 
 			desc->first_data_row = desc->border_head_row + 1;
+			desc->border_top_row = pconfig.border == 2 ? 0 : -1;
 
-			desc->maxy = printbuf.flushed_rows - 1;
-			desc->total_rows = printbuf.flushed_rows;
-			desc->last_row = desc->total_rows - 1;
-
-			desc->footer_row = desc->last_row;
-
-			if (pconfig.border == 2)
-			{
-				desc->border_top_row = 0;
-				desc->last_data_row = desc->total_rows - 2 - 1;
-				desc->border_bottom_row = desc->last_data_row + 1;
-			}
-			else
-			{
-				desc->border_top_row = -1;
-				desc->border_bottom_row = -1;
-				desc->last_data_row = desc->total_rows - 1 - 1;
-			}
+			set_desc_rows(desc, &printbuf, &pconfig, !more_data && !parsed_rows);
 		}
 	}
 	else
@@ -1644,56 +2474,167 @@ read_and_format(Options *opts, DataDesc *desc, StateData *state)
 
 		desc->cranges[i].xmax = desc->headline_char_size - 1;
 
-		desc->maxy = printbuf.flushed_rows - 1;
-		desc->total_rows = printbuf.flushed_rows;
-		desc->last_row = desc->total_rows - 1;
-
-		desc->footer_row = desc->last_row;
+		desc->first_data_row = 0;
 
 		if (pconfig.border == 2)
 		{
-			desc->first_data_row = 0;
 			desc->border_top_row = 0;
 			desc->border_head_row = 0;
-			desc->last_data_row = desc->total_rows - 2 - 1;
-			desc->border_bottom_row = desc->last_data_row + 1;
 		}
 		else
 		{
-			desc->first_data_row = 0;
 			desc->border_top_row = -1;
 			desc->border_head_row = -1;
-
-			desc->border_bottom_row = -1;
-			desc->last_data_row = desc->total_rows - 1 - 1;
 		}
+
+		set_desc_rows(desc, &printbuf, &pconfig, !more_data && !parsed_rows);
+	}
+
+	free_rowbuckets(&rowbuckets);
+
+	if (more_data || parsed_rows)
+	{
+		CsvStream  *stream = smalloc(sizeof(CsvStream));
+
+		memcpy(&stream->linebuf, &linebuf, sizeof(LinebufType));
+		memcpy(&stream->pconfig, &pconfig, sizeof(PrintConfigType));
+		memcpy(&stream->pdesc, &pdesc, sizeof(PrintDataDesc));
+		memcpy(&stream->printbuf, &printbuf, sizeof(PrintbufType));
+		stream->query_stream = query_stream;
+		stream->parsed_rows = parsed_rows;
+
+		/* printbuf took buffer of linebuf */
+		stream->linebuf.buffer = smalloc(10 * 1024);
+		stream->linebuf.size = 10 * 1024;
+		stream->linebuf.used = 0;
+
+		desc->csv_stream = stream;
+		desc->completed = false;
+
+		if (parsed_rows)
+			log_row("formatting of %d parsed rows is deferred",
+					rowbuckets_nrows(parsed_rows));
+		else
+			log_row("%s is formatted progressively, widths are from %d rows",
+					query_stream ? "query result" : "csv", max_rows);
+	}
+	else
+	{
+		free(printbuf.buffer);
+		free(linebuf.input.data);
 	}
 
-	free(printbuf.buffer);
+	stats_timer_stop(STATS_PARSE, start_parse);
 
-	/* release row buckets */
-	rb = &rowbuckets;
+	return true;
+}
 
-	while (rb)
+/*
+ * Read and format next rows of csv or tsv document or of query result,
+ * that is formatted progressively.
+ */
+bool
+read_and_format_next(Options *opts, DataDesc *desc, StateData *state)
+{
+	CsvStream  *stream = desc->csv_stream;
+	RowBucketType	rowbuckets;
+	bool		more_data;
+	uint64_t	start_parse = stats_clock();
+
+	state->errstr = NULL;
+	state->_errno = 0;
+
+	if (!stream || (!stream->query_stream && !stream->parsed_rows && !f_data))
+		return false;
+
+	memset(&rowbuckets, 0, sizeof(RowBucketType));
+
+	rowbuckets.allocated = false;
+	rowbuckets.nrows = 0;
+	rowbuckets.next_bucket = NULL;
+
+	if (stream->parsed_rows)
 	{
-		RowBucketType	*nextrb;
-		int		i;
+		/* the rows are parsed already, only next chunk is formatted */
+		rowbuckets.next_bucket = stream->parsed_rows;
+		stream->parsed_rows = split_rowbuckets(stream->parsed_rows, CSV_STREAM_CHUNK_ROWS);
 
-		for (i = 0; i < rb->nrows; i++)
+		more_data = stream->parsed_rows != NULL;
+	}
+	else if (stream->query_stream)
+	{
+		if (!pg_fetch_rows(stream->query_stream,
+						   &rowbuckets,
+						   CSV_STREAM_CHUNK_ROWS,
+						   &more_data,
+						   &state->errstr))
 		{
-			RowType	   *r = rb->rows[i];
+			log_row("pgclient error: %s\n", state->errstr);
 
-			/* only first field holds allocated string */
-			if (r->nfields > 0)
-				free(r->fields[0]);
-			free(r);
+			/* received rows are displayed */
+			more_data = false;
 		}
+	}
+	else if (opts->csv_format)
+		more_data = read_csv(&rowbuckets,
+							 &stream->linebuf,
+							 opts->csv_separator,
+							 f_data, opts->ignore_short_rows,
+							 CSV_STREAM_CHUNK_ROWS,
+							 opts);
+	else
+		more_data = read_tsv(&rowbuckets,
+							 &stream->linebuf,
+							 f_data,
+							 opts->ignore_short_rows,
+							 CSV_STREAM_CHUNK_ROWS,
+							 opts);
 
-		nextrb = rb->next_bucket;
-		if (rb->allocated)
-			free(rb);
-		rb = nextrb;
+	/* DataDesc can be copied, so don't use saved pointers */
+	stream->printbuf.desc = desc;
+	stream->printbuf.linebuf = desc->lb_dir_items > 0 ?
+								desc->lb_dir[desc->lb_dir_items - 1] : &desc->rows;
+
+	pb_print_rows(&stream->printbuf, &rowbuckets, &stream->pconfig, &stream->pdesc);
+
+	if (!more_data)
+		pb_print_tail(&stream->printbuf, &stream->pconfig, &stream->pdesc);
+
+	free_rowbuckets(&rowbuckets);
+
+	desc->maxbytes = stream->printbuf.maxbytes;
+	set_desc_rows(desc, &stream->printbuf, &stream->pconfig, !more_data);
+
+	log_row("formatted rows %d", desc->total_rows);
+
+	if (!more_data)
+	{
+		csv_stream_free(desc);
+		desc->completed = true;
 	}
 
+	stats_timer_stop(STATS_PARSE, start_parse);
+
 	return true;
 }
+
+/*
+ * Releases state of progressive formatting
+ */
+void
+csv_stream_free(DataDesc *desc)
+{
+	CsvStream  *stream = desc->csv_stream;
+
+	if (!stream)
+		return;
+
+	free(stream->linebuf.buffer);
+	free(stream->linebuf.input.data);
+	free(stream->printbuf.buffer);
+	pg_query_stream_free(stream->query_stream);
+	free_rowbuckets(stream->parsed_rows);
+	free(stream);
+
+	desc->csv_stream = NULL;
+}
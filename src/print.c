@@ -26,6 +26,7 @@
 #include <ncurses/ncurses.h>
 #endif
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,10 +51,36 @@
 static inline void
 wrepeatspace(WINDOW *win, int n)
 {
-	int		i;
+	static const char spaces[] = "                                ";
+
+	while (n > 0)
+	{
+		int		chunk = n < (int) sizeof(spaces) - 1 ? n : (int) sizeof(spaces) - 1;
 
-	for (i = 0; i < n; i++)
-		waddch(win, ' ');
+		waddnstr(win, spaces, chunk);
+		n -= chunk;
+	}
+}
+
+/*
+ * Returns true, when ascii decoration char should be replaced by
+ * special terminal decoration.
+ */
+static inline bool
+is_replaced_deco_char(char column_format, char c)
+{
+	switch (column_format)
+	{
+		case 'd':
+			return c == '-';
+		case 'L':
+		case 'R':
+			return c == '+' || c == '|';
+		case 'I':
+			return c == '+';
+		default:
+			return false;
+	}
 }
 
 /*
@@ -80,10 +107,22 @@ flush_bytes(WINDOW *win,
 
 			if (column_format == 'd' && *rowstr == '-')
 			{
-				waddch(win, ACS_HLINE);
-				rowstr += 1;
-				bytes -= 1;
-				offsetx += 1;
+				int		n = 0;
+				int		y, x;
+
+				/* horizontal line is drawn by one call */
+				while (n < bytes &&
+					   desc->headline_transl[offsetx + n] == 'd' &&
+					   rowstr[n] == '-')
+					n += 1;
+
+				getyx(win, y, x);
+				whline(win, ACS_HLINE, n);
+				wmove(win, y, x + n);
+
+				rowstr += n;
+				bytes -= n;
+				offsetx += n;
 			}
 			else if (column_format == 'L' && (*rowstr == '+' || *rowstr == '|'))
 			{
@@ -126,12 +165,21 @@ flush_bytes(WINDOW *win,
 			}
 			else
 			{
-				int len = charlen(rowstr);
+				char   *start = rowstr;
 
-				waddnstr(win, rowstr, len);
-				offsetx += utf_dsplen(rowstr);
-				rowstr +=len;
-				bytes -= len;
+				/* run of not replaced chars is printed at once */
+				do
+				{
+					int len = charlen(rowstr);
+
+					offsetx += utf_dsplen(rowstr);
+					rowstr += len;
+					bytes -= len;
+				}
+				while (bytes > 0 &&
+					   !is_replaced_deco_char(desc->headline_transl[offsetx], *rowstr));
+
+				waddnstr(win, start, rowstr - start);
 			}
 		}
 	}
@@ -214,6 +262,7 @@ print_column_names(WINDOW *win,
 
 	attr_t		active_attr = 0;
 	attr_t		new_attr;
+	int		pending_spaces = 0;
 	int		i;
 
 	getyx(win, cy, cx);
@@ -278,6 +327,12 @@ print_column_names(WINDOW *win,
 
 		if (active_attr != new_attr)
 		{
+			if (pending_spaces > 0)
+			{
+				wrepeatspace(win, pending_spaces);
+				pending_spaces = 0;
+			}
+
 			/* disable current style */
 			wattroff(win, active_attr);
 
@@ -288,20 +343,29 @@ print_column_names(WINDOW *win,
 
 		if (column_format != 'd')
 		{
+			if (pending_spaces > 0)
+			{
+				wrepeatspace(win, pending_spaces);
+				pending_spaces = 0;
+			}
+
 			if (desc->linestyle == 'a' && opts->force_uniborder)
 				waddch(win, ACS_VLINE);
 			else
 				waddnstr(win, ptr, bytes);
 		}
 		else
-			/* clean background of colum names */
-			wrepeatspace(win, chars);
+			/* clean background of colum names, the spaces are printed together */
+			pending_spaces += chars;
 
 		headline_ptr += chars;
 		ptr += bytes;
 		pos += chars;
 	}
 
+	if (pending_spaces > 0)
+		wrepeatspace(win, pending_spaces);
+
 	wclrtoeol(win);
 
 	wattroff(win, active_attr);
@@ -409,6 +473,73 @@ print_column_names(WINDOW *win,
 	}
 }
 
+/*
+ * Returns number of occurrences of searched pattern in the row, but
+ * maximally max_matches. The position of first occurrence in display
+ * chars is stored to start_char. lineno is position of row in pager.
+ */
+int
+search_line(Options *opts,
+			ScrDesc *scrdesc,
+			DataDesc *desc,
+			int lineno,
+			const char *rowstr,
+			int max_matches,
+			short int *start_char)
+{
+	const char *str = rowstr;
+	int			matches = 0;
+
+	/* apply row selection filtr */
+	if (scrdesc->search_rows > 0)
+	{
+		int		rowno = lineno - desc->first_data_row;
+
+		if (rowno < scrdesc->search_first_row ||
+			rowno > scrdesc->search_first_row + scrdesc->search_rows - 1)
+			return 0;
+	}
+
+	while (str != NULL && matches < max_matches)
+	{
+		str = pspg_search(opts, scrdesc, str);
+
+		if (str != NULL)
+		{
+			/* apply column selection filtr */
+			if (scrdesc->search_columns > 0)
+			{
+				int		bytes = str - rowstr;
+				int		pos;
+
+				pos = use_utf8 ? utf_string_dsplen(rowstr, bytes) : bytes;
+
+				if (pos < scrdesc->search_first_column)
+				{
+					str += charlen(str);
+					continue;
+				}
+
+				if (pos > scrdesc->search_first_column + scrdesc->search_columns - 1)
+					break;
+			}
+
+			if (matches == 0)
+			{
+				if (use_utf8)
+					*start_char = utf_string_dsplen(rowstr, str - rowstr);
+				else
+					*start_char = str - rowstr;
+			}
+
+			matches += 1;
+			str += scrdesc->searchterm_size;
+		}
+	}
+
+	return matches;
+}
+
 LineInfo *
 set_line_info(Options *opts,
 			  ScrDesc *scrdesc,
@@ -426,7 +557,7 @@ set_line_info(Options *opts,
 		LineBuffer *lb = lbm->lb;
 		int		i;
 
-		lb->lineinfo = smalloc(LINEBUFFER_LINES * sizeof(LineInfo));
+		lb->lineinfo = lb_alloc_lineinfo(lb);
 
 		for (i = 0; i < LINEBUFFER_LINES; i++)
 			lb->lineinfo[i].mask = LINEINFO_UNKNOWN;
@@ -436,89 +567,187 @@ set_line_info(Options *opts,
 
 	if (linfo->mask & LINEINFO_UNKNOWN)
 	{
-		const char *str = rowstr;
+		short int	start_char = 0;
+		int			matches;
 
 		linfo->mask ^= LINEINFO_UNKNOWN;
 		linfo->mask &= ~(LINEINFO_FOUNDSTR | LINEINFO_FOUNDSTR_MULTI);
 
-		/* apply row selection filtr */
-		if (scrdesc->search_rows > 0)
+		/* When we detect multi occurrence, then stop searching */
+		matches = search_line(opts, scrdesc, desc, lbm->lineno, rowstr, 2, &start_char);
+
+		if (matches > 0)
 		{
-			int		rowno = lbm->lineno - desc->first_data_row;
+			linfo->mask |= LINEINFO_FOUNDSTR;
+			linfo->start_char = start_char;
+		}
+
+		if (matches > 1)
+			linfo->mask |= LINEINFO_FOUNDSTR_MULTI;
+	}
+
+	return linfo;
+}
+
+#define SEARCH_ROWS_PER_WORKER		20000
 
-			if (rowno < scrdesc->search_first_row ||
-				rowno > scrdesc->search_first_row + scrdesc->search_rows - 1)
-				return linfo;
+typedef struct
+{
+	Options	   *opts;
+	ScrDesc	   *scrdesc;
+	DataDesc   *desc;
+	int			from;				/* first position of searched range */
+	int			to;					/* position after searched range */
+} SearchAllTask;
+
+/*
+ * Searches pattern in rows of task's range. Every worker updates
+ * line infos and counters of own rows only.
+ */
+static void *
+search_rows_task(void *arg)
+{
+	SearchAllTask *task = (SearchAllTask *) arg;
+	DataDesc   *desc = task->desc;
+	LineBufferIter lbi;
+	LineBuffer *pinned_lb = NULL;
+
+	init_lbi_ddesc(&lbi, desc, task->from);
+
+	while (lbi.current_lb && lbi.lineno < task->to)
+	{
+		LineBuffer *lb = lbi.current_lb;
+		LineInfo   *linfo = &lb->lineinfo[lbi.current_lb_rowno];
+		short int	start_char = 0;
+		int			matches;
+
+		/* evicted rows can be paged in by more workers in parallel */
+		if (lb != pinned_lb)
+		{
+			if (pinned_lb)
+				lb_unpin(pinned_lb);
+
+			lb_pin(lb);
+			pinned_lb = lb;
 		}
 
-		while (str != NULL)
+		matches = search_line(task->opts, task->scrdesc, desc,
+							  lbi.lineno, lb->rows[lbi.current_lb_rowno],
+							  USHRT_MAX, &start_char);
+
+		linfo->mask &= ~(LINEINFO_UNKNOWN | LINEINFO_FOUNDSTR | LINEINFO_FOUNDSTR_MULTI);
+
+		if (matches > 0)
 		{
-			/*
-			 * When we would to ignore case or lower case (in this case, we know, so
-			 * pattern has not any upper char, then we have to use slower case insensitive
-			 * searching.
-			 */
-			if (opts->ignore_case || (opts->ignore_lower_case && !scrdesc->has_upperchr))
-			{
+			linfo->mask |= LINEINFO_FOUNDSTR;
+			linfo->start_char = start_char;
+		}
 
-				if (use_utf8)
-					str = utf8_nstrstr(str, scrdesc->searchterm);
-				else
-					str = nstrstr(str, scrdesc->searchterm);
-			}
-			else if (opts->ignore_lower_case && scrdesc->has_upperchr)
-			{
-				if (use_utf8)
-					str = utf8_nstrstr_ignore_lower_case(str, scrdesc->searchterm);
-				else
-					str = nstrstr_ignore_lower_case(str, scrdesc->searchterm);
-			}
-			else
-				/* we can use case sensitive searching (binary comparation) */
-				str = strstr(str, scrdesc->searchterm);
+		if (matches > 1)
+			linfo->mask |= LINEINFO_FOUNDSTR_MULTI;
 
-			if (str != NULL)
-			{
-				/* apply column selection filtr */
-				if (scrdesc->search_columns > 0)
-				{
-					int		bytes = str - rowstr;
-					int		pos;
+		desc->found_counts[lb->first_row + lbi.current_lb_rowno] = matches;
 
-					pos = use_utf8 ? utf_string_dsplen(rowstr, bytes) : bytes;
+		(void) lbi_next(&lbi);
+	}
 
-					if (pos < scrdesc->search_first_column)
-					{
-						str += charlen(str);
-						continue;
-					}
+	if (pinned_lb)
+		lb_unpin(pinned_lb);
 
-					if (pos > scrdesc->search_first_column + scrdesc->search_columns - 1)
-						return linfo;
-				}
+	return NULL;
+}
 
-				if (linfo->mask & LINEINFO_FOUNDSTR)
-				{
-					/* When we detect multi occurrence, then stop searching */
-					linfo->mask |= LINEINFO_FOUNDSTR_MULTI;
-					break;
-				}
-				else
-				{
-					linfo->mask |= LINEINFO_FOUNDSTR;
+/*
+ * Searches current pattern in all rows by parallel workers. The line
+ * infos of all rows are updated, and the bitmap of rows with found
+ * pattern and counters of occurrences are stored in desc.
+ */
+void
+search_all_rows(Options *opts, ScrDesc *scrdesc, DataDesc *desc)
+{
+	SearchAllTask *tasks;
+	LineBuffer *lb;
+	int			nworkers;
+	int			i;
+	uint64_t	start_search;
 
-					if (use_utf8)
-						linfo->start_char = utf_string_dsplen(rowstr, str - rowstr);
-					else
-						linfo->start_char = str - rowstr;
-				}
+	found_rows_free(desc);
 
-				str += scrdesc->searchterm_size;
-			}
+	if (*scrdesc->searchterm == '\0' || desc->total_rows == 0)
+		return;
+
+	start_search = stats_clock();
+
+	/* workers cannot to allocate memory from arena */
+	for (lb = &desc->rows; lb; lb = lb->next)
+	{
+		if (!lb->lineinfo)
+		{
+			lb->lineinfo = lb_alloc_lineinfo(lb);
+
+			for (i = 0; i < LINEBUFFER_LINES; i++)
+				lb->lineinfo[i].mask = LINEINFO_UNKNOWN;
 		}
 	}
 
-	return linfo;
+	/*
+	 * Search implementation is selected by first call, and this
+	 * should be done before start of workers.
+	 */
+	(void) pspg_search(opts, scrdesc, scrdesc->searchterm);
+
+	desc->found_counts = smalloc(desc->total_rows * sizeof(unsigned short));
+	desc->found_rows = smalloc((desc->total_rows + 7) / 8);
+	desc->found_rows_items = desc->total_rows;
+
+	nworkers = parallel_workers(desc->total_rows, SEARCH_ROWS_PER_WORKER);
+	tasks = smalloc(nworkers * sizeof(SearchAllTask));
+
+	for (i = 0; i < nworkers; i++)
+	{
+		tasks[i].opts = opts;
+		tasks[i].scrdesc = scrdesc;
+		tasks[i].desc = desc;
+		tasks[i].from = (int) ((long) desc->total_rows * i / nworkers);
+		tasks[i].to = (int) ((long) desc->total_rows * (i + 1) / nworkers);
+	}
+
+	if (nworkers > 1)
+		log_row("rows are searched by %d workers", nworkers);
+
+	run_parallel_tasks(search_rows_task, tasks, sizeof(SearchAllTask), nworkers);
+
+	free(tasks);
+
+	for (i = 0; i < desc->total_rows; i++)
+	{
+		if (desc->found_counts[i] > 0)
+		{
+			desc->found_rows[i >> 3] |= 1 << (i & 7);
+			desc->found_lines += 1;
+			desc->found_matches += desc->found_counts[i];
+		}
+	}
+
+	stats_timer_stop(STATS_SEARCH, start_search);
+
+	log_row("pattern found %ld times in %d rows", desc->found_matches, desc->found_lines);
+}
+
+/*
+ * Releases results of search_all_rows
+ */
+void
+found_rows_free(DataDesc *desc)
+{
+	free(desc->found_rows);
+	free(desc->found_counts);
+
+	desc->found_rows = NULL;
+	desc->found_counts = NULL;
+	desc->found_rows_items = 0;
+	desc->found_lines = 0;
+	desc->found_matches = 0;
 }
 
 #if NCURSES_WIDECHAR > 0 && defined HAVE_NCURSESW
@@ -839,6 +1068,161 @@ fin:
 	return nwords;
 }
 
+/*
+ * Damage tracking of windows. The description of every drawn row is
+ * saved together with the state of window, and the row is not drawn
+ * again when it should be drawn with same description. When only
+ * first displayed row is changed, then content of window is scrolled,
+ * and only new rows are drawn.
+ */
+typedef struct
+{
+	int			srcx;
+	int			maxy;
+	int			maxx;
+	int			vcursor_xmin;
+	int			vcursor_xmax;
+	int			selected_xmin;
+	int			selected_xmax;
+	int			selected_first_row;
+	int			selected_rows;
+	int			search_first_row;
+	int			search_rows;
+	int			search_first_column;
+	int			search_columns;
+	bool		found;
+	int			found_start_x;
+	char		searchterm[256];
+	bool		has_upperchr;
+	bool		ignore_case;
+	bool		ignore_lower_case;
+	bool		no_highlight_search;
+	bool		force_uniborder;
+	bool		highlight_odd_rec;
+	char	   *headline_transl;
+	int			headline_char_size;
+	int			border_type;
+	char		linestyle;
+	bool		is_expanded_mode;
+	int			border_top_row;
+	int			border_head_row;
+	int			border_bottom_row;
+	int			first_data_row;
+	char	   *namesline;
+	Theme		theme;
+	Theme		odd_theme;
+} WindowState;
+
+typedef struct
+{
+	bool		valid;
+	char	   *rowstr;				/* source row or NULL */
+	int			lineno;
+	char		mask;				/* mask of line info */
+	short int	start_char;
+	bool		is_cursor_row;
+	bool		is_found_row;
+	bool		is_selected_row;
+	bool		is_odd_row;
+} RowDamage;
+
+typedef struct
+{
+	WINDOW	   *win;
+	DataDesc   *desc;
+	int			srcy;
+	WindowState	state;
+	RowDamage  *rows;
+	int			nrows;
+} WindowDamage;
+
+static WindowDamage window_damage[PSPG_WINDOW_COUNT];
+
+/*
+ * Forces redraw of all rows of all windows. Should be called when
+ * content of windows can be changed outside window_fill.
+ */
+void
+reset_window_damage(void)
+{
+	int		i;
+
+	for (i = 0; i < PSPG_WINDOW_COUNT; i++)
+		window_damage[i].win = NULL;
+}
+
+/*
+ * Compares state of window with state used for previous drawing, and
+ * prepares descriptions of drawn rows. When only srcy is different,
+ * then window content is scrolled.
+ */
+static WindowDamage *
+prepare_window_damage(int window_identifier,
+					  WINDOW *win,
+					  DataDesc *desc,
+					  WindowState *state,
+					  int srcy)
+{
+	WindowDamage *damage = &window_damage[window_identifier];
+	int			nrows = state->maxy;
+	int			i;
+
+	if (damage->nrows < nrows)
+	{
+		damage->rows = srealloc(damage->rows, nrows * sizeof(RowDamage));
+		damage->nrows = nrows;
+		damage->win = NULL;
+	}
+
+	if (damage->win != win ||
+		damage->desc != desc ||
+		memcmp(&damage->state, state, sizeof(WindowState)) != 0)
+	{
+		for (i = 0; i < nrows; i++)
+			damage->rows[i].valid = false;
+	}
+	else if (damage->srcy != srcy)
+	{
+		int		delta = srcy - damage->srcy;
+
+		if (abs(delta) < nrows)
+		{
+			scrollok(win, TRUE);
+			wscrl(win, delta);
+			scrollok(win, FALSE);
+
+			if (delta > 0)
+			{
+				memmove(damage->rows, damage->rows + delta,
+						(nrows - delta) * sizeof(RowDamage));
+
+				for (i = nrows - delta; i < nrows; i++)
+					damage->rows[i].valid = false;
+			}
+			else
+			{
+				memmove(damage->rows - delta, damage->rows,
+						(nrows + delta) * sizeof(RowDamage));
+
+				for (i = 0; i < -delta; i++)
+					damage->rows[i].valid = false;
+			}
+		}
+		else
+		{
+			for (i = 0; i < nrows; i++)
+				damage->rows[i].valid = false;
+		}
+	}
+
+	damage->win = win;
+	damage->desc = desc;
+	damage->srcy = srcy;
+	memcpy(&damage->state, state, sizeof(WindowState));
+
+	return damage;
+}
+
 void
 window_fill(int window_identifier,
 			int srcy,
@@ -864,6 +1248,8 @@ window_fill(int window_identifier,
 	Theme		*t;
 	SpecialWord specwords[30];
 	int			nspecwords;
+	WindowState	state;
+	WindowDamage *damage;
 
 	bool		is_footer = window_identifier == WINDOW_FOOTER;
 	bool		is_fix_rows = window_identifier == WINDOW_LUC || window_identifier == WINDOW_FIX_ROWS;
@@ -929,6 +1315,47 @@ window_fill(int window_identifier,
 
 	getmaxyx(win, maxy, maxx);
 
+	/* all values that can change content of window */
+	memset(&state, 0, sizeof(WindowState));
+
+	state.srcx = srcx;
+	state.maxy = maxy;
+	state.maxx = maxx;
+	state.vcursor_xmin = vcursor_xmin;
+	state.vcursor_xmax = vcursor_xmax;
+	state.selected_xmin = selected_xmin;
+	state.selected_xmax = selected_xmax;
+	state.selected_first_row = scrdesc->selected_first_row;
+	state.selected_rows = scrdesc->selected_rows;
+	state.search_first_row = scrdesc->search_first_row;
+	state.search_rows = scrdesc->search_rows;
+	state.search_first_column = scrdesc->search_first_column;
+	state.search_columns = scrdesc->search_columns;
+	state.found = scrdesc->found;
+	state.found_start_x = scrdesc->found_start_x;
+	memcpy(state.searchterm, scrdesc->searchterm, sizeof(state.searchterm));
+	state.has_upperchr = scrdesc->has_upperchr;
+	state.ignore_case = opts->ignore_case;
+	state.ignore_lower_case = opts->ignore_lower_case;
+	state.no_highlight_search = opts->no_highlight_search;
+	state.force_uniborder = opts->force_uniborder;
+	state.highlight_odd_rec = opts->highlight_odd_rec;
+	state.headline_transl = desc->headline_transl;
+	state.headline_char_size = desc->headline_char_size;
+	state.border_type = desc->border_type;
+	state.linestyle = desc->linestyle;
+	state.is_expanded_mode = desc->is_expanded_mode;
+	state.border_top_row = desc->border_top_row;
+	state.border_head_row = desc->border_head_row;
+	state.border_bottom_row = desc->border_bottom_row;
+	state.first_data_row = desc->first_data_row;
+	state.namesline = desc->namesline;
+	memcpy(&state.theme, t, sizeof(Theme));
+	if (odd_theme_identifier != -1)
+		memcpy(&state.odd_theme, &scrdesc->themes[odd_theme_identifier], sizeof(Theme));
+
+	damage = prepare_window_damage(window_identifier, win, desc, &state, srcy);
+
 	while (row < maxy )
 	{
 		int			bytes;
@@ -947,6 +1374,7 @@ window_fill(int window_identifier,
 		int			rowno = row + srcy_bak + 1 - desc->first_data_row;
 		int			lineno;
 		int			recno;
+		RowDamage	rowdamage;
 
 		is_cursor_row = (!opts->no_cursor && row == cursor_row);
 
@@ -954,16 +1382,24 @@ window_fill(int window_identifier,
 
 		line_is_valid = lbm_get_line(&lbm, &rowstr, &lineinfo, &lineno);
 
+		memset(&rowdamage, 0, sizeof(RowDamage));
+
 		if (odd_theme_identifier != -1)
 		{
-			recno = lineno - lineinfo->recno_offset;
+			recno = !desc->has_multilines ? lineno - desc->first_data_row + 1 :
+					line_is_valid ? lb_get_recno(desc, lbm.lb, lbm.lb_rowno) : 0;
 
 			if (recno % 2 == 1)
+			{
 				t = &scrdesc->themes[odd_theme_identifier];
+				rowdamage.is_odd_row = true;
+			}
 			else
 				t = &scrdesc->themes[window_identifier];
 		}
 
+		rowdamage.rowstr = rowstr;
+
 		/* when rownum is printed, don't process original text */
 		if (is_rownum && line_is_valid)
 		{
@@ -978,6 +1414,45 @@ window_fill(int window_identifier,
 
 		is_pattern_row = (lineinfo != NULL && (lineinfo->mask & LINEINFO_FOUNDSTR) != 0) ? true : false;
 
+		rowdamage.valid = true;
+
+		/* all rows after data are displayed as empty rows */
+		if (rowdamage.rowstr)
+		{
+			rowdamage.lineno = lineno;
+			rowdamage.mask = lineinfo ? lineinfo->mask : 0;
+			rowdamage.start_char = lineinfo ? lineinfo->start_char : 0;
+			rowdamage.is_cursor_row = is_cursor_row;
+			rowdamage.is_found_row = scrdesc->found && scrdesc->found_row == row + srcy_bak;
+			rowdamage.is_selected_row = rowno >= scrdesc->selected_first_row + 1 &&
+										rowno < scrdesc->selected_first_row + 1 + scrdesc->selected_rows;
+		}
+		else
+			rowdamage.is_odd_row = false;
+
+		/* the row is displayed already */
+		if (memcmp(&damage->rows[row], &rowdamage, sizeof(RowDamage)) == 0)
+		{
+			/* expanded records titles should be detected every time */
+			if (desc->is_expanded_mode && rowstr != NULL && !is_rownum)
+			{
+				int		ei_min, ei_max;
+
+				if (is_expanded_header(rowstr, &ei_min, &ei_max))
+				{
+					if (scrdesc->first_rec_title_y == -1)
+						scrdesc->first_rec_title_y = row;
+					else
+						scrdesc->last_rec_title_y = row;
+				}
+			}
+
+			row += 1;
+			continue;
+		}
+
+		memcpy(&damage->rows[row], &rowdamage, sizeof(RowDamage));
+
 		/* prepare position cache, when first occurrence is visible */
 		if (lineinfo != NULL && (lineinfo->mask & LINEINFO_FOUNDSTR_MULTI) != 0 &&
 			  srcx + maxx > lineinfo->start_char &&
@@ -1147,6 +1622,8 @@ window_fill(int window_identifier,
 								   vcursor_xmin, vcursor_xmax,
 								   loc_selected_xmin, loc_selected_xmax,
 								   desc, opts, t);
+
+				wattroff(win, active_attr);
 				continue;
 			}
 
@@ -1154,6 +1631,16 @@ window_fill(int window_identifier,
 			i = srcx;
 			left_spaces = 0;
 
+			/* long skip can start on nearest checkpoint */
+			if (!is_rownum && line_is_valid && i >= DSPPOS_CHECKPOINT_STEP)
+			{
+				int		seek_pos;
+
+				LB_PAGE_IN(lbm.lb);
+				rowstr = lb_seek_dsppos(lbm.lb, lbm.lb_rowno, i, true, &seek_pos);
+				i -= seek_pos;
+			}
+
 			while(i > 0)
 			{
 				if (*rowstr != '\0' && *rowstr != '\n')
@@ -1281,12 +1768,9 @@ window_fill(int window_identifier,
 								saved_pos = pos;
 							}
 
-							/* disable current style */
-							wattroff(win, active_attr);
-
-							/* active new style */
+							/* switch style */
 							active_attr = new_attr;
-							wattron(win, active_attr);
+							wattrset(win, active_attr);
 						}
 					}
 					else if (!fix_line_attr_style)
@@ -1384,12 +1868,9 @@ window_fill(int window_identifier,
 								saved_pos = pos;
 							}
 
-							/* disable current style */
-							wattroff(win, active_attr);
-
-							/* active new style */
+							/* switch style */
 							active_attr = new_attr;
-							wattron(win, active_attr);
+							wattrset(win, active_attr);
 						}
 
 						if (print_acs_vline)
@@ -1443,12 +1924,9 @@ window_fill(int window_identifier,
 									saved_pos = pos;
 								}
 
-								/* disable current style */
-								wattroff(win, active_attr);
-
-								/* active new style */
+								/* switch style */
 								active_attr = new_attr;
-								wattron(win, active_attr);
+								wattrset(win, active_attr);
 							}
 						}
 					}
@@ -1539,7 +2017,14 @@ window_fill(int window_identifier,
 		}
 		else
 		{
+			int		i;
+
 			wclrtobot(win);
+
+			/* rows below are empty now */
+			for (i = row; i < maxy; i++)
+				memcpy(&damage->rows[i], &rowdamage, sizeof(RowDamage));
+
 			break;
 		}
 
@@ -97,6 +97,8 @@ static void print_memory_stats(bool enable_memory_debug);
 
 static long	last_watch_ms = 0;
 static time_t	last_watch_sec = 0;					/* time when we did last refresh */
+static long	query_start_ms = 0;
+static time_t	query_start_sec = 0;				/* time when running query was sent */
 static bool	paused = false;							/* true, when watch mode is paused */
 
 static bool active_ncurses = false;
@@ -575,6 +577,9 @@ create_layout(Options *opts,
 {
 	int		i;
 
+	/* new windows should be drawn completely */
+	reset_window_damage();
+
 	for (i = 0; i < PSPG_WINDOW_COUNT; i++)
 	{
 		if (i != WINDOW_TOP_BAR &&
@@ -671,6 +676,9 @@ create_layout(Options *opts,
 								   scrdesc->main_maxx - scrdesc->fix_cols_cols,
 								   scrdesc->fix_rows_rows + scrdesc->main_start_y,
 								   scrdesc->fix_cols_cols + scrdesc->main_start_x);
+
+		/* allow to use scroll region of terminal, when rows are scrolled */
+		idlok(w_rows(scrdesc), TRUE);
 	}
 
 	if (scrdesc->fix_rows_rows > 0 && opts->show_rownum)
@@ -915,6 +923,7 @@ redraw_screen(void)
 	long		current_ms;
 	static time_t last_doupdate_sec = -1;
 	static long last_doupdate_ms = -1;
+	uint64_t	start_redraw;
 
 #ifdef DEBUG_PIPE
 
@@ -1057,6 +1066,8 @@ redraw_screen(void)
 
 #endif
 
+	start_redraw = stats_clock();
+
 	window_fill(WINDOW_LUC,
 				desc->title_rows + desc->fixed_rows - scrdesc->fix_rows_rows,
 				0,
@@ -1182,12 +1193,21 @@ redraw_screen(void)
 								   last_doupdate_sec, last_doupdate_ms);
 
 			if (td < 15)
+			{
+				uint64_t	start_sleep = stats_clock();
+
 				usleep((15 - td) * 1000);
+
+				/* throttling is not part of frame time */
+				start_redraw += stats_clock() - start_sleep;
+			}
 		}
 	}
 
 	doupdate();
 
+	stats_timer_stop(STATS_REDRAW, start_redraw);
+
 	current_time(&current_sec, &current_ms);
 
 	last_doupdate_sec = current_sec;
@@ -1263,6 +1283,7 @@ print_status(Options *opts,
 	int		maxy, maxx;
 	int		smaxy, smaxx;
 	char	buffer[200];
+	char	found_info[50];
 	WINDOW *top_bar = w_top_bar(scrdesc);
 	WINDOW *bottom_bar = w_bottom_bar(scrdesc);
 	Theme  *top_bar_theme = &scrdesc->themes[WINDOW_TOP_BAR];
@@ -1311,7 +1332,13 @@ print_status(Options *opts,
 					(desc->title[0] != '\0' || desc->filename[0] != '\0'))
 					x = maxx / 4;
 
-				if (paused)
+				if (pg_query_socket() != -1)
+				{
+					td = (sec - query_start_sec) * 1000 + ms - query_start_ms;
+
+					mvwprintw(top_bar, 0, x, "running %ld sec", td / 1000);
+				}
+				else if (paused)
 					mvwprintw(top_bar, 0, x, "paused %ld sec", td / 1000);
 				else
 					mvwprintw(top_bar, 0, x, "%*ld/%d", w, td/1000 + 1, opts->watch_time);
@@ -1445,7 +1472,15 @@ print_status(Options *opts,
 			}
 		}
 
-		mvwprintw(top_bar, 0, maxx - strlen(buffer) - 2, "  %s", buffer);
+		/* number of occurrences and rows found by search all */
+		if (FOUND_ROWS_IS_VALID(desc))
+			snprintf(found_info, sizeof(found_info), "M:%ld/%d  ",
+					 desc->found_matches, desc->found_lines);
+		else
+			found_info[0] = '\0';
+
+		mvwprintw(top_bar, 0, maxx - strlen(buffer) - strlen(found_info) - 2,
+				  "  %s%s", found_info, buffer);
 		wnoutrefresh(top_bar);
 	}
 
@@ -1517,6 +1552,35 @@ make_beep(void)
 		beep();
 }
 
+static void
+print_info(const char *fmt,
+		   const char *par,
+		   bool press_any_key,
+		   bool is_error)
+{
+	attr_t  att;
+
+	att = !is_error ? prompt_window_info_attr : prompt_window_error_attr;
+
+	wattron(prompt_window, att);
+
+	if (par != NULL)
+		mvwprintw(prompt_window, 0, 0, fmt, par);
+	else
+		mvwprintw(prompt_window, 0, 0, "%s", fmt);
+
+	if (press_any_key)
+		wprintw(prompt_window, " (press any key)");
+
+	wclrtoeol(prompt_window);
+	mvwchgat(prompt_window, 0, 0, -1, att, PAIR_NUMBER(att), 0);
+
+	wattroff(prompt_window,  att);
+	wnoutrefresh(prompt_window);
+
+	doupdate();
+}
+
 /*
  * It is used for result of action info
  */
@@ -1528,7 +1592,6 @@ show_info_wait(const char *fmt,
 			   bool applytimeout,
 			   bool is_error)
 {
-	attr_t  att;
 	int		event;
 	int		timeout = -1;
 	NCursesEventData nced;
@@ -1555,31 +1618,13 @@ show_info_wait(const char *fmt,
 		return;
 	}
 
-	att = !is_error ? prompt_window_info_attr : prompt_window_error_attr;
-
-	wattron(prompt_window, att);
-
-	if (par != NULL)
-		mvwprintw(prompt_window, 0, 0, fmt, par);
-	else
-		mvwprintw(prompt_window, 0, 0, "%s", fmt);
-
-	if (!applytimeout)
-		wprintw(prompt_window, " (press any key)");
+	print_info(fmt, par, !applytimeout, is_error);
 
 	if (par)
 		log_row(fmt, par);
 	else
 		log_row(fmt);
 
-	wclrtoeol(prompt_window);
-	mvwchgat(prompt_window, 0, 0, -1, att, PAIR_NUMBER(att), 0);
-
-	wattroff(prompt_window,  att);
-	wnoutrefresh(prompt_window);
-
-	doupdate();
-
 	if (beep)
 		make_beep();
 
@@ -1599,6 +1644,39 @@ show_info_wait(const char *fmt,
 		unget_pspg_event(&nced);
 }
 
+/*
+ * Shows info about progress of long operation, and waits timeout ms
+ * on key. Returns true, when user wants to cancel the operation (by
+ * Escape or Ctrl C). Other keys are ignored. Only tty events are read,
+ * so events of data are not lost, and get_pspg_event holds sigint in
+ * handle_sigint, so it should be checked here.
+ */
+bool
+show_info_progress(const char *fmt, int timeout)
+{
+	int		event;
+	NCursesEventData nced;
+	bool	sigint;
+
+	print_info(fmt, NULL, false, false);
+
+	if (handle_sigint)
+		event = PSPG_SIGINT_EVENT;
+	else
+		event = get_pspg_event(&nced, true, timeout);
+
+	sigint = handle_sigint || event == PSPG_SIGINT_EVENT;
+	handle_sigint = false;
+
+	/*
+	 * Screen should be refreshed after show any info.
+	 */
+	current_state->refresh_scr = true;
+
+	return sigint ||
+		   (event == PSPG_NCURSES_EVENT && nced.keycode == PSPG_ESC_CODE);
+}
+
 #define SEARCH_FORWARD			1
 #define SEARCH_BACKWARD			2
 
@@ -1629,12 +1707,105 @@ has_upperchr(char *str)
 	return false;
 }
 
+/*
+ * Skips rows without searched pattern. When all rows was searched
+ * already, the bitmap of found rows is used, else the rows from
+ * line buffers without searched trigrams are skipped.
+ */
+static void
+skip_not_found_rows(LineBufferIter *lbi, SearchFilter *sf, DataDesc *desc, bool forward)
+{
+	if (FOUND_ROWS_IS_VALID(desc))
+		lbi_skip_not_found(lbi, desc, forward);
+	else
+		lbi_skip_filtered(lbi, sf, forward);
+}
+
+/*
+ * Searches next row with pattern from row lineno (first skip_bytes of
+ * this row are ignored). Returns number of found row and sets position
+ * of pattern in scrdesc, or returns -1. The row_offset is difference
+ * between row number and cursor row, that is used by selected rows
+ * (search_first_row). It is used by cmd_SearchNext and by benchmark.
+ */
+int
+search_next_row(Options *opts, ScrDesc *scrdesc, DataDesc *desc,
+				int lineno, int skip_bytes, int row_offset)
+{
+	LineBufferIter lbi;
+	SearchFilter sf;
+	char   *line;
+
+	init_lbi_ddesc(&lbi, desc, lineno);
+	init_search_filter(&sf, scrdesc->searchterm);
+
+	/* rows without searched pattern are skipped */
+	for (skip_not_found_rows(&lbi, &sf, desc, true);
+		 lbi_get_line_next(&lbi, &line, NULL, &lineno);
+		 skip_not_found_rows(&lbi, &sf, desc, true))
+	{
+		const char   *pttrn;
+
+		if (scrdesc->search_rows > 0)
+		{
+			if (lineno - row_offset < scrdesc->search_first_row ||
+				lineno - row_offset >= scrdesc->search_first_row + scrdesc->search_rows)
+			{
+				continue;
+			}
+		}
+
+		pttrn = pspg_search(opts, scrdesc, line + skip_bytes);
+		while (pttrn)
+		{
+			/* apply column selection filtr */
+			if (scrdesc->search_columns > 0)
+			{
+				int		bytes = pttrn - line;
+				int		pos = use_utf8 ? utf_string_dsplen(line, bytes) : bytes;
+
+				if (pos < scrdesc->search_first_column)
+				{
+					pttrn += charlen(pttrn);
+					pttrn = pspg_search(opts, scrdesc, pttrn);
+
+					continue;
+				}
+
+				if (pos > scrdesc->search_first_column + scrdesc->search_columns - 1)
+					pttrn = NULL;
+			}
+
+			break;
+		}
+
+		if (pttrn)
+		{
+			int		found_start_bytes = pttrn - line;
+
+			scrdesc->found_start_x =
+				use_utf8 ? utf_string_dsplen(line, found_start_bytes) : (int) (found_start_bytes);
+
+			scrdesc->found_start_bytes = found_start_bytes;
+			scrdesc->found_row = lineno;
+
+			return lineno;
+		}
+
+		skip_bytes = 0;
+	}
+
+	return -1;
+}
+
 static void
 reset_searching_lineinfo(DataDesc *desc)
 {
 	SimpleLineBufferIter slbi, *_slbi;
 	LineInfo   *linfo;
 
+	found_rows_free(desc);
+
 	_slbi = init_slbi_ddesc(&slbi, desc);
 
 	while (_slbi)
@@ -1718,6 +1889,8 @@ exit_handler(void)
 
 	close_tty_stream();
 	close_data_stream();
+
+	pg_close_connection();
 }
 
 static void
@@ -1782,6 +1955,41 @@ adjust_first_row(int _first_row, DataDesc *desc, ScrDesc *scrdesc)
 	return _first_row > max_first_row ? max_first_row : _first_row;
 }
 
+/*
+ * In follow mode, the cursor goes with appended rows, when it was on
+ * last row before. Else it holds its row, that can be moved by released
+ * rows.
+ */
+static void
+follow_stream_tail(DataDesc *desc, ScrDesc *scrdesc, long recycled_rows, bool at_bottom)
+{
+	int		released = (int) (desc->recycled_rows - recycled_rows);
+	int		max_cursor_row = desc->last_row - desc->first_data_row;
+
+	if (at_bottom)
+	{
+		cursor_row = max_cursor_row;
+		first_row = cursor_row;
+	}
+	else
+	{
+		cursor_row -= released;
+		first_row -= released;
+	}
+
+	cursor_row = cursor_row > max_cursor_row ? max_cursor_row : cursor_row;
+	cursor_row = cursor_row < 0 ? 0 : cursor_row;
+
+	if (first_row > cursor_row)
+		first_row = cursor_row;
+
+	first_row = adjust_first_row(first_row, desc, scrdesc);
+
+	/* same positions in windows can show different rows now */
+	if (released > 0)
+		reset_window_damage();
+}
+
 /*
  * When error is detected, then better to clean screen
  */
@@ -2610,6 +2818,8 @@ main(int argc, char *argv[])
 	opts.progressive_load_mode = true;
 	opts.highlight_odd_rec = false;
 	opts.hide_header_line = false;
+	opts.mmap_load = true;
+	opts.background_load = true;
 
 	setup_sigsegv_handler();
 
@@ -2643,6 +2853,9 @@ main(int argc, char *argv[])
 	memset(&state, 0, sizeof(state));
 
 	state.reserved_rows = -1;					/* dbcli has significant number of self reserved lines */
+	state.benchmark_rows = 100000;
+	state.benchmark_columns = 10;
+	state.benchmark_unicode = 10;
 	state.file_format_from_suffix = FILE_UNDEF;	/* input file is not defined */
 
 	state.desc = &desc;							/* global reference used for readline's tabcomplete */
@@ -2695,6 +2908,9 @@ main(int argc, char *argv[])
 		setlinebuf(logfile);
 	}
 
+	if (opts.stats_pathname)
+		stats_save_at_exit(opts.stats_pathname);
+
 	if (opts.custom_theme_name)
 	{
 		FILE	   *themedesc;
@@ -2721,6 +2937,9 @@ main(int argc, char *argv[])
 	if (state.boot_wait > 0)
 		usleep(1000 * 1000 * state.boot_wait);
 
+	if (state.benchmark)
+		return run_benchmark(&opts, &state);
+
 	/*
 	 * don't use inotify, when user prefer periodic watch time, or when we
 	 * have not file for watching
@@ -2789,6 +3008,10 @@ main(int argc, char *argv[])
 	if ((opts.csv_format || opts.tsv_format || opts.query) &&
 		(state.no_interactive || (!state.interactive && !isatty(STDOUT_FILENO))))
 	{
+		/* csv can be formatted progressively, but all rows are printed */
+		while (!desc.completed && readfile(&opts, &desc, &state))
+			;
+
 		lb_print_all_ddesc(&desc, stdout);
 
 		log_row("quit due non interactive mode");
@@ -2830,6 +3053,12 @@ main(int argc, char *argv[])
 		if (state.reserved_rows != -1)
 			available_rows -= state.reserved_rows;
 
+		/* progressively formatted csv can be shorter than screen */
+		while (!desc.completed && desc.csv_stream &&
+			   desc.last_row <= available_rows &&
+			   readfile(&opts, &desc, &state))
+			;
+
 		/* the content can be displayed in one screen */
 		if (available_rows >= desc.last_row && size.ws_col > desc.maxx)
 		{
@@ -3104,6 +3333,12 @@ reinit_theme:
 		if (state.reserved_rows != -1)
 			available_rows -= state.reserved_rows;
 
+		/* progressively formatted csv can be shorter than screen */
+		while (!desc.completed && desc.csv_stream &&
+			   desc.last_row <= available_rows &&
+			   readfile(&opts, &desc, &state))
+			;
+
 		/* the content can be displayed in one screen */
 		if (available_rows >= desc.last_row && maxx >= desc.maxx)
 		{
@@ -3286,6 +3521,8 @@ reinit_theme:
 				{
 					bool	res;
 					int		total_rows_before = desc.total_rows;
+					long	recycled_rows_before = desc.recycled_rows;
+					bool	at_bottom = cursor_row >= MAX_CURSOR_ROW;
 
 					/*
 					 * When pspg is used in streaming mode, then in this moment,
@@ -3297,7 +3534,12 @@ reinit_theme:
 					 * just tty.
 					 */
 					res = readfile(&opts, &desc, &state);
-					if (res && desc.total_rows > 0)
+
+					/*
+					 * Loader thread wakes us, when it has new data, so we can
+					 * wait on tty or loader's event without timeout.
+					 */
+					if (res && desc.total_rows > 0 && !desc.loader)
 					{
 						timeout = 10;
 						only_tty = true;
@@ -3312,11 +3554,15 @@ reinit_theme:
 					 * We loaded some data, and then we need refresh.
 					 * so enforce short timeout.
 					 */
-					if (total_rows_before != desc.total_rows)
+					if (total_rows_before != desc.total_rows ||
+						recycled_rows_before != desc.recycled_rows)
 					{
 						timeout = 10;
 						only_tty = true;
 
+						if (desc.lb_own_arenas)
+							follow_stream_tail(&desc, &scrdesc, recycled_rows_before, at_bottom);
+
 						/*
 						 * maybe layout should be recreated, if
 						 * before was calculated for too small
@@ -3334,7 +3580,7 @@ reinit_theme:
 				 * we forced repeated readfile until load is completed, when
 				 * some deferred command requires complete load.
 				 */
-				if (deffered_command != cmd_Invalid)
+				if (deffered_command != cmd_Invalid && !desc.loader)
 				{
 					if (desc.completed)
 					{
@@ -3350,6 +3596,15 @@ reinit_theme:
 				if (event == PSPG_FATAL_EVENT)
 					break;
 
+				/* Ctrl-C or Escape cancels running query */
+				if (pg_query_socket() != -1 &&
+					(event == PSPG_SIGINT_EVENT ||
+					 (event == PSPG_NCURSES_EVENT && nced.keycode == PSPG_ESC_CODE)))
+				{
+					pg_cancel_query();
+					continue;
+				}
+
 				event_keycode = (event == PSPG_NCURSES_EVENT) ? nced.keycode : 0;
 
 				/*
@@ -3380,8 +3635,52 @@ reinit_theme:
 						event_keycode != KEY_MOUSE)
 					mark_mode = MARK_MODE_NONE;
 
-				if (force_refresh ||
+				/*
+				 * In follow mode, new rows are appended to current data, and
+				 * only changed rows are drawn.
+				 */
+				if (desc.lb_own_arenas && event == PSPG_READ_DATA_EVENT)
+				{
+					int		total_rows_before = desc.total_rows;
+					long	recycled_rows_before = desc.recycled_rows;
+					bool	at_bottom = cursor_row >= MAX_CURSOR_ROW;
+
+					if (readfile(&opts, &desc, &state) &&
+						(total_rows_before != desc.total_rows ||
+						 recycled_rows_before != desc.recycled_rows))
+					{
+						desc.first_data_row = 0;
+						desc.last_data_row = desc.last_row;
+
+						if (total_rows_before < LINES)
+							refresh_layout_after_terminal_resize();
+
+						follow_stream_tail(&desc, &scrdesc, recycled_rows_before, at_bottom);
+
+						set_scrollbar_dimensions(&opts, &desc, &scrdesc);
+						set_scrollbar(&scrdesc, &desc, first_row);
+
+						refresh_scr = true;
+					}
+				}
+				else if (desc.lb_own_arenas && force_refresh)
+				{
+					/*
+					 * In follow mode the rows are appended only by read data
+					 * event. The reload would replace followed rows by rows
+					 * that are not read yet, so only screen is refreshed.
+					 */
+					force_refresh = false;
+					event_keycode = 0;
+					next_event_keycode = 0;
+					next_command = 0;
+					command = 0;
+
+					refresh_scr = true;
+				}
+				else if (force_refresh ||
 					opts.watch_time ||
+					event == PSPG_QUERY_READY_EVENT ||
 					((opts.watch_file || state.stream_mode) && (event == PSPG_READ_DATA_EVENT)))
 				{
 					long	ms;
@@ -3393,6 +3692,7 @@ reinit_theme:
 
 					if (force_refresh ||
 						(ct > next_watch && !paused) ||
+						event == PSPG_QUERY_READY_EVENT ||
 						((opts.watch_file || state.stream_mode) &&
 						 (event == PSPG_READ_DATA_EVENT)))
 					{
@@ -3403,10 +3703,21 @@ reinit_theme:
 
 						/*
 						 * The query doesn't need reopen, and are available every
-						 * time.
+						 * time. The query is sent asynchronously, and the previous
+						 * result is displayed until the new result is available.
 						 */
 						if (opts.query)
-							fresh_data = true;
+						{
+							if (event == PSPG_QUERY_READY_EVENT)
+								fresh_data = true;
+							else if (pg_query_socket() == -1)
+							{
+								state.errstr = NULL;
+
+								if (pg_send_query(&opts, opts.query, &state.errstr))
+									current_time(&query_start_sec, &query_start_ms);
+							}
+						}
 						/*
 						 * force open stream, where there are not an valid input
 						 * stream. The stream can be closed inside event handler,
@@ -3455,6 +3766,9 @@ reinit_theme:
 							int		max_cursor_row;
 							ScrDesc		aux;
 
+							/* bookmarks and caches of not changed rows are reused */
+							(void) lb_reuse_unchanged(&desc2, &desc);
+
 							DataDescFree(&desc);
 							memcpy(&desc, &desc2, sizeof(desc));
 
@@ -3515,7 +3829,10 @@ reinit_theme:
 						else
 							DataDescFree(&desc2);
 
-						if ((ct - next_watch) < (opts.watch_time * 1000))
+						/* the interval of watched query starts after its result */
+						if (event == PSPG_QUERY_READY_EVENT)
+							next_watch = ct + 1000 * opts.watch_time;
+						else if ((ct - next_watch) < (opts.watch_time * 1000))
 							next_watch = next_watch + 1000 * opts.watch_time;
 						else
 							next_watch = ct + 100 * opts.watch_time;
@@ -3526,6 +3843,7 @@ reinit_theme:
 						if (fresh_data || opts.watch_time > 0 || state._errno != 0)
 						{
 							clear();
+							reset_window_damage();
 							refresh_scr = true;
 						}
 					}
@@ -5543,10 +5861,9 @@ recheck_end:
 
 			case cmd_SearchNext:
 				{
-					LineBufferIter lbi;
 					int		lineno;
-					char   *line;
 					int		skip_bytes = 0;
+					uint64_t	start_search;
 
 					if (!*scrdesc.searchterm)
 						break;
@@ -5565,72 +5882,28 @@ recheck_end:
 
 					scrdesc.found = false;
 
-					init_lbi_ddesc(&lbi, &desc, lineno);
+					start_search = stats_clock();
 
-					while (lbi_get_line_next(&lbi, &line, NULL, &lineno))
+					lineno = search_next_row(&opts, &scrdesc, &desc,
+											 lineno, skip_bytes,
+											 CURSOR_ROW_OFFSET);
+					if (lineno != -1)
 					{
-						const char   *pttrn;
-
-						if (scrdesc.search_rows > 0)
-						{
-							if (lineno - CURSOR_ROW_OFFSET < scrdesc.search_first_row ||
-								lineno - CURSOR_ROW_OFFSET >= scrdesc.search_first_row + scrdesc.search_rows)
-							{
-								continue;
-							}
-						}
-
-						pttrn = pspg_search(&opts, &scrdesc, line + skip_bytes);
-						while (pttrn)
-						{
-							/* apply column selection filtr */
-							if (scrdesc.search_columns > 0)
-							{
-								int		bytes = pttrn - line;
-								int		pos = use_utf8 ? utf_string_dsplen(line, bytes) : bytes;
-
-								if (pos < scrdesc.search_first_column)
-								{
-									pttrn += charlen(pttrn);
-									pttrn = pspg_search(&opts, &scrdesc, pttrn);
-
-									continue;
-								}
-
-								if (pos > scrdesc.search_first_column + scrdesc.search_columns - 1)
-									pttrn = NULL;
-							}
+						fresh_found = true;
+						fresh_found_cursor_col = -1;
 
-							break;
-						}
+						cursor_row = lineno - CURSOR_ROW_OFFSET;
 
-						if (pttrn)
-						{
-							int		found_start_bytes = pttrn - line;
-
-							scrdesc.found_start_x =
-								use_utf8 ? utf_string_dsplen(line, found_start_bytes) : (int) (found_start_bytes);
-
-							scrdesc.found_start_bytes = found_start_bytes;
-							scrdesc.found_row = lineno;
-
-							fresh_found = true;
-							fresh_found_cursor_col = -1;
-
-							cursor_row = lineno - CURSOR_ROW_OFFSET;
-
-							if (cursor_row - first_row + 1 > VISIBLE_DATA_ROWS)
-								first_row = cursor_row - VISIBLE_DATA_ROWS + 1;
-
-							first_row = adjust_first_row(first_row, &desc, &scrdesc);
+						if (cursor_row - first_row + 1 > VISIBLE_DATA_ROWS)
+							first_row = cursor_row - VISIBLE_DATA_ROWS + 1;
 
-							scrdesc.found = true;
-							break;
-						}
+						first_row = adjust_first_row(first_row, &desc, &scrdesc);
 
-						skip_bytes = 0;
+						scrdesc.found = true;
 					}
 
+					stats_timer_stop(STATS_SEARCH, start_search);
+
 					if (!scrdesc.found)
 						show_info_wait(" Not found", NULL, true, true, false, false);
 					break;
@@ -5696,9 +5969,11 @@ recheck_end:
 			case cmd_SearchPrev:
 				{
 					LineBufferIter lbi;
+					SearchFilter sf;
 					int		lineno;
 					char   *line, *_line;
 					int		cut_bytes = 0;
+					uint64_t	start_search;
 
 					if (!*scrdesc.searchterm)
 						break;
@@ -5724,9 +5999,14 @@ recheck_end:
 
 					scrdesc.found = false;
 
+					start_search = stats_clock();
+
 					init_lbi_ddesc(&lbi, &desc, lineno);
+					init_search_filter(&sf, scrdesc.searchterm);
 
-					while (lbi_get_line_prev(&lbi, &line, NULL, &lineno))
+					for (skip_not_found_rows(&lbi, &sf, &desc, false);
+						 lbi_get_line_prev(&lbi, &line, NULL, &lineno);
+						 skip_not_found_rows(&lbi, &sf, &desc, false))
 					{
 						const char   *ptr;
 						const char   *most_right_pttrn = NULL;
@@ -5808,6 +6088,8 @@ recheck_end:
 						cut_bytes = 0;
 					}
 
+					stats_timer_stop(STATS_SEARCH, start_search);
+
 					if (!scrdesc.found)
 						show_info_wait(" Not found", NULL, true, true, false, false);
 
@@ -5836,6 +6118,23 @@ recheck_end:
 					break;
 				}
 
+			case cmd_SearchAll:
+				{
+					if (!*scrdesc.searchterm)
+					{
+						show_info_wait(" There are not search pattern",
+									   NULL, true, true, true, false);
+						break;
+					}
+
+					search_all_rows(&opts, &scrdesc, &desc);
+
+					if (desc.found_lines == 0)
+						show_info_wait(" Not found", NULL, true, true, false, false);
+
+					break;
+				}
+
 			case cmd_SearchColumn:
 				{
 					if (desc.namesline)
@@ -6694,6 +6993,8 @@ refresh:
 	 * It is not necessary, but it can helps with debugging of
 	 * memory leaks.
 	 */
+	snapshot_save(&opts, &desc);
+
 	lb_free(&desc);
 	free(desc.cranges);
 	free(desc.headline_transl);
@@ -6782,9 +7083,17 @@ print_memory_stats(bool enable_memory_debug)
 
 #endif
 
+#endif
+
+		if (current_state && current_state->desc && current_state->desc->arena)
+		{
+			MemArena   *arena = current_state->desc->arena;
+
+			fprintf(debug_pipe, "Row arena allocated bytes:             %zu\n", arena->allocated);
+			fprintf(debug_pipe, "Row arena used bytes:                  %zu\n", arena->used);
+			fprintf(debug_pipe, "Row arena chunks:                      %d\n", arena->nchunks);
+		}
 	}
 }
 
 #endif
-
-#endif
@@ -15,6 +15,8 @@
 #define PSPG_PSPG_H
 
 #include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "commands.h"
@@ -27,7 +29,6 @@
 #define LINEINFO_FOUNDSTR			2
 #define LINEINFO_FOUNDSTR_MULTI		4
 #define LINEINFO_UNKNOWN			8
-#define LINEINFO_CONTINUATION		16
 
 #define			FILE_UNDEF			0
 #define			FILE_CSV			1
@@ -45,21 +46,104 @@ typedef struct LineInfo
 {
 	char			mask;
 	short int		start_char;
-	short int		recno_offset;
 } LineInfo;
 
+/*
+ * Simple chunked allocator. All memory is released together.
+ */
+typedef struct MemArenaChunk
+{
+	struct MemArenaChunk *next;
+	size_t	size;					/* size of data area */
+	size_t	used;					/* used bytes of data area */
+	char	data[];
+} MemArenaChunk;
+
+typedef struct
+{
+	MemArenaChunk *chunks;			/* list of chunks, first is current */
+	size_t	allocated;				/* sum of size of all chunks */
+	size_t	used;					/* sum of allocated bytes */
+	int		nchunks;				/* number of chunks */
+	size_t	chunk_size;				/* size of chunk or 0 for default */
+} MemArena;
+
 #define	LINEBUFFER_LINES		1000
 
+/*
+ * Sparse map of display positions of one row. Every DSPPOS_CHECKPOINT_STEP
+ * display columns, the byte offset and display position of first char
+ * starting there is stored, so horizontal seek doesn't need to walk from
+ * start of row.
+ */
+#define DSPPOS_CHECKPOINT_STEP		64
+
+typedef struct
+{
+	int		bytes;
+	int		pos;
+} DspPosCheckpoint;
+
+typedef struct
+{
+	int		nitems;
+	DspPosCheckpoint items[];
+} DspPosCheckpoints;
+
 typedef struct LineBuffer
 {
-	int		first_row;
+	int		first_row;				/* input number of first row of buffer */
 	int		nrows;
-	char   *rows[LINEBUFFER_LINES];
+	char  **rows;					/* LINEBUFFER_LINES pointers to rows, in rows arena */
 	LineInfo	   *lineinfo;
+	DspPosCheckpoints **checkpoints;	/* lazy created display positions maps or NULL */
+	MemArena	   *arena;			/* holds rows, lineinfo and next line buffers */
 	struct LineBuffer *next;
 	struct LineBuffer *prev;
+	unsigned char  *search_filter;	/* bloom filter of trigrams of rows or NULL */
+	int				search_filter_bits;		/* log2 of size of filter, 0 when it is not usable */
+	int				search_filter_nrows;	/* number of rows, when filter was created */
+	unsigned long long rows_hash;	/* hash of rows, used for compare with reloaded data */
+	int				rows_hash_nrows;	/* number of rows, when hash was calculated */
+	unsigned char  *continuation_bits;	/* bitmap of rows continued on next row or NULL */
+	int				first_recno;	/* record number of first data row of buffer */
+	uint32_t	   *column_offsets;	/* byte offsets of columns of rows (malloc-ed) or NULL */
+	int				column_offsets_columns;	/* number of columns of column_offsets */
+	struct LbSpill *spill;			/* spill storage, when rows can be evicted, or NULL */
+	MemArena	   *rows_arena;		/* holds rows of line buffer that can be evicted */
+	off_t			spill_offset;	/* offset of saved rows in spill file or -1 */
+	char		   *spill_data;		/* saved rows, when they are stored in memory */
+	size_t			spill_size;		/* size of saved (possibly compressed) rows */
+	size_t			rows_size;		/* size of saved rows before compression */
+	size_t			resident_size;	/* size of rows arena counted in spill storage */
+	bool			spilled;		/* rows are not in memory, should be paged in */
+	atomic_bool		referenced;		/* rows was used after last check of eviction */
+	int				pins;			/* number of workers that use rows */
 } LineBuffer;
 
+/*
+ * Ensures so rows of line buffer are in memory. Should be used before
+ * direct access to lb->rows, when pointers to rows are not hold over
+ * other accesses. Workers should to use lb_pin and lb_unpin instead.
+ */
+#define LB_PAGE_IN(lb) \
+	do { \
+		if ((lb)->spill) \
+			lb_page_in(lb); \
+	} while (0)
+
+/*
+ * Rows of line buffers, that can be evicted, are stored in own arena
+ */
+#define LB_ROWS_ARENA(lb)		((lb)->rows_arena ? (lb)->rows_arena : (lb)->arena)
+
+/*
+ * Returns true, when row is continued on next row (multiline field)
+ */
+#define LB_IS_CONTINUED(lb, rowno) \
+	((lb)->continuation_bits && \
+	 ((lb)->continuation_bits[(rowno) >> 3] & (1 << ((rowno) & 7))))
+
 typedef struct
 {
 	LineBuffer	   *lnb;
@@ -82,6 +166,22 @@ typedef struct
 	int				lnb_row;
 } SortData;
 
+/*
+ * Sorted keys of one column. The keys are in ascending order and
+ * they are valid only for data, that had same layout.
+ */
+typedef struct
+{
+	SortData	   *keys;			/* sort keys in ascending order or NULL */
+	int				nitems;			/* number of keys */
+	bool			is_text;		/* keys are strxfrm blobs */
+	int				total_rows;		/* total_rows of DataDesc when keys was created */
+	int				first_data_row;
+	int				last_data_row;
+	int				xmin;
+	int				xmax;
+} SortCacheItem;
+
 /*
  * Column range
  */
@@ -143,7 +243,8 @@ typedef struct
 	int		fixed_columns;			/* number of fixed columns */
 	int		data_rows;				/* number of data rows */
 	bool	oid_name_table;			/* detected system table with first oid column */
-	bool	multilines_already_tested;	/* true, when we know where are multilines */
+	int		multilines_tested_rows;	/* rows before this row are tested for multilines */
+	int		multilines_recno;		/* record number of first not tested row */
 	bool	has_multilines;			/* true, when some field contains more lines */
 
 	bool	initialized;			/* used as protection against unwanted initialization
@@ -152,8 +253,43 @@ typedef struct
 	LineBuffer *last_buffer;		/* pointer to last LineBuffer */
 
 	bool	load_data_rows;			/* true, when loaded rows holds data */
+
+	MemArena *arena;				/* memory of rows, line buffers and line infos */
+
+	char   *mmap_addr;				/* mapped input file or NULL */
+	size_t	mmap_size;				/* size of mapped input file */
+	size_t	mmap_pos;				/* offset of first not processed byte */
+	size_t *lb_offsets;				/* offsets of first row of line buffers in mapped file */
+	int		lb_offsets_size;		/* number of allocated items of lb_offsets */
+
+	LineBuffer **lb_dir;			/* line buffers after first, lb_dir[i] is (i + 1)th */
+	int		lb_dir_items;			/* number of line buffers after first */
+	int		lb_dir_size;			/* number of allocated items of lb_dir */
+	bool	lb_own_arenas;			/* every line buffer has own arena (follow mode) */
+	long	recycled_rows;			/* number of rows released in follow mode */
+
+	struct Loader *loader;			/* background reader of input or NULL */
+	struct LbSpill *spill;			/* storage of evicted line buffers or NULL */
+	struct CsvStream *csv_stream;	/* state of progressive csv formatting or NULL */
+	struct Snapshot *snapshot;		/* snapshot of parsed mapped file or NULL */
+	bool	rows_modified;			/* rows are not same like mapped input file */
+
+	SortCacheItem *sort_cache;		/* sorted keys of columns (indexed by colno - 1) */
+	int		sort_cache_items;		/* number of allocated items of sort_cache */
+
+	unsigned char *found_rows;		/* bitmap of input rows with found pattern or NULL */
+	unsigned short *found_counts;	/* number of occurrences of pattern in input rows */
+	int		found_rows_items;		/* number of rows, when found_rows was created */
+	int		found_lines;			/* number of rows with found pattern */
+	long	found_matches;			/* number of all occurrences of pattern */
 } DataDesc;
 
+#define FOUND_ROWS_IS_VALID(desc) \
+	((desc)->found_rows && (desc)->found_rows_items == (desc)->total_rows)
+
+#define FOUND_ROWS_TEST(desc, rowno) \
+	((desc)->found_rows[(rowno) >> 3] & (1 << ((rowno) & 7)))
+
 #define		PSPG_WINDOW_COUNT				10
 #define		PSPG_WINDOW_THEMES_COUNT		13
 
@@ -289,12 +425,19 @@ typedef struct
 
 	int		theme_template;
 	int		menu_template;
+
+	bool	benchmark;				/* run benchmark over synthetic data and quit */
+	int		benchmark_rows;
+	int		benchmark_columns;
+	int		benchmark_unicode;		/* percent of text values with non ascii chars */
 } StateData;
 
 
 typedef struct
 {
 	LineBuffer	   *start_lb;
+	LineBuffer	  **lb_dir;			/* line buffers after start_lb */
+	int				lb_dir_items;
 	MappedLine	   *order_map;
 	int				order_map_items;
 
@@ -316,6 +459,16 @@ typedef struct
 	int				lb_rowno;
 } SimpleLineBufferIter;
 
+/*
+ * Hashes of trigrams of searched pattern. When there are no trigrams,
+ * then no line buffer can be skipped.
+ */
+typedef struct
+{
+	int				ntrigrams;
+	unsigned int	trigrams[256];
+} SearchFilter;
+
 typedef struct
 {
 	int		len;
@@ -333,6 +486,7 @@ extern void enable_xterm_mouse_mode(bool enable);
 extern bool disable_xterm_mouse_mode(void);
 extern void show_info_wait(const char *fmt, const char *par, bool beep,
 						   bool refresh_first, bool applytimeout, bool is_error);
+extern bool show_info_progress(const char *fmt, int timeout);
 
 extern void current_time(time_t *sec, long *ms);
 extern void refresh_terminal_size(void);
@@ -346,11 +500,63 @@ extern int max_int(int a, int b);
 #define UNUSED(expr) do { (void)(expr); } while (0)
 
 
+/*
+ * Timers and counters of main operations. These values are displayed by
+ * command \stats, and they can be saved to file before exit.
+ */
+typedef enum
+{
+	STATS_LOAD,					/* reading of psql format (readfile) */
+	STATS_PARSE,				/* reading and formatting of csv, tsv or query result */
+	STATS_SORT,
+	STATS_SEARCH,
+	STATS_REDRAW,				/* frame time without doupdate throttling */
+	STATS_PGWAIT,				/* waiting on libpq (connect, results) */
+	STATS_TIMERS_COUNT
+} StatsTimer;
+
+typedef enum
+{
+	STATS_ROWS_READ,
+	STATS_BYTES_READ,
+	STATS_ALLOCATIONS,
+	STATS_ALLOCATED_BYTES,
+	STATS_COUNTERS_COUNT
+} StatsCounter;
+
+/* from stats.c */
+extern uint64_t stats_clock(void);
+extern void stats_timer_stop(StatsTimer timer, uint64_t start);
+extern void stats_counter_add(StatsCounter counter, long value);
+extern void stats_alloc_add(long size);
+extern void stats_summary(char *buffer, int size);
+extern bool stats_save_json(const char *pathname);
+extern void stats_save_at_exit(const char *pathname);
+
+/* from compress.c */
+extern size_t lz_compress_bound(size_t size);
+extern size_t lz_compress(const char *src, size_t size, char *dest);
+extern bool lz_decompress(const char *src, size_t csize, char *dest, size_t size);
+
+/* from snapshot.c */
+extern void snapshot_capture(Options *opts, DataDesc *desc);
+extern bool snapshot_load(Options *opts, DataDesc *desc);
+extern void snapshot_restore_caches(DataDesc *desc);
+extern void snapshot_save(Options *opts, DataDesc *desc);
+extern void snapshot_free(DataDesc *desc);
+
+/* from bench.c */
+extern int run_benchmark(Options *opts, StateData *state);
+
 /* from print.c */
+extern void reset_window_damage(void);
 extern void window_fill(int window_identifier, int srcy, int srcx, int cursor_row, int vcursor_xmin, int vcursor_xmax,
 	int selected_xmin, int selected_xmax, DataDesc *desc, ScrDesc *scrdesc, Options *opts);
 extern void draw_data(Options *opts, ScrDesc *scrdesc, DataDesc *desc, int first_data_row, int first_row, int cursor_col, int footer_cursor_col, int fix_rows_offset);
+extern int search_line(Options *opts, ScrDesc *scrdesc, DataDesc *desc, int lineno, const char *rowstr, int max_matches, short int *start_char);
 extern LineInfo *set_line_info(Options *opts, ScrDesc *scrdesc, DataDesc *desc, LineBufferMark *lbm, char *rowstr);
+extern void search_all_rows(Options *opts, ScrDesc *scrdesc, DataDesc *desc);
+extern void found_rows_free(DataDesc *desc);
 
 #define PSPG_ERRSTR_BUFFER_SIZE		2048
 extern char pspg_errstr_buffer[PSPG_ERRSTR_BUFFER_SIZE];
@@ -362,6 +568,7 @@ extern const char *nstrstr_ignore_lower_case(const char *haystack, const char *n
 extern bool nstreq(const char *str1, const char *str2);
 
 extern const char *pspg_search(Options *opts, ScrDesc *scrdesc, const char *str);
+extern int search_next_row(Options *opts, ScrDesc *scrdesc, DataDesc *desc, int lineno, int skip_bytes, int row_offset);
 
 /* from menu.c */
 extern void init_menu_config(Options *opts);
@@ -374,12 +581,26 @@ extern void refresh_copy_target_options(Options *opts, struct ST_MENU *menu);
 /* from sort.c */
 extern void sort_column_num(SortData *sortbuf, int rows, bool desc);
 extern void sort_column_text(SortData *sortbuf, int rows, bool desc);
+extern void sort_column_parallel(SortData *sortbuf, int rows, bool desc, bool text, int nworkers);
+extern void sort_column_reverse(SortData *sortbuf, SortData *dest, int rows, bool text);
+extern void sort_cache_free(DataDesc *desc);
 
 /* from pretty-csv.c */
 extern bool read_and_format(Options *opts, DataDesc *desc, StateData *state);
+extern bool read_and_format_next(Options *opts, DataDesc *desc, StateData *state);
+extern void csv_stream_free(DataDesc *desc);
 
 /* from pgclient.c */
-extern bool pg_exec_query(Options *opts, char *query, RowBucketType *rb, PrintDataDesc *pdesc, const char **err);
+struct PgQueryStream;
+
+extern bool pg_exec_query(Options *opts, char *query, RowBucketType *rb, PrintDataDesc *pdesc, int max_rows, struct PgQueryStream **qsptr, const char **err);
+extern bool pg_fetch_rows(struct PgQueryStream *qs, RowBucketType *rb, int max_rows, bool *more_data, const char **err);
+extern void pg_query_stream_free(struct PgQueryStream *qs);
+extern void pg_close_connection(void);
+extern bool pg_send_query(Options *opts, char *query, const char **err);
+extern int pg_query_socket(void);
+extern bool pg_query_is_ready(void);
+extern void pg_cancel_query(void);
 
 /* from args.c */
 extern char **buildargv(const char *input, int *argc, char *appname);
@@ -398,6 +619,16 @@ extern char *sstrdup(const char *str);
 extern char *sstrdup2(const char *str, char *debugstr);
 extern char *sstrndup(const char *str, int bytes);
 
+extern MemArena *arena_create(void);
+extern MemArena *arena_create_sized(size_t chunk_size);
+extern void *arena_alloc(MemArena *arena, size_t size);
+extern char *arena_strndup(MemArena *arena, const char *str, size_t bytes);
+extern void arena_merge(MemArena *dest, MemArena *src);
+extern void arena_free(MemArena *arena);
+
+extern int parallel_workers(long nitems, long min_items);
+extern void run_parallel_tasks(void *(*routine)(void *), void *tasks, size_t task_size, int ntasks);
+
 extern int charlen(const char *str);
 extern int dsplen(const char *str);
 extern char *trim_str(const char *str, int *size);
@@ -435,7 +666,8 @@ extern bool export_data(Options *opts, ScrDesc *scrdesc, DataDesc *desc,
 						PspgCommand cmd, ClipboardFormat format);
 
 /* from linebuffer.c */
-extern void init_lbi(LineBufferIter *lbi, LineBuffer *lb, MappedLine *order_map, int order_map_items, int init_pos);
+extern void init_lbi(LineBufferIter *lbi, LineBuffer *lb, LineBuffer **lb_dir, int lb_dir_items,
+					 MappedLine *order_map, int order_map_items, int init_pos);
 extern void init_lbi_ddesc(LineBufferIter *lbi, DataDesc *desc, int init_pos);
 extern bool lbi_set_lineno(LineBufferIter *lbi, int pos);
 extern void lbi_set_mark(LineBufferIter *lbi, LineBufferMark *lbm);
@@ -449,11 +681,36 @@ extern bool lbi_next(LineBufferIter *lbi);
 extern SimpleLineBufferIter *init_slbi_ddesc(SimpleLineBufferIter *slbi, DataDesc *desc);
 extern SimpleLineBufferIter *slbi_get_line_next(SimpleLineBufferIter *slbi, char **line, LineInfo **linfo);
 extern bool ddesc_set_mark(LineBufferMark *lbm, DataDesc *desc, int pos);
+extern LineBuffer *lb_alloc(DataDesc *desc, LineBuffer *prev);
+extern LineInfo *lb_alloc_lineinfo(LineBuffer *lb);
+extern void lb_alloc_rows(LineBuffer *lb);
 extern void lbm_xor_mask(LineBufferMark *lbm, char mask);
-extern void lbm_recno_offset(LineBufferMark *lbm, short int recno_offset);
+extern int lb_get_recno(DataDesc *desc, LineBuffer *lb, int rowno);
 extern void lb_free(DataDesc *desc);
 extern void lb_print_all_ddesc(DataDesc *desc, FILE *f);
 extern const char *getline_ddesc(DataDesc *desc, int pos);
+extern void init_search_filter(SearchFilter *sf, const char *pattern);
+extern bool lb_may_contain(LineBuffer *lb, SearchFilter *sf);
+extern void lbi_skip_not_found(LineBufferIter *lbi, DataDesc *desc, bool forward);
+extern void lbi_skip_filtered(LineBufferIter *lbi, SearchFilter *sf, bool forward);
+extern char *lb_seek_dsppos(LineBuffer *lb, int rowno, int pos, bool build, int *seek_pos);
+extern char *lb_seek_column(DataDesc *desc, LineBuffer *lb, int rowno, int colno, int *seek_pos);
+extern bool lb_column_offsets_enabled(DataDesc *desc);
+extern void lb_free_column_offsets(DataDesc *desc);
+extern int lb_reuse_unchanged(DataDesc *desc, DataDesc *prev);
+extern int lb_recycle(DataDesc *desc, int max_rows, size_t max_bytes);
+extern bool lb_spill_start(Options *opts, DataDesc *desc);
+extern void lb_page_in(LineBuffer *lb);
+extern void lb_pin(LineBuffer *lb);
+extern void lb_unpin(LineBuffer *lb);
+
+/* from loader.c */
+extern bool loader_start(Options *opts, DataDesc *desc, StateData *state);
+extern ssize_t loader_getline(struct Loader *loader, char **lineptr, size_t *n, bool wait_on_data);
+extern bool loader_is_finished(struct Loader *loader);
+extern int loader_get_fd(struct Loader *loader);
+extern void loader_ack_wakeup(struct Loader *loader);
+extern void loader_free(DataDesc *desc);
 
 /* from bscommands.c */
 extern const char *get_token(const char *instr, const char **token, int *n);
@@ -85,10 +85,12 @@ static const char *bscommands[] = {
 	"order",
 	"orderd",
 	"search",
+	"findall",
 	"sort",
 	"sortd",
 	"rsort",
 	"dsort",
+	"stats",
 	NULL
 };
 
@@ -0,0 +1,881 @@
+/*-------------------------------------------------------------------------
+ *
+ * snapshot.c
+ *	  cache of parsed metadata of large input files
+ *
+ * Portions Copyright (c) 2017-2021 Pavel Stehule
+ *
+ * IDENTIFICATION
+ *	  src/snapshot.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <locale.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pspg.h"
+#include "inputs.h"
+
+/*
+ * Snapshot holds the result of readfile over mapped file - metadata of
+ * DataDesc, and offsets of first rows of line buffers. When the file is
+ * opened again, and it was not changed, the rows are found just by
+ * searching of new line chars, and the parsing of rows is skipped. When
+ * they was calculated, the results of multilines detection and sorted
+ * keys of columns are stored too, and they are used, when the layout
+ * of data is same.
+ *
+ * The snapshot is written to cache dir, when pspg ends. The name of file
+ * is hash of full path of input file. The input file is identified by
+ * path, size, mtime, inode and device. The snapshot is mapped to memory,
+ * so all sections are aligned.
+ */
+#define SNAPSHOT_MAGIC			"PSPGSNP1"
+#define SNAPSHOT_MIN_ROWS		10000
+
+#define SNAPSHOT_ALIGN(size)	(((size) + 7) & ~((size_t) 7))
+
+typedef struct
+{
+	int32_t		total_rows;
+	int32_t		title_rows;
+	int32_t		border_top_row;
+	int32_t		border_head_row;
+	int32_t		border_bottom_row;
+	int32_t		footer_row;
+	int32_t		alt_footer_row;
+	int32_t		last_data_row;
+	int32_t		last_row;
+	int32_t		maxbytes;
+	int32_t		maxx;
+	int32_t		is_expanded_mode;
+	int32_t		load_data_rows;
+	char		title[68];
+} SnapshotDesc;
+
+typedef struct
+{
+	char		magic[8];
+	int32_t		header_size;		/* protection against change of layout */
+	int32_t		use_utf8;
+	uint64_t	file_size;
+	int64_t		mtime_sec;
+	int64_t		mtime_nsec;
+	uint64_t	ino;
+	uint64_t	dev;
+	char		pathname[PATH_MAX];
+	char		collate[64];		/* LC_COLLATE used for text sort keys */
+
+	SnapshotDesc meta;				/* DataDesc after readfile */
+	int32_t		nbuffers;			/* number of line buffers */
+
+	/* layout of data, when multilines detection and sort keys are valid */
+	int32_t		first_data_row;
+	int32_t		last_data_row;
+	int32_t		border_type;
+	int32_t		headline_char_size;
+
+	int32_t		multilines_tested_rows;
+	int32_t		multilines_recno;
+	int32_t		has_multilines;
+	int32_t		multilines_buffers;	/* number of line buffer records or zero */
+	int32_t		sort_items;			/* number of cached sort keys of columns */
+	int32_t		padding;
+
+	uint64_t	offsets_pos;		/* uint64_t offsets of line buffers */
+	uint64_t	multilines_pos;		/* SnapshotLineBuffer records */
+	uint64_t	sort_pos;			/* SnapshotSortItem items */
+	uint64_t	size;				/* size of snapshot file */
+} SnapshotHeader;
+
+typedef struct
+{
+	int32_t		first_recno;
+	int32_t		has_continuation_bits;
+	unsigned char continuation_bits[(LINEBUFFER_LINES + 7) / 8];
+} SnapshotLineBuffer;
+
+/*
+ * Sort item is followed by keys, and then by zero terminated strxfrm
+ * blobs of text keys.
+ */
+typedef struct
+{
+	int32_t		sbcn;
+	int32_t		nitems;
+	int32_t		is_text;
+	int32_t		xmin;
+	int32_t		xmax;
+	int32_t		padding;
+	uint64_t	blobs_size;
+} SnapshotSortItem;
+
+typedef struct
+{
+	int32_t		lineno;
+	int32_t		info;
+	double		d;
+} SnapshotSortKey;
+
+typedef struct Snapshot
+{
+	SnapshotDesc meta;				/* DataDesc after last readfile */
+	bool		captured;
+	bool		loaded;				/* rows was loaded from snapshot */
+	char	   *addr;				/* mapped snapshot file or NULL */
+	size_t		size;
+	bool		multilines_loaded;
+	int			sort_items_loaded;
+} Snapshot;
+
+/*
+ * Returns path of snapshot file of input file. Returns false, when
+ * there is not cache dir.
+ */
+static bool
+snapshot_pathname(const char *fullpath, char *pathname, bool create_dir)
+{
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char		dir[PATH_MAX - 32];
+	unsigned long long h = 14695981039346656037ULL;
+	const unsigned char *ptr;
+
+	if (cache_home && *cache_home)
+		snprintf(dir, sizeof(dir), "%s/pspg", cache_home);
+	else if (home && *home)
+		snprintf(dir, sizeof(dir), "%s/.cache/pspg", home);
+	else
+		return false;
+
+	if (create_dir)
+	{
+		char	   *slash = strrchr(dir, '/');
+
+		/* the parent dir (.cache) can be missing too */
+		*slash = '\0';
+		if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+			return false;
+		*slash = '/';
+
+		if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+		{
+			log_row("cannot to create snapshot dir \"%s\" (%s)", dir, strerror(errno));
+			return false;
+		}
+	}
+
+	for (ptr = (const unsigned char *) fullpath; *ptr; ptr++)
+	{
+		h ^= *ptr;
+		h *= 1099511628211ULL;
+	}
+
+	return snprintf(pathname, PATH_MAX, "%s/%016llx.snapshot", dir, h) < PATH_MAX;
+}
+
+static void
+copy_meta(SnapshotDesc *meta, DataDesc *desc)
+{
+	memset(meta, 0, sizeof(SnapshotDesc));
+
+	meta->total_rows = desc->total_rows;
+	meta->title_rows = desc->title_rows;
+	meta->border_top_row = desc->border_top_row;
+	meta->border_head_row = desc->border_head_row;
+	meta->border_bottom_row = desc->border_bottom_row;
+	meta->footer_row = desc->footer_row;
+	meta->alt_footer_row = desc->alt_footer_row;
+	meta->last_data_row = desc->last_data_row;
+	meta->last_row = desc->last_row;
+	meta->maxbytes = desc->maxbytes;
+	meta->maxx = desc->maxx;
+	meta->is_expanded_mode = desc->is_expanded_mode;
+	meta->load_data_rows = desc->load_data_rows;
+	memcpy(meta->title, desc->title, sizeof(desc->title));
+}
+
+/*
+ * Stores metadata of DataDesc, when all rows of mapped file was read.
+ * Should be called before readfile changes metadata after reading rows.
+ */
+void
+snapshot_capture(Options *opts, DataDesc *desc)
+{
+	if (!opts->snapshot || !desc->mmap_addr)
+		return;
+
+	if (!desc->snapshot)
+		desc->snapshot = smalloc(sizeof(Snapshot));
+
+	copy_meta(&desc->snapshot->meta, desc);
+	desc->snapshot->captured = true;
+}
+
+/*
+ * Reverts changes of mapped file (new line chars) and removes
+ * partially loaded rows.
+ */
+static void
+snapshot_unload_rows(DataDesc *desc)
+{
+	LineBuffer *lb;
+	int			i;
+
+	for (lb = &desc->rows; lb; lb = lb->next)
+	{
+		for (i = 0; i < lb->nrows; i++)
+		{
+			char	   *row = lb->rows[i];
+
+			if (row >= desc->mmap_addr && row < desc->mmap_addr + desc->mmap_size)
+				row[strlen(row)] = '\n';
+		}
+	}
+
+	desc->rows.nrows = 0;
+	desc->rows.next = NULL;
+	desc->lb_dir_items = 0;
+}
+
+/*
+ * Returns true, when the snapshot is valid for input file
+ */
+static bool
+snapshot_is_valid(SnapshotHeader *hdr, size_t size, const char *fullpath, DataDesc *desc)
+{
+	struct stat statbuf;
+	size_t		nbuffers;
+
+	if (size < sizeof(SnapshotHeader) ||
+		memcmp(hdr->magic, SNAPSHOT_MAGIC, 8) != 0 ||
+		hdr->header_size != (int32_t) sizeof(SnapshotHeader) ||
+		hdr->size != size)
+		return false;
+
+	if (fstat(fileno(f_data), &statbuf) != 0 ||
+		(uint64_t) statbuf.st_size != hdr->file_size ||
+		statbuf.st_mtim.tv_sec != hdr->mtime_sec ||
+		statbuf.st_mtim.tv_nsec != hdr->mtime_nsec ||
+		(uint64_t) statbuf.st_ino != hdr->ino ||
+		(uint64_t) statbuf.st_dev != hdr->dev ||
+		hdr->file_size != desc->mmap_size)
+		return false;
+
+	if (strncmp(hdr->pathname, fullpath, PATH_MAX) != 0 ||
+		hdr->use_utf8 != use_utf8)
+		return false;
+
+	nbuffers = (size_t) (hdr->meta.total_rows + LINEBUFFER_LINES - 1) / LINEBUFFER_LINES;
+
+	if (hdr->meta.total_rows <= 0 ||
+		(size_t) hdr->nbuffers != nbuffers ||
+		hdr->offsets_pos + nbuffers * sizeof(uint64_t) > size ||
+		(hdr->multilines_buffers > 0 &&
+		 (hdr->multilines_buffers != hdr->nbuffers ||
+		  hdr->multilines_pos + nbuffers * sizeof(SnapshotLineBuffer) > size)) ||
+		hdr->sort_pos > size)
+		return false;
+
+	return true;
+}
+
+/*
+ * Loads rows of mapped input file by snapshot. Returns false, when there
+ * is not valid snapshot, and then the file should be parsed.
+ */
+bool
+snapshot_load(Options *opts, DataDesc *desc)
+{
+	char		fullpath[PATH_MAX];
+	char		pathname[PATH_MAX];
+	struct stat statbuf;
+	SnapshotHeader *hdr;
+	uint64_t   *offsets;
+	LineBuffer *rows = &desc->rows;
+	void	   *addr;
+	int			nrows = 0;
+	int			fd;
+	int			lbno;
+
+	if (!opts->snapshot || !opts->pathname || !desc->mmap_addr ||
+		desc->total_rows > 0)
+		return false;
+
+	if (!realpath(opts->pathname, fullpath) ||
+		!snapshot_pathname(fullpath, pathname, false))
+		return false;
+
+	fd = open(pathname, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	if (fstat(fd, &statbuf) != 0 || statbuf.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	addr = mmap(NULL, (size_t) statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (addr == MAP_FAILED)
+	{
+		log_row("cannot to map snapshot \"%s\" (%s)", pathname, strerror(errno));
+		return false;
+	}
+
+	hdr = (SnapshotHeader *) addr;
+
+	if (!snapshot_is_valid(hdr, (size_t) statbuf.st_size, fullpath, desc))
+	{
+		log_row("snapshot \"%s\" is not valid for input file", pathname);
+		munmap(addr, (size_t) statbuf.st_size);
+		return false;
+	}
+
+	offsets = (uint64_t *) ((char *) addr + hdr->offsets_pos);
+
+	desc->lb_offsets = smalloc(hdr->nbuffers * sizeof(size_t));
+	desc->lb_offsets_size = hdr->nbuffers;
+
+	for (lbno = 0; lbno < hdr->nbuffers; lbno++)
+	{
+		char	   *ptr;
+		char	   *end;
+		int			n;
+		int			i;
+
+		if (offsets[lbno] >= desc->mmap_size ||
+			(lbno + 1 < hdr->nbuffers && offsets[lbno + 1] <= offsets[lbno]))
+			goto broken;
+
+		ptr = desc->mmap_addr + offsets[lbno];
+		end = lbno + 1 < hdr->nbuffers ? desc->mmap_addr + offsets[lbno + 1] : desc->mmap_addr + desc->mmap_size;
+		n = hdr->meta.total_rows - nrows;
+		if (n > LINEBUFFER_LINES)
+			n = LINEBUFFER_LINES;
+
+		if (lbno > 0)
+			rows = lb_alloc(desc, rows);
+
+		desc->lb_offsets[lbno] = offsets[lbno];
+
+		for (i = 0; i < n; i++)
+		{
+			char	   *endline = memchr(ptr, '\n', end - ptr);
+
+			if (endline)
+			{
+				*endline = '\0';
+				rows->rows[rows->nrows++] = ptr;
+				ptr = endline + 1;
+			}
+			/* last row without new line char is copied to arena */
+			else if (lbno + 1 == hdr->nbuffers && i + 1 == n && ptr < end)
+			{
+				rows->rows[rows->nrows++] = arena_strndup(desc->arena, ptr, end - ptr);
+				ptr = end;
+			}
+			else
+				goto broken;
+		}
+
+		if (ptr != end)
+			goto broken;
+
+		nrows += n;
+	}
+
+	desc->total_rows = nrows;
+	desc->last_buffer = rows != &desc->rows ? rows : NULL;
+	desc->mmap_pos = desc->mmap_size;
+
+	desc->title_rows = hdr->meta.title_rows;
+	desc->border_top_row = hdr->meta.border_top_row;
+	desc->border_head_row = hdr->meta.border_head_row;
+	desc->border_bottom_row = hdr->meta.border_bottom_row;
+	desc->footer_row = hdr->meta.footer_row;
+	desc->alt_footer_row = hdr->meta.alt_footer_row;
+	desc->last_data_row = hdr->meta.last_data_row;
+	desc->last_row = hdr->meta.last_row;
+	desc->maxbytes = hdr->meta.maxbytes;
+	desc->maxx = hdr->meta.maxx;
+	desc->is_expanded_mode = hdr->meta.is_expanded_mode;
+	desc->load_data_rows = hdr->meta.load_data_rows;
+	memcpy(desc->title, hdr->meta.title, sizeof(desc->title));
+	desc->title[sizeof(desc->title) - 1] = '\0';
+
+	if (!desc->snapshot)
+		desc->snapshot = smalloc(sizeof(Snapshot));
+
+	desc->snapshot->loaded = true;
+	desc->snapshot->addr = addr;
+	desc->snapshot->size = (size_t) statbuf.st_size;
+
+	log_row("%d rows are loaded by snapshot \"%s\"", nrows, pathname);
+
+	return true;
+
+broken:
+
+	log_row("snapshot \"%s\" doesn't match to input file", pathname);
+
+	snapshot_unload_rows(desc);
+
+	free(desc->lb_offsets);
+	desc->lb_offsets = NULL;
+	desc->lb_offsets_size = 0;
+
+	munmap(addr, (size_t) statbuf.st_size);
+
+	return false;
+}
+
+static inline LineBuffer *
+get_lb(DataDesc *desc, int lineno)
+{
+	int		lbno = lineno / LINEBUFFER_LINES;
+
+	return lbno > 0 ? desc->lb_dir[lbno - 1] : &desc->rows;
+}
+
+/*
+ * Returns true, when keys and strxfrm blobs of sort item are inside the
+ * data rows and inside the item. The snapshot can be stale or broken, and
+ * the keys are used as indexes to line buffers and order map.
+ */
+static bool
+is_valid_snapshot_sort_item(DataDesc *desc, SnapshotSortItem *ssi)
+{
+	SnapshotSortKey *keys = (SnapshotSortKey *) (ssi + 1);
+	char	   *blob = (char *) (keys + ssi->nitems);
+	char	   *blobs_end = blob + ssi->blobs_size;
+	int			j;
+
+	for (j = 0; j < ssi->nitems; j++)
+	{
+		if (keys[j].lineno < desc->first_data_row ||
+			keys[j].lineno > desc->last_data_row)
+			return false;
+
+		if (keys[j].info == INFO_STRXFRM)
+		{
+			char	   *endblob = memchr(blob, '\0', blobs_end - blob);
+
+			if (!endblob)
+				return false;
+
+			blob = endblob + 1;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Restores results of multilines detection and sort keys from loaded
+ * snapshot, when the layout of data is same. It is used only once,
+ * and then the snapshot is unmapped.
+ */
+void
+snapshot_restore_caches(DataDesc *desc)
+{
+	Snapshot   *snap = desc->snapshot;
+	SnapshotHeader *hdr;
+	char	   *ptr;
+	const char *collate;
+	int			i;
+
+	if (!snap || !snap->addr)
+		return;
+
+	hdr = (SnapshotHeader *) snap->addr;
+
+	if (hdr->first_data_row != desc->first_data_row ||
+		hdr->last_data_row != desc->last_data_row ||
+		hdr->border_type != desc->border_type ||
+		hdr->headline_char_size != desc->headline_char_size ||
+		hdr->meta.total_rows != desc->total_rows)
+		goto done;
+
+	if (hdr->multilines_buffers > 0 && desc->multilines_tested_rows == 0)
+	{
+		SnapshotLineBuffer *slb = (SnapshotLineBuffer *) (snap->addr + hdr->multilines_pos);
+
+		for (i = 0; i < hdr->multilines_buffers; i++)
+		{
+			LineBuffer *lb = i > 0 ? desc->lb_dir[i - 1] : &desc->rows;
+
+			lb->first_recno = slb[i].first_recno;
+
+			if (slb[i].has_continuation_bits)
+			{
+				lb->continuation_bits = arena_alloc(lb->arena, (LINEBUFFER_LINES + 7) / 8);
+				memcpy(lb->continuation_bits, slb[i].continuation_bits, (LINEBUFFER_LINES + 7) / 8);
+			}
+		}
+
+		desc->multilines_tested_rows = hdr->multilines_tested_rows;
+		desc->multilines_recno = hdr->multilines_recno;
+		desc->has_multilines = hdr->has_multilines;
+
+		snap->multilines_loaded = true;
+	}
+
+	collate = setlocale(LC_COLLATE, NULL);
+	ptr = snap->addr + hdr->sort_pos;
+
+	for (i = 0; i < hdr->sort_items; i++)
+	{
+		SnapshotSortItem *ssi = (SnapshotSortItem *) ptr;
+		SnapshotSortKey *keys;
+		SortCacheItem *item;
+		char	   *blob;
+		size_t		avail;
+		size_t		item_size;
+		int			j;
+
+		if ((size_t) (ptr - snap->addr) + sizeof(SnapshotSortItem) > snap->size)
+			break;
+
+		avail = snap->size - (size_t) (ptr - snap->addr) - sizeof(SnapshotSortItem);
+
+		/* the broken item can't be skipped, so following items are ignored too */
+		if (desc->first_data_row < 0 || ssi->nitems <= 0 ||
+			ssi->nitems > desc->last_data_row - desc->first_data_row + 1 ||
+			(size_t) ssi->nitems * sizeof(SnapshotSortKey) > avail ||
+			ssi->blobs_size > avail - (size_t) ssi->nitems * sizeof(SnapshotSortKey))
+			break;
+
+		item_size = sizeof(SnapshotSortItem) +
+					SNAPSHOT_ALIGN((size_t) ssi->nitems * sizeof(SnapshotSortKey) + ssi->blobs_size);
+
+		if ((size_t) (ptr - snap->addr) + item_size > snap->size ||
+			ssi->sbcn < 1 || ssi->sbcn > desc->columns ||
+			!is_valid_snapshot_sort_item(desc, ssi))
+			break;
+
+		ptr += item_size;
+
+		/* strxfrm blobs depends on collation */
+		if (ssi->is_text && (!collate || strcmp(collate, hdr->collate) != 0))
+			continue;
+
+		if (ssi->xmin != desc->cranges[ssi->sbcn - 1].xmin ||
+			ssi->xmax != desc->cranges[ssi->sbcn - 1].xmax)
+			continue;
+
+		if (ssi->sbcn > desc->sort_cache_items)
+		{
+			desc->sort_cache = srealloc(desc->sort_cache, ssi->sbcn * sizeof(SortCacheItem));
+			memset(desc->sort_cache + desc->sort_cache_items, 0,
+				   (ssi->sbcn - desc->sort_cache_items) * sizeof(SortCacheItem));
+			desc->sort_cache_items = ssi->sbcn;
+		}
+
+		item = &desc->sort_cache[ssi->sbcn - 1];
+		if (item->keys)
+			continue;
+
+		keys = (SnapshotSortKey *) (ssi + 1);
+		blob = (char *) (keys + ssi->nitems);
+
+		item->keys = smalloc(ssi->nitems * sizeof(SortData));
+
+		for (j = 0; j < ssi->nitems; j++)
+		{
+			SortData   *sd = &item->keys[j];
+
+			sd->info = keys[j].info;
+			sd->d = keys[j].d;
+			sd->lnb = get_lb(desc, keys[j].lineno);
+			sd->lnb_row = keys[j].lineno % LINEBUFFER_LINES;
+
+			if (sd->info == INFO_STRXFRM)
+			{
+				sd->strxfrm = sstrdup(blob);
+				blob += strlen(blob) + 1;
+			}
+		}
+
+		item->nitems = ssi->nitems;
+		item->is_text = ssi->is_text;
+		item->total_rows = desc->total_rows;
+		item->first_data_row = desc->first_data_row;
+		item->last_data_row = desc->last_data_row;
+		item->xmin = ssi->xmin;
+		item->xmax = ssi->xmax;
+
+		snap->sort_items_loaded += 1;
+	}
+
+	log_row("snapshot caches restored (multilines: %s, sorted columns: %d)",
+			snap->multilines_loaded ? "yes" : "no", snap->sort_items_loaded);
+
+done:
+
+	munmap(snap->addr, snap->size);
+	snap->addr = NULL;
+}
+
+/*
+ * Returns true, when sort keys of column are valid for current data
+ */
+static bool
+is_valid_sort_item(DataDesc *desc, SortCacheItem *item, int sbcn)
+{
+	return item->keys &&
+		   item->total_rows == desc->total_rows &&
+		   item->first_data_row == desc->first_data_row &&
+		   item->last_data_row == desc->last_data_row &&
+		   item->xmin == desc->cranges[sbcn - 1].xmin &&
+		   item->xmax == desc->cranges[sbcn - 1].xmax;
+}
+
+static bool
+write_padding(FILE *fp, size_t size)
+{
+	static const char zeros[8] = {0};
+
+	return size == SNAPSHOT_ALIGN(size) ||
+		   fwrite(zeros, 1, SNAPSHOT_ALIGN(size) - size, fp) == SNAPSHOT_ALIGN(size) - size;
+}
+
+/*
+ * Writes snapshot of data loaded from mapped file. The snapshot is
+ * written to temporary file, that is renamed, so the reader never
+ * see partially written snapshot.
+ */
+void
+snapshot_save(Options *opts, DataDesc *desc)
+{
+	Snapshot   *snap = desc->snapshot;
+	SnapshotHeader hdr;
+	char		fullpath[PATH_MAX];
+	char		pathname[PATH_MAX];
+	char		tmppathname[PATH_MAX + 32];
+	struct stat statbuf;
+	const char *collate;
+	bool		multilines;
+	size_t		pos;
+	int			nbuffers = desc->lb_dir_items + 1;
+	int			sort_items = 0;
+	int			fd;
+	FILE	   *fp;
+	bool		ok = true;
+	int			i;
+
+	if (!opts->snapshot || !snap || !snap->captured || !desc->completed ||
+		desc->rows_modified || !desc->mmap_addr || !desc->lb_offsets ||
+		desc->lb_offsets_size < nbuffers || desc->recycled_rows > 0 ||
+		snap->meta.total_rows != desc->total_rows ||
+		desc->total_rows < SNAPSHOT_MIN_ROWS || !opts->pathname)
+		return;
+
+	multilines = desc->first_data_row >= 0 &&
+				 desc->multilines_tested_rows > desc->last_data_row;
+
+	for (i = 0; i < desc->sort_cache_items; i++)
+		if (is_valid_sort_item(desc, &desc->sort_cache[i], i + 1))
+			sort_items += 1;
+
+	/* there is nothing new against loaded snapshot */
+	if (snap->loaded &&
+		(!multilines || snap->multilines_loaded) &&
+		sort_items <= snap->sort_items_loaded)
+		return;
+
+	if (!realpath(opts->pathname, fullpath) ||
+		!snapshot_pathname(fullpath, pathname, true))
+		return;
+
+	if (!f_data || fstat(fileno(f_data), &statbuf) != 0 ||
+		(size_t) statbuf.st_size != desc->mmap_size)
+		return;
+
+	memset(&hdr, 0, sizeof(SnapshotHeader));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, 8);
+	hdr.header_size = sizeof(SnapshotHeader);
+	hdr.use_utf8 = use_utf8;
+	hdr.file_size = statbuf.st_size;
+	hdr.mtime_sec = statbuf.st_mtim.tv_sec;
+	hdr.mtime_nsec = statbuf.st_mtim.tv_nsec;
+	hdr.ino = statbuf.st_ino;
+	hdr.dev = statbuf.st_dev;
+	memcpy(hdr.pathname, fullpath, strlen(fullpath) + 1);
+
+	collate = setlocale(LC_COLLATE, NULL);
+	if (collate)
+		strncpy(hdr.collate, collate, sizeof(hdr.collate) - 1);
+
+	memcpy(&hdr.meta, &snap->meta, sizeof(SnapshotDesc));
+	hdr.nbuffers = nbuffers;
+
+	hdr.first_data_row = desc->first_data_row;
+	hdr.last_data_row = desc->last_data_row;
+	hdr.border_type = desc->border_type;
+	hdr.headline_char_size = desc->headline_char_size;
+
+	if (multilines)
+	{
+		hdr.multilines_tested_rows = desc->multilines_tested_rows;
+		hdr.multilines_recno = desc->multilines_recno;
+		hdr.has_multilines = desc->has_multilines;
+		hdr.multilines_buffers = nbuffers;
+	}
+
+	hdr.sort_items = sort_items;
+
+	pos = SNAPSHOT_ALIGN(sizeof(SnapshotHeader));
+	hdr.offsets_pos = pos;
+	pos += SNAPSHOT_ALIGN(nbuffers * sizeof(uint64_t));
+	hdr.multilines_pos = pos;
+	if (multilines)
+		pos += nbuffers * sizeof(SnapshotLineBuffer);
+	pos = SNAPSHOT_ALIGN(pos);
+	hdr.sort_pos = pos;
+
+	for (i = 0; i < desc->sort_cache_items; i++)
+	{
+		SortCacheItem *item = &desc->sort_cache[i];
+		size_t		blobs_size = 0;
+		int			j;
+
+		if (!is_valid_sort_item(desc, item, i + 1))
+			continue;
+
+		for (j = 0; j < item->nitems; j++)
+			if (item->keys[j].info == INFO_STRXFRM)
+				blobs_size += strlen(item->keys[j].strxfrm) + 1;
+
+		pos += sizeof(SnapshotSortItem) +
+			   SNAPSHOT_ALIGN(item->nitems * sizeof(SnapshotSortKey) + blobs_size);
+	}
+
+	hdr.size = pos;
+
+	snprintf(tmppathname, sizeof(tmppathname), "%s.%d", pathname, (int) getpid());
+
+	fd = open(tmppathname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1 || !(fp = fdopen(fd, "w")))
+	{
+		log_row("cannot to create snapshot \"%s\" (%s)", tmppathname, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+
+	ok = fwrite(&hdr, sizeof(SnapshotHeader), 1, fp) == 1 &&
+		 write_padding(fp, sizeof(SnapshotHeader));
+
+	for (i = 0; ok && i < nbuffers; i++)
+	{
+		uint64_t	offset = desc->lb_offsets[i];
+
+		ok = fwrite(&offset, sizeof(uint64_t), 1, fp) == 1;
+	}
+
+	if (ok)
+		ok = write_padding(fp, nbuffers * sizeof(uint64_t));
+
+	if (multilines)
+	{
+		for (i = 0; ok && i < nbuffers; i++)
+		{
+			LineBuffer *lb = i > 0 ? desc->lb_dir[i - 1] : &desc->rows;
+			SnapshotLineBuffer slb;
+
+			memset(&slb, 0, sizeof(SnapshotLineBuffer));
+			slb.first_recno = lb->first_recno;
+
+			if (lb->continuation_bits)
+			{
+				slb.has_continuation_bits = true;
+				memcpy(slb.continuation_bits, lb->continuation_bits, (LINEBUFFER_LINES + 7) / 8);
+			}
+
+			ok = fwrite(&slb, sizeof(SnapshotLineBuffer), 1, fp) == 1;
+		}
+
+		if (ok)
+			ok = write_padding(fp, nbuffers * sizeof(SnapshotLineBuffer));
+	}
+
+	for (i = 0; ok && i < desc->sort_cache_items; i++)
+	{
+		SortCacheItem *item = &desc->sort_cache[i];
+		SnapshotSortItem ssi;
+		int			j;
+
+		if (!is_valid_sort_item(desc, item, i + 1))
+			continue;
+
+		memset(&ssi, 0, sizeof(SnapshotSortItem));
+		ssi.sbcn = i + 1;
+		ssi.nitems = item->nitems;
+		ssi.is_text = item->is_text;
+		ssi.xmin = item->xmin;
+		ssi.xmax = item->xmax;
+
+		for (j = 0; j < item->nitems; j++)
+			if (item->keys[j].info == INFO_STRXFRM)
+				ssi.blobs_size += strlen(item->keys[j].strxfrm) + 1;
+
+		ok = fwrite(&ssi, sizeof(SnapshotSortItem), 1, fp) == 1;
+
+		for (j = 0; ok && j < item->nitems; j++)
+		{
+			SortData   *sd = &item->keys[j];
+			SnapshotSortKey key;
+
+			key.lineno = sd->lnb->first_row + sd->lnb_row;
+			key.info = sd->info;
+			key.d = sd->d;
+
+			ok = fwrite(&key, sizeof(SnapshotSortKey), 1, fp) == 1;
+		}
+
+		for (j = 0; ok && j < item->nitems; j++)
+			if (item->keys[j].info == INFO_STRXFRM)
+				ok = fwrite(item->keys[j].strxfrm, strlen(item->keys[j].strxfrm) + 1, 1, fp) == 1;
+
+		if (ok)
+			ok = write_padding(fp, item->nitems * sizeof(SnapshotSortKey) + ssi.blobs_size);
+	}
+
+	if (fclose(fp) != 0)
+		ok = false;
+
+	if (ok && rename(tmppathname, pathname) == 0)
+		log_row("snapshot \"%s\" is saved", pathname);
+	else
+	{
+		log_row("cannot to write snapshot \"%s\" (%s)", tmppathname, strerror(errno));
+		(void) unlink(tmppathname);
+	}
+}
+
+void
+snapshot_free(DataDesc *desc)
+{
+	if (!desc->snapshot)
+		return;
+
+	if (desc->snapshot->addr)
+		munmap(desc->snapshot->addr, desc->snapshot->size);
+
+	free(desc->snapshot);
+	desc->snapshot = NULL;
+}
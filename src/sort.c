@@ -11,6 +11,7 @@
  *-------------------------------------------------------------------------
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -76,12 +77,6 @@ compar_num_desc(const void *a, const void *b)
 	}
 }
 
-void
-sort_column_num(SortData *sortbuf, int rows, bool desc)
-{
-
-	qsort(sortbuf, rows, sizeof(SortData), desc ? compar_num_desc : compar_num_asc);
-}
 
 static int
 compar_text_asc(const void *a, const void *b)
@@ -127,8 +122,483 @@ compar_text_desc(const void *a, const void *b)
 	}
 }
 
+/*
+ * Radix sort. The sort keys are transformed to unsigned 64bit integers
+ * with same order, and these integers are sorted by LSD radix sort.
+ * Doubles are transformed by flipping bits, strings are represented by
+ * first 8 bytes of strxfrm blob, and the groups with same prefix are
+ * sorted by comparing of rest of blobs. Items without key are moved
+ * to the end. The result is same like result of stable sort.
+ */
+#define RADIX_SORT_MIN_ROWS			256
+#define RADIX_PREFIX_SIZE			8
+
+typedef struct
+{
+	uint64_t	key;
+	int			idx;				/* position in original buffer */
+	const char *str;				/* strxfrm blob or NULL */
+} RadixItem;
+
+static inline uint64_t
+double_key(double d)
+{
+	uint64_t	u;
+
+	/* -0.0 and 0.0 are equal */
+	if (d == 0.0)
+		d = 0.0;
+
+	memcpy(&u, &d, sizeof(u));
+
+	return (u & UINT64_C(0x8000000000000000)) ? ~u : u | UINT64_C(0x8000000000000000);
+}
+
+static inline uint64_t
+prefix_key(const char *str)
+{
+	const unsigned char *ptr = (const unsigned char *) str;
+	uint64_t	key = 0;
+	int			i;
+
+	for (i = 0; i < RADIX_PREFIX_SIZE && ptr[i]; i++)
+		key |= (uint64_t) ptr[i] << (8 * (RADIX_PREFIX_SIZE - 1 - i));
+
+	return key;
+}
+
+/*
+ * Stable sort of radix items by key. Returns pointer to sorted items,
+ * that can be items or aux.
+ */
+static RadixItem *
+radix_sort(RadixItem *items, RadixItem *aux, int n)
+{
+	size_t		counts[8][256];
+	int			i, b;
+
+	memset(counts, 0, sizeof(counts));
+
+	for (i = 0; i < n; i++)
+	{
+		uint64_t	key = items[i].key;
+
+		for (b = 0; b < 8; b++)
+			counts[b][(key >> (8 * b)) & 0xff] += 1;
+	}
+
+	for (b = 0; b < 8; b++)
+	{
+		size_t		offsets[256];
+		size_t		offset = 0;
+		RadixItem  *swap;
+		int			d;
+
+		/* skip pass, when all items has same digit */
+		if (counts[b][(items[0].key >> (8 * b)) & 0xff] == (size_t) n)
+			continue;
+
+		for (d = 0; d < 256; d++)
+		{
+			offsets[d] = offset;
+			offset += counts[b][d];
+		}
+
+		for (i = 0; i < n; i++)
+			aux[offsets[(items[i].key >> (8 * b)) & 0xff]++] = items[i];
+
+		swap = items;
+		items = aux;
+		aux = swap;
+	}
+
+	return items;
+}
+
+static int
+compar_radix_text_asc(const void *a, const void *b)
+{
+	RadixItem  *ria = (RadixItem *) a;
+	RadixItem  *rib = (RadixItem *) b;
+	int			result;
+
+	result = strcmp(ria->str + RADIX_PREFIX_SIZE, rib->str + RADIX_PREFIX_SIZE);
+
+	return result ? result : ria->idx - rib->idx;
+}
+
+static int
+compar_radix_text_desc(const void *a, const void *b)
+{
+	RadixItem  *ria = (RadixItem *) a;
+	RadixItem  *rib = (RadixItem *) b;
+	int			result;
+
+	result = strcmp(rib->str + RADIX_PREFIX_SIZE, ria->str + RADIX_PREFIX_SIZE);
+
+	return result ? result : ria->idx - rib->idx;
+}
+
+static void
+sort_column_radix(SortData *sortbuf, int rows, bool desc, bool text)
+{
+	SortDataInfo info = text ? INFO_STRXFRM : INFO_DOUBLE;
+	RadixItem  *items;
+	RadixItem  *sorted;
+	SortData   *result;
+	int			nkeys = 0;
+	int			pos;
+	int			i;
+
+	items = smalloc(2 * rows * sizeof(RadixItem));
+
+	for (i = 0; i < rows; i++)
+	{
+		if (sortbuf[i].info == info)
+		{
+			uint64_t	key;
+
+			key = text ? prefix_key(sortbuf[i].strxfrm) : double_key(sortbuf[i].d);
+
+			items[nkeys].key = desc ? ~key : key;
+			items[nkeys].idx = i;
+			items[nkeys].str = sortbuf[i].strxfrm;
+			nkeys += 1;
+		}
+	}
+
+	sorted = nkeys > 0 ? radix_sort(items, items + rows, nkeys) : items;
+
+	/*
+	 * Strings with same prefix should be compared. When prefix is
+	 * shorter than RADIX_PREFIX_SIZE, then strings are equal.
+	 */
+	if (text)
+	{
+		int			start = 0;
+
+		while (start < nkeys)
+		{
+			int			end = start + 1;
+
+			while (end < nkeys && sorted[end].key == sorted[start].key)
+				end += 1;
+
+			if (end - start > 1 &&
+				((desc ? ~sorted[start].key : sorted[start].key) & 0xff))
+				qsort(sorted + start, end - start, sizeof(RadixItem),
+					  desc ? compar_radix_text_desc : compar_radix_text_asc);
+
+			start = end;
+		}
+	}
+
+	result = smalloc(rows * sizeof(SortData));
+
+	for (i = 0; i < nkeys; i++)
+		result[i] = sortbuf[sorted[i].idx];
+
+	pos = nkeys;
+
+	for (i = 0; i < rows; i++)
+	{
+		if (sortbuf[i].info != info)
+			result[pos++] = sortbuf[i];
+	}
+
+	memcpy(sortbuf, result, rows * sizeof(SortData));
+
+	free(result);
+	free(items);
+}
+
+void
+sort_column_num(SortData *sortbuf, int rows, bool desc)
+{
+	if (rows < RADIX_SORT_MIN_ROWS)
+		qsort(sortbuf, rows, sizeof(SortData), desc ? compar_num_desc : compar_num_asc);
+	else
+		sort_column_radix(sortbuf, rows, desc, false);
+}
+
 void
 sort_column_text(SortData *sortbuf, int rows, bool desc)
 {
-	qsort(sortbuf, rows, sizeof(SortData), desc ? compar_text_desc : compar_text_asc);
+	if (rows < RADIX_SORT_MIN_ROWS)
+		qsort(sortbuf, rows, sizeof(SortData), desc ? compar_text_desc : compar_text_asc);
+	else
+		sort_column_radix(sortbuf, rows, desc, true);
+}
+
+/*
+ * Parallel sort. The buffer is divided to runs, that are sorted by
+ * workers, and then the sorted runs are merged. The merge is stable,
+ * so equal items holds order from sorted runs.
+ */
+typedef int (*SortCmpFunc) (const void *, const void *);
+
+typedef struct
+{
+	SortCmpFunc	cmp;
+	bool		desc;
+	bool		text;
+	SortData   *src;			/* source of merge */
+	SortData   *dest;			/* target of merge, or NULL for sort of run */
+	int			a_start;		/* first items of merged runs */
+	int			a_end;
+	int			b_start;
+	int			b_end;
+	int			k_start;		/* part of merged output */
+	int			k_end;
+} SortTask;
+
+/*
+ * Returns number of items of run a, that are in first k items of
+ * stable merge of runs a and b.
+ */
+static int
+merge_corank(int k, SortData *a, int m, SortData *b, int n, SortCmpFunc cmp)
+{
+	int		lo = k > n ? k - n : 0;
+	int		hi = k < m ? k : m;
+
+	while (lo < hi)
+	{
+		int		i = (lo + hi) / 2;
+		int		j = k - i;
+
+		/* equal items of run a are before items of run b */
+		if (j > 0 && cmp(&b[j - 1], &a[i]) >= 0)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+
+	return lo;
+}
+
+static void *
+sort_task(void *arg)
+{
+	SortTask   *task = (SortTask *) arg;
+	SortData   *a, *b;
+	int			m, n;
+	int			i, j, ie, je;
+	SortData   *dest;
+
+	if (!task->dest)
+	{
+		if (task->text)
+			sort_column_text(task->src + task->a_start,
+							 task->a_end - task->a_start,
+							 task->desc);
+		else
+			sort_column_num(task->src + task->a_start,
+							task->a_end - task->a_start,
+							task->desc);
+		return NULL;
+	}
+
+	a = task->src + task->a_start;
+	m = task->a_end - task->a_start;
+	b = task->src + task->b_start;
+	n = task->b_end - task->b_start;
+
+	i = merge_corank(task->k_start, a, m, b, n, task->cmp);
+	j = task->k_start - i;
+	ie = merge_corank(task->k_end, a, m, b, n, task->cmp);
+	je = task->k_end - ie;
+
+	dest = task->dest + task->a_start + task->k_start;
+
+	while (i < ie && j < je)
+	{
+		if (task->cmp(&a[i], &b[j]) <= 0)
+			*dest++ = a[i++];
+		else
+			*dest++ = b[j++];
+	}
+
+	while (i < ie)
+		*dest++ = a[i++];
+
+	while (j < je)
+		*dest++ = b[j++];
+
+	return NULL;
+}
+
+void
+sort_column_parallel(SortData *sortbuf, int rows, bool desc, bool text, int nworkers)
+{
+	SortCmpFunc	cmp;
+	SortTask   *tasks;
+	SortData   *src = sortbuf;
+	SortData   *dest;
+	int		   *bounds;
+	int			nruns = nworkers;
+	int			i;
+
+	if (text)
+		cmp = desc ? compar_text_desc : compar_text_asc;
+	else
+		cmp = desc ? compar_num_desc : compar_num_asc;
+
+	if (nworkers < 2 || rows < 2 * nworkers)
+	{
+		if (text)
+			sort_column_text(sortbuf, rows, desc);
+		else
+			sort_column_num(sortbuf, rows, desc);
+		return;
+	}
+
+	tasks = smalloc(nworkers * sizeof(SortTask));
+	bounds = smalloc((nruns + 1) * sizeof(int));
+	dest = smalloc(rows * sizeof(SortData));
+
+	for (i = 0; i <= nruns; i++)
+		bounds[i] = (int) ((long) rows * i / nruns);
+
+	for (i = 0; i < nruns; i++)
+	{
+		tasks[i].cmp = cmp;
+		tasks[i].desc = desc;
+		tasks[i].text = text;
+		tasks[i].src = sortbuf;
+		tasks[i].dest = NULL;
+		tasks[i].a_start = bounds[i];
+		tasks[i].a_end = bounds[i + 1];
+	}
+
+	run_parallel_tasks(sort_task, tasks, sizeof(SortTask), nruns);
+
+	/*
+	 * Merge pairs of runs, until only one run is there. Every merge is
+	 * divided between more workers, when there are less pairs than
+	 * workers.
+	 */
+	while (nruns > 1)
+	{
+		int		npairs = nruns / 2;
+		int		parts = nworkers / npairs > 1 ? nworkers / npairs : 1;
+		int		ntasks = 0;
+		SortData *swap;
+
+		for (i = 0; i < npairs; i++)
+		{
+			int		a_start = bounds[2 * i];
+			int		b_start = bounds[2 * i + 1];
+			int		b_end = bounds[2 * i + 2];
+			int		total = b_end - a_start;
+			int		p;
+
+			for (p = 0; p < parts; p++)
+			{
+				/* npairs * parts <= nworkers */
+				SortTask   *task = &tasks[ntasks++];
+
+				task->cmp = cmp;
+				task->src = src;
+				task->dest = dest;
+				task->a_start = a_start;
+				task->a_end = b_start;
+				task->b_start = b_start;
+				task->b_end = b_end;
+				task->k_start = (int) ((long) total * p / parts);
+				task->k_end = (int) ((long) total * (p + 1) / parts);
+			}
+		}
+
+		/* odd run is copied */
+		if (nruns % 2 == 1)
+			memcpy(dest + bounds[nruns - 1],
+				   src + bounds[nruns - 1],
+				   (rows - bounds[nruns - 1]) * sizeof(SortData));
+
+		run_parallel_tasks(sort_task, tasks, sizeof(SortTask), ntasks);
+
+		/* merged runs */
+		for (i = 0; i < npairs; i++)
+			bounds[i + 1] = bounds[2 * i + 2];
+
+		if (nruns % 2 == 1)
+			bounds[npairs + 1] = rows;
+
+		nruns = npairs + nruns % 2;
+
+		swap = src;
+		src = dest;
+		dest = swap;
+	}
+
+	if (src != sortbuf)
+	{
+		memcpy(sortbuf, src, rows * sizeof(SortData));
+		free(src);
+	}
+	else
+		free(dest);
+
+	free(tasks);
+	free(bounds);
+}
+
+/*
+ * Creates descending order from keys sorted in ascending order. The
+ * result is same like result of stable sort in descending order: the
+ * groups of equal values are reversed, but the order inside groups is
+ * not changed. Values without key are at the end in both orders.
+ */
+void
+sort_column_reverse(SortData *sortbuf, SortData *dest, int rows, bool text)
+{
+	SortCmpFunc	cmp = text ? compar_text_asc : compar_num_asc;
+	SortDataInfo info = text ? INFO_STRXFRM : INFO_DOUBLE;
+	int			nkeys = 0;
+	int			end;
+
+	while (nkeys < rows && sortbuf[nkeys].info == info)
+		nkeys += 1;
+
+	end = nkeys;
+	while (end > 0)
+	{
+		int		start = end - 1;
+
+		while (start > 0 && cmp(&sortbuf[start - 1], &sortbuf[end - 1]) == 0)
+			start -= 1;
+
+		memcpy(dest, sortbuf + start, (end - start) * sizeof(SortData));
+		dest += end - start;
+		end = start;
+	}
+
+	memcpy(dest, sortbuf + nkeys, (rows - nkeys) * sizeof(SortData));
+}
+
+/*
+ * Releases cached sort keys of all columns
+ */
+void
+sort_cache_free(DataDesc *desc)
+{
+	int			i, j;
+
+	for (i = 0; i < desc->sort_cache_items; i++)
+	{
+		SortCacheItem *item = &desc->sort_cache[i];
+
+		if (!item->keys)
+			continue;
+
+		for (j = 0; j < item->nitems; j++)
+			free(item->keys[j].strxfrm);
+
+		free(item->keys);
+	}
+
+	free(desc->sort_cache);
+	desc->sort_cache = NULL;
+	desc->sort_cache_items = 0;
 }
@@ -0,0 +1,323 @@
+/*-------------------------------------------------------------------------
+ *
+ * stats.c
+ *	  timers and counters of main operations
+ *
+ * Portions Copyright (c) 2017-2021 Pavel Stehule
+ *
+ * IDENTIFICATION
+ *	  src/stats.c
+ *
+ *-------------------------------------------------------------------------
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pspg.h"
+
+/*
+ * Timers are updated only by main thread. Counters can be updated by
+ * loader thread or by workers too (allocations), so every thread has own
+ * slot of counters, and the values of slots are summed when they are
+ * reported. Only owner thread writes to slot, so the counters are not
+ * contended. Relaxed atomic access is enough, the values are read only
+ * for reporting. When thread ends, its counters are moved to retired
+ * counters.
+ */
+typedef struct
+{
+	long	count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+} StatsTimerData;
+
+typedef struct StatsSlot
+{
+	atomic_long counters[STATS_COUNTERS_COUNT];
+	struct StatsSlot *prev;
+	struct StatsSlot *next;
+} StatsSlot;
+
+static StatsTimerData timers[STATS_TIMERS_COUNT];
+
+static pthread_mutex_t slots_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+static StatsSlot *slots = NULL;
+static long retired_counters[STATS_COUNTERS_COUNT];
+
+static __thread StatsSlot *thread_slot = NULL;
+
+static char *stats_pathname = NULL;
+
+static const char *timer_names[STATS_TIMERS_COUNT] = {
+	"load",
+	"parse",
+	"sort",
+	"search",
+	"redraw",
+	"pg_wait"
+};
+
+static const char *counter_names[STATS_COUNTERS_COUNT] = {
+	"rows_read",
+	"bytes_read",
+	"allocations",
+	"allocated_bytes"
+};
+
+/*
+ * Returns monotonic time in ns
+ */
+uint64_t
+stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Adds time from start (returned by stats_clock) to now
+ */
+void
+stats_timer_stop(StatsTimer timer, uint64_t start)
+{
+	StatsTimerData *td = &timers[timer];
+	uint64_t	elapsed = stats_clock() - start;
+
+	td->count += 1;
+	td->total_ns += elapsed;
+
+	if (elapsed > td->max_ns)
+		td->max_ns = elapsed;
+}
+
+/*
+ * Moves counters of ending thread to retired counters
+ */
+static void
+release_slot(void *ptr)
+{
+	StatsSlot  *slot = (StatsSlot *) ptr;
+	int			i;
+
+	pthread_mutex_lock(&slots_mutex);
+
+	for (i = 0; i < STATS_COUNTERS_COUNT; i++)
+		retired_counters[i] += atomic_load_explicit(&slot->counters[i], memory_order_relaxed);
+
+	if (slot->prev)
+		slot->prev->next = slot->next;
+	else
+		slots = slot->next;
+
+	if (slot->next)
+		slot->next->prev = slot->prev;
+
+	pthread_mutex_unlock(&slots_mutex);
+
+	free(slot);
+}
+
+static void
+create_slot_key(void)
+{
+	pthread_key_create(&slot_key, release_slot);
+}
+
+/*
+ * Returns slot of counters of current thread. The slot is allocated by
+ * malloc, because smalloc updates counters.
+ */
+static StatsSlot *
+get_slot(void)
+{
+	StatsSlot  *slot = thread_slot;
+
+	if (slot)
+		return slot;
+
+	slot = calloc(1, sizeof(StatsSlot));
+	if (!slot)
+		leave("out of memory");
+
+	pthread_once(&slot_key_once, create_slot_key);
+	pthread_setspecific(slot_key, slot);
+
+	pthread_mutex_lock(&slots_mutex);
+
+	slot->next = slots;
+	if (slots)
+		slots->prev = slot;
+	slots = slot;
+
+	pthread_mutex_unlock(&slots_mutex);
+
+	thread_slot = slot;
+
+	return slot;
+}
+
+static inline void
+slot_counter_add(StatsSlot *slot, StatsCounter counter, long value)
+{
+	atomic_store_explicit(&slot->counters[counter],
+						  atomic_load_explicit(&slot->counters[counter], memory_order_relaxed) + value,
+						  memory_order_relaxed);
+}
+
+void
+stats_counter_add(StatsCounter counter, long value)
+{
+	slot_counter_add(get_slot(), counter, value);
+}
+
+/*
+ * Counts one allocation of size bytes
+ */
+void
+stats_alloc_add(long size)
+{
+	StatsSlot  *slot = get_slot();
+
+	slot_counter_add(slot, STATS_ALLOCATIONS, 1);
+	slot_counter_add(slot, STATS_ALLOCATED_BYTES, size);
+}
+
+/*
+ * Returns sum of counter of all threads
+ */
+static long
+counter_value(StatsCounter counter)
+{
+	StatsSlot  *slot;
+	long		result;
+
+	pthread_mutex_lock(&slots_mutex);
+
+	result = retired_counters[counter];
+
+	for (slot = slots; slot; slot = slot->next)
+		result += atomic_load_explicit(&slot->counters[counter], memory_order_relaxed);
+
+	pthread_mutex_unlock(&slots_mutex);
+
+	return result;
+}
+
+static double
+ns_to_ms(uint64_t ns)
+{
+	return ns / 1000000.0;
+}
+
+/*
+ * Writes short description of stats to buffer. It is displayed
+ * by command \stats.
+ */
+void
+stats_summary(char *buffer, int size)
+{
+	StatsTimerData *redraw = &timers[STATS_REDRAW];
+	int		len;
+	int		i;
+
+	*buffer = '\0';
+	len = 0;
+
+	for (i = 0; i < STATS_TIMERS_COUNT && len < size; i++)
+	{
+		StatsTimerData *td = &timers[i];
+
+		if (i == STATS_REDRAW)
+			len += snprintf(buffer + len, size - len, "%s %.1f/%.1f ms (%ld), ",
+							timer_names[i],
+							ns_to_ms(redraw->count > 0 ? redraw->total_ns / redraw->count : 0),
+							ns_to_ms(redraw->max_ns),
+							redraw->count);
+		else
+			len += snprintf(buffer + len, size - len, "%s %.1f ms (%ld), ",
+							timer_names[i],
+							ns_to_ms(td->total_ns),
+							td->count);
+	}
+
+	if (len < size)
+		snprintf(buffer + len, size - len, "rows %ld, read %.1f MB, allocs %ld (%.1f MB)",
+				 counter_value(STATS_ROWS_READ),
+				 counter_value(STATS_BYTES_READ) / (1024.0 * 1024.0),
+				 counter_value(STATS_ALLOCATIONS),
+				 counter_value(STATS_ALLOCATED_BYTES) / (1024.0 * 1024.0));
+}
+
+/*
+ * Writes stats in json format
+ */
+bool
+stats_save_json(const char *pathname)
+{
+	FILE	   *fp;
+	int			i;
+
+	fp = fopen(pathname, "w");
+	if (!fp)
+	{
+		log_row("cannot to open stats file \"%s\"", pathname);
+		return false;
+	}
+
+	fprintf(fp, "{\n  \"timers\": {\n");
+
+	for (i = 0; i < STATS_TIMERS_COUNT; i++)
+	{
+		StatsTimerData *td = &timers[i];
+
+		fprintf(fp, "    \"%s\": {\"count\": %ld, \"total_ms\": %.3f, \"max_ms\": %.3f}%s\n",
+				timer_names[i],
+				td->count,
+				ns_to_ms(td->total_ns),
+				ns_to_ms(td->max_ns),
+				i < STATS_TIMERS_COUNT - 1 ? "," : "");
+	}
+
+	fprintf(fp, "  },\n  \"counters\": {\n");
+
+	for (i = 0; i < STATS_COUNTERS_COUNT; i++)
+	{
+		fprintf(fp, "    \"%s\": %ld%s\n",
+				counter_names[i],
+				counter_value(i),
+				i < STATS_COUNTERS_COUNT - 1 ? "," : "");
+	}
+
+	fprintf(fp, "  }\n}\n");
+
+	return fclose(fp) == 0;
+}
+
+static void
+stats_exit_handler(void)
+{
+	(void) stats_save_json(stats_pathname);
+}
+
+/*
+ * Stats will be saved to file before exit. The tilde is replaced now,
+ * because result of tilde is stored in static buffer.
+ */
+void
+stats_save_at_exit(const char *pathname)
+{
+	if (!stats_pathname)
+		atexit(stats_exit_handler);
+
+	free(stats_pathname);
+	stats_pathname = sstrdup(tilde(NULL, pathname));
+}
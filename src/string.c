@@ -14,6 +14,7 @@
 #include <ctype.h>
 
 #include "pspg.h"
+#include "unicode.h"
 
 /*
  * Case insensitive string comparation.
@@ -35,42 +36,54 @@ nstreq(const char *str1, const char *str2)
 
 /*
  * special case insensitive searching routines
+ *
+ * The possible start of pattern is searched by find_search_candidate,
+ * when the first char of pattern is ASCII char. Other chars are compared
+ * only on these positions.
  */
+static inline bool
+starts_with_upper(const char *str, const char *pattern, bool *at_end)
+{
+	while (*pattern)
+	{
+		if (!*str)
+		{
+			*at_end = true;
+			return false;
+		}
+
+		if (toupper((unsigned char) *str++) != toupper((unsigned char) *pattern++))
+			return false;
+	}
+
+	return true;
+}
+
 const char *
 nstrstr(const char *haystack, const char *needle)
 {
-	const char *haystack_cur, *needle_cur, *needle_prev;
-	int		f1 = 0, f2 = 0;
+	unsigned char c = (unsigned char) *needle;
+	bool		at_end = false;
 
-	needle_cur = needle;
-	needle_prev = NULL;
-	haystack_cur = haystack;
+	if (!c)
+		return haystack;
 
-	while (*needle_cur != '\0')
+	for (;;)
 	{
-		if (*haystack_cur == '\0')
+		if (c < 0x80)
+			haystack = find_search_candidate(haystack, c, isupper(c) ? tolower(c) : toupper(c));
+
+		if (!*haystack)
 			return NULL;
 
-		if (needle_prev != needle_cur)
-		{
-			needle_prev = needle_cur;
-			f1 = toupper(*needle_cur);
-		}
+		if (starts_with_upper(haystack, needle, &at_end))
+			return haystack;
 
-		f2 = toupper(*haystack_cur);
-		if (f1 == f2)
-		{
-			needle_cur += 1;
-			haystack_cur += 1;
-		}
-		else
-		{
-			needle_cur = needle;
-			haystack_cur = haystack += 1;
-		}
-	}
+		if (at_end)
+			return NULL;
 
-	return haystack;
+		haystack += 1;
+	}
 }
 
 const char *
@@ -144,53 +157,60 @@ nstarts_with_with_sizes(const char *str,
  * Special string searching, lower chars are case insensitive,
  * upper chars are case sensitive.
  */
-const char *
-nstrstr_ignore_lower_case(const char *haystack, const char *needle)
+static inline bool
+starts_with_ignore_lower_case(const char *str, const char *pattern, bool *at_end)
 {
-	const char *haystack_cur, *needle_cur, *needle_prev;
-	int		f1 = 0;
-	bool	eq;
-
-	needle_cur = needle;
-	needle_prev = NULL;
-	haystack_cur = haystack;
-
-	while (*needle_cur != '\0')
+	while (*pattern)
 	{
-		bool	needle_char_is_upper = false; /* be compiler quiet */
+		unsigned char pc = (unsigned char) *pattern++;
+		unsigned char sc = (unsigned char) *str++;
 
-		if (*haystack_cur == '\0')
-			return NULL;
-
-		if (needle_prev != needle_cur)
+		if (!sc)
 		{
-			needle_prev = needle_cur;
-			needle_char_is_upper = isupper(*needle_cur);
-			f1 = toupper(*needle_cur);
+			*at_end = true;
+			return false;
 		}
 
-		if (needle_char_is_upper)
+		if (isupper(pc))
 		{
 			/* case sensitive */
-			eq = *haystack_cur == *needle_cur;
+			if (sc != pc)
+				return false;
 		}
 		else
 		{
 			/* case insensitive */
-			eq = f1 == toupper(*haystack_cur);
-		}
-
-		if (eq)
-		{
-			needle_cur += 1;
-			haystack_cur += 1;
-		}
-		else
-		{
-			needle_cur = needle;
-			haystack_cur = haystack += 1;
+			if (toupper(sc) != toupper(pc))
+				return false;
 		}
 	}
 
-	return haystack;
+	return true;
+}
+
+const char *
+nstrstr_ignore_lower_case(const char *haystack, const char *needle)
+{
+	unsigned char c = (unsigned char) *needle;
+	bool		at_end = false;
+
+	if (!c)
+		return haystack;
+
+	for (;;)
+	{
+		if (c < 0x80)
+			haystack = find_search_candidate(haystack, c, isupper(c) ? c : toupper(c));
+
+		if (!*haystack)
+			return NULL;
+
+		if (starts_with_ignore_lower_case(haystack, needle, &at_end))
+			return haystack;
+
+		if (at_end)
+			return NULL;
+
+		haystack += 1;
+	}
 }
@@ -17,6 +17,8 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -524,6 +526,162 @@ endline_exit:
 	return -1;
 }
 
+/*
+ * Regular files can be mapped to memory, and then the rows are not copied
+ * to separately allocated strings, but they are just slices of mapped file.
+ * The file is mapped privately and writeable, because the new line chars are
+ * replaced by zero in place, and some rows can be modified (by removing ANSI
+ * escape sequences). Only modified pages are copied by kernel.
+ *
+ * The truncation of mapped file raises SIGBUS on access to lost pages, so
+ * watched files (and streams) are read by classic getline way. The modified
+ * pages cannot be released by kernel, so the file is not mapped, when
+ * the rows can be evicted to spill file.
+ */
+static bool
+mmap_data_file(Options *opts, DataDesc *desc, StateData *state)
+{
+	struct stat statbuf;
+	void	   *addr;
+	long		pos;
+
+	if (!opts->mmap_load ||
+		desc->spill ||
+		!(f_data_opts & STREAM_IS_FILE) ||
+		(f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE) ||
+		state->stream_mode ||
+		opts->querystream ||
+		opts->watch_time > 0 ||
+		opts->watch_file)
+		return false;
+
+	if (fstat(fileno(f_data), &statbuf) != 0)
+	{
+		log_row("cannot to stat file (%s)", strerror(errno));
+		return false;
+	}
+
+	if (statbuf.st_size <= 0 || (uintmax_t) statbuf.st_size > SIZE_MAX)
+		return false;
+
+	pos = ftell(f_data);
+	if (pos < 0 || pos >= statbuf.st_size)
+		return false;
+
+	addr = mmap(NULL, (size_t) statbuf.st_size,
+				PROT_READ | PROT_WRITE, MAP_PRIVATE,
+				fileno(f_data), 0);
+
+	if (addr == MAP_FAILED)
+	{
+		log_row("cannot to map file to memory (%s)", strerror(errno));
+		return false;
+	}
+
+	desc->mmap_addr = addr;
+	desc->mmap_size = (size_t) statbuf.st_size;
+	desc->mmap_pos = (size_t) pos;
+
+	log_row("input file is mapped to memory (%zu bytes)", desc->mmap_size);
+
+	return true;
+}
+
+/*
+ * getline like API over mapped file. The returned line is not copy,
+ * so caller should not to free it. Only last line without new line
+ * char is copied to arena (there is not a space for terminating zero).
+ */
+static ssize_t
+_mmap_getline(DataDesc *desc, char **lineptr, size_t *n)
+{
+	char	   *start;
+	char	   *endline;
+	size_t		remaining;
+	ssize_t		result;
+
+	if (desc->mmap_pos >= desc->mmap_size)
+	{
+		*lineptr = NULL;
+		errno = 0;
+
+		return -1;
+	}
+
+	start = desc->mmap_addr + desc->mmap_pos;
+	remaining = desc->mmap_size - desc->mmap_pos;
+
+	endline = memchr(start, '\n', remaining);
+	if (endline)
+	{
+		result = endline - start + 1;
+		*lineptr = start;
+	}
+	else
+	{
+		result = remaining;
+		*lineptr = arena_strndup(desc->arena, start, remaining);
+	}
+
+	desc->mmap_pos += result;
+	*n = result + 1;
+
+	return result;
+}
+
+/*
+ * Read next line from input. Lines read by getline are stored in buffer,
+ * that is reused for next line (should be copied). Lines from mapped
+ * file are returned directly.
+ */
+static inline ssize_t
+read_line(DataDesc *desc,
+		  char **lineptr,
+		  char **buffer,
+		  size_t *n,
+		  bool wait_on_data)
+{
+	ssize_t		result;
+
+	if (desc->mmap_addr)
+		return _mmap_getline(desc, lineptr, n);
+
+	/*
+	 * Lines from loader are in loader's arena. We wait on data only
+	 * in initial run (when total_rows is not set yet).
+	 */
+	if (desc->loader)
+		return loader_getline(desc->loader, lineptr, n, desc->total_rows == 0);
+
+	/* nonblocking reading doesn't reuse buffer */
+	if (f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE)
+	{
+		free(*buffer);
+		*buffer = NULL;
+	}
+
+	result = _getline(buffer, n, f_data, f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE, wait_on_data);
+	*lineptr = *buffer;
+
+	return result;
+}
+
+/*
+ * Saves offset of first row of new line buffer in mapped file
+ */
+static void
+save_lb_offset(DataDesc *desc, int lbno, size_t offset)
+{
+	if (lbno >= desc->lb_offsets_size)
+	{
+		desc->lb_offsets_size = desc->lb_offsets_size > 0 ? 2 * desc->lb_offsets_size : 64;
+		desc->lb_offsets = srealloc(desc->lb_offsets,
+									desc->lb_offsets_size * sizeof(size_t));
+	}
+
+	desc->lb_offsets[lbno] = offset;
+}
+
 /*
  * Copy trimmed string
  */
@@ -653,6 +811,253 @@ finish_deescape:
 	return writeptr - line;
 }
 
+/*
+ * Detects borders, header, footer and sizes of data from one row of
+ * table. The row should be stored already.
+ */
+static void
+process_table_row(DataDesc *desc, char *line, ssize_t read, size_t len, int clen, int nrows)
+{
+	/* save possible table name */
+	if (nrows == 0 && !isTopLeftChar(line))
+	{
+		strncpytrim(desc->title, line, 63, read);
+		desc->title_rows = 1;
+	}
+
+	if (desc->border_head_row == -1 && desc->border_top_row == -1 && isTopLeftChar(line))
+	{
+		desc->border_top_row = nrows;
+		desc->is_expanded_mode = is_expanded_header(line, NULL, NULL);
+		if (desc->is_expanded_mode)
+			desc->border_head_row = nrows;
+	}
+	else if (desc->border_head_row == -1 && isHeadLeftChar(line))
+	{
+		desc->border_head_row = nrows;
+
+		if (isUnicodeHeadLeftCharBorder2(line))
+		{
+			desc->load_data_rows = true;
+			log_row("next row will be data row");
+		}
+
+		if (!desc->is_expanded_mode)
+			desc->is_expanded_mode = is_expanded_header(line, NULL, NULL);
+
+		/* title surely doesn't it there */
+		if ((!desc->is_expanded_mode && nrows == 1) ||
+		    (desc->is_expanded_mode && nrows == 0))
+		{
+			desc->title[0] = '\0';
+			desc->title_rows = 0;
+		}
+	}
+	else if (!desc->is_expanded_mode && desc->border_bottom_row == -1 && isBottomLeftChar(line))
+	{
+		desc->border_bottom_row = nrows;
+		desc->last_data_row = nrows - 1;
+		desc->load_data_rows = false;
+		log_row("next row will be desc row");
+
+	}
+	else if (!desc->is_expanded_mode && desc->border_bottom_row != -1 && desc->footer_row == -1)
+	{
+		desc->footer_row = nrows;
+	}
+	else if (desc->is_expanded_mode && isBottomLeftChar(line))
+	{
+		/* Outer border is repeated in expanded mode, use last detected row */
+		desc->border_bottom_row = nrows;
+		desc->last_data_row = nrows - 1;
+		log_row("next row will be desc row");
+	}
+
+	if (!desc->is_expanded_mode && desc->border_head_row != -1 && desc->border_head_row < nrows
+		 && desc->alt_footer_row == -1)
+	{
+		if (*line != '\0' && *line != ' ')
+			desc->alt_footer_row = nrows;
+	}
+
+	if ((int) len > desc->maxbytes)
+		desc->maxbytes = (int) len;
+
+	if ((int) clen > desc->maxx + 1)
+		desc->maxx = clen - 1;
+
+	if ((int) clen > 1 || (clen == 1 && *line != '\n'))
+		desc->last_row = nrows;
+}
+
+/*
+ * The format of table is detected from first rows sequentially. Rows
+ * of mapped file after PARSE_SEQUENTIAL_ROWS rows are split by workers
+ * (every worker processes PARSE_CHUNK_SIZE bytes at least), and only
+ * cheap detection of borders and footer is sequential.
+ */
+#define PARSE_SEQUENTIAL_ROWS		500
+#define PARSE_CHUNK_SIZE			(4 * 1024 * 1024)
+
+typedef struct
+{
+	char	   *line;
+	int			bytes;				/* size of row without escape sequences */
+	int			clen;				/* display width of row */
+} ParsedRow;
+
+typedef struct
+{
+	char	   *start;				/* first char of first row */
+	char	   *end;				/* char after new line char of last row */
+	ParsedRow  *rows;
+	int			nrows;
+	int			rows_size;			/* number of allocated items of rows */
+	bool		rows_modified;		/* some escape sequence was removed */
+} ParseChunkTask;
+
+/*
+ * Splits rows of chunk of mapped file, removes escape sequences and
+ * calculates display width of rows.
+ */
+static void *
+parse_chunk_task(void *arg)
+{
+	ParseChunkTask *task = (ParseChunkTask *) arg;
+	char	   *ptr = task->start;
+
+	task->nrows = 0;
+
+	while (ptr < task->end)
+	{
+		char	   *endline = memchr(ptr, '\n', task->end - ptr);
+		ssize_t		read = endline - ptr;
+		ParsedRow  *row;
+
+		*endline = '\0';
+
+		row = &task->rows[task->nrows];
+		row->line = ptr;
+		row->bytes = remove_ansi_escape_seq(ptr, read);
+		row->clen = use_utf8 ? utf_string_dsplen(ptr, row->bytes) : row->bytes;
+
+		if (row->bytes != read)
+			task->rows_modified = true;
+
+		if (++task->nrows == task->rows_size)
+		{
+			task->rows_size *= 2;
+			task->rows = srealloc(task->rows, task->rows_size * sizeof(ParsedRow));
+		}
+
+		ptr = endline + 1;
+	}
+
+	return NULL;
+}
+
+/*
+ * Reads rows of mapped file to last new line char by workers. The rows
+ * are processed in rounds (one chunk per worker), so the memory used
+ * by parsed rows is limited. Returns number of rows.
+ */
+static int
+parse_rows_parallel(DataDesc *desc, LineBuffer **rowsp, int nrows, int *clen, long *bytes_read)
+{
+	ParseChunkTask *tasks;
+	LineBuffer *rows = *rowsp;
+	char	   *end = desc->mmap_addr + desc->mmap_size;
+	int			nworkers;
+	int			i;
+
+	/* the last row without new line char is read later */
+	while (end > desc->mmap_addr + desc->mmap_pos && end[-1] != '\n')
+		end -= 1;
+
+	nworkers = parallel_workers(end - (desc->mmap_addr + desc->mmap_pos), PARSE_CHUNK_SIZE);
+	if (nworkers < 2)
+		return nrows;
+
+	log_row("rows are parsed by %d workers", nworkers);
+
+	tasks = smalloc(nworkers * sizeof(ParseChunkTask));
+
+	for (i = 0; i < nworkers; i++)
+	{
+		tasks[i].rows_size = PARSE_CHUNK_SIZE / 64;
+		tasks[i].rows = smalloc(tasks[i].rows_size * sizeof(ParsedRow));
+	}
+
+	while (desc->mmap_addr + desc->mmap_pos < end)
+	{
+		char	   *ptr = desc->mmap_addr + desc->mmap_pos;
+		int			ntasks = 0;
+
+		for (i = 0; i < nworkers && ptr < end; i++)
+		{
+			char	   *chunk_end = ptr + PARSE_CHUNK_SIZE;
+
+			if (chunk_end >= end)
+				chunk_end = end;
+			else
+				chunk_end = (char *) memchr(chunk_end - 1, '\n', end - chunk_end + 1) + 1;
+
+			tasks[i].start = ptr;
+			tasks[i].end = chunk_end;
+			ntasks += 1;
+
+			ptr = chunk_end;
+		}
+
+		run_parallel_tasks(parse_chunk_task, tasks, sizeof(ParseChunkTask), ntasks);
+
+		/* rows are appended in original order */
+		for (i = 0; i < ntasks; i++)
+		{
+			ParseChunkTask *task = &tasks[i];
+			int			j;
+
+			for (j = 0; j < task->nrows; j++)
+			{
+				ParsedRow  *row = &task->rows[j];
+				char	   *next = j + 1 < task->nrows ? task->rows[j + 1].line : task->end;
+
+				/* see clen calculation in readfile */
+				if (*clen == -1 || !desc->load_data_rows)
+					*clen = row->clen;
+
+				if (rows->nrows == LINEBUFFER_LINES)
+					rows = lb_alloc(desc, rows);
+
+				if (rows->nrows == 0)
+					save_lb_offset(desc, nrows / LINEBUFFER_LINES, row->line - desc->mmap_addr);
+
+				rows->rows[rows->nrows++] = row->line;
+
+				/* len is same like len returned by _mmap_getline */
+				process_table_row(desc, row->line, row->bytes, next - row->line + 1, *clen, nrows);
+
+				nrows += 1;
+			}
+
+			if (task->rows_modified)
+				desc->rows_modified = true;
+		}
+
+		*bytes_read += ptr - (desc->mmap_addr + desc->mmap_pos);
+		desc->mmap_pos = ptr - desc->mmap_addr;
+	}
+
+	for (i = 0; i < nworkers; i++)
+		free(tasks[i].rows);
+
+	free(tasks);
+
+	*rowsp = rows;
+
+	return nrows;
+}
+
 /*
  * Read data from file and fill DataDesc.
  */
@@ -660,15 +1065,22 @@ bool
 readfile(Options *opts, DataDesc *desc, StateData *state)
 {
 	char	   *line = NULL;
+	char	   *buffer = NULL;
 	size_t		len;
 	ssize_t		read;
+	ssize_t		orig_read;
 	int			nrows = 0;
 	int			stop_after_nrows = 0;
 	bool		completed = true;
 	bool		initial_run;
 	bool		progressive_load_mode;
+	bool		parallel_parse = true;
 	LineBuffer *rows;
 	int		clen = -1;
+	size_t	line_offset = 0;
+	int		first_nrows;
+	long	bytes_read = 0;
+	uint64_t	start_load;
 
 #ifdef DEBUG_PIPE
 
@@ -680,6 +1092,12 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 
 #endif
 
+	/* csv or tsv document is formatted progressively */
+	if (desc->csv_stream)
+		return read_and_format_next(opts, desc, state);
+
+	start_load = stats_clock();
+
 	progressive_load_mode = opts->progressive_load_mode;
 
 	if (!desc->initialized)
@@ -711,9 +1129,29 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 		memset(&desc->rows, 0, sizeof(LineBuffer));
 		desc->rows.prev = NULL;
 		desc->oid_name_table = false;
-		desc->multilines_already_tested = false;
+		desc->multilines_tested_rows = 0;
 		desc->last_buffer = 0;
 
+		desc->mmap_addr = NULL;
+		desc->mmap_size = 0;
+		desc->mmap_pos = 0;
+		desc->lb_offsets = NULL;
+		desc->lb_offsets_size = 0;
+		desc->loader = NULL;
+		desc->lb_dir = NULL;
+		desc->lb_dir_items = 0;
+		desc->lb_dir_size = 0;
+		desc->sort_cache = NULL;
+		desc->sort_cache_items = 0;
+		desc->lb_own_arenas = opts->follow;
+		desc->recycled_rows = 0;
+		desc->rows_modified = false;
+		desc->snapshot = NULL;
+
+		/* in follow mode old rows are released, so spill storage is useless */
+		if (!opts->follow && !desc->spill)
+			(void) lb_spill_start(opts, desc);
+
 		/* safe reset */
 		desc->filename[0] = '\0';
 
@@ -722,6 +1160,15 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 		desc->completed = false;
 	}
 
+	if (!desc->arena)
+	{
+		desc->arena = arena_create();
+		desc->rows.arena = desc->arena;
+	}
+
+	if (!desc->rows.rows)
+		lb_alloc_rows(&desc->rows);
+
 	nrows = desc->total_rows;
 
 	/*
@@ -747,14 +1194,17 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 	if (!f_data)
 		return false;
 
-	clearerr(f_data);
+	/* f_data is used by loader thread */
+	if (!desc->loader)
+		clearerr(f_data);
 
 	if (progressive_load_mode)
 	{
 		if (nrows == 0)
 			stop_after_nrows = max_int(2 * LINES, 500);
+		/* rows from loader are in memory already, so we can take more */
 		else
-			stop_after_nrows = nrows + 2000;
+			stop_after_nrows = nrows + (desc->loader ? 20000 : 2000);
 	}
 	else
 	{
@@ -767,17 +1217,48 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 		/* detection truncating */
 		detect_file_truncation();
 		initial_run = true;
+
+		if (!desc->mmap_addr && !desc->loader &&
+			!mmap_data_file(opts, desc, state))
+			(void) loader_start(opts, desc, state);
+
+		/* unchanged mapped file can be loaded without parsing */
+		if (desc->mmap_addr && snapshot_load(opts, desc))
+		{
+			nrows = desc->total_rows;
+			rows = desc->last_buffer ? desc->last_buffer : &desc->rows;
+			first_nrows = nrows;
+			bytes_read = desc->mmap_size;
+			read = -1;
+			errno = 0;
+
+			goto rows_loaded;
+		}
 	}
 	else
+	{
+		/* in follow mode the rows are appended, and file can be truncated */
+		if (desc->lb_own_arenas)
+			detect_file_truncation();
+
 		initial_run = false;
+	}
+
+	first_nrows = nrows;
 
 	errno = 0;
-	read = _getline(&line, &len, f_data, f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE, false);
+	read = read_line(desc, &line, &buffer, &len, false);
 	if (read == -1)
 		return false;
 
 	do
 	{
+		bytes_read += read;
+
+		/* the line is not modified yet, so we can calculate offset of line */
+		if (desc->mmap_addr)
+			line_offset = desc->mmap_pos - read;
+
 		if (line && read > 0 && line[read - 1] == '\n')
 		{
 			line[read - 1] = '\0';
@@ -801,10 +1282,8 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 		 * Note: psql helps with it - it redirects only tabular data.
 		 *
 		 */
-		if (state->stream_mode && read == 0)
+		if (state->stream_mode && read == 0 && !desc->lb_own_arenas)
 		{
-			free(line);
-
 			/* ignore this line if we are on second line - probably watch mode */
 			if (nrows == 1)
 				goto next_row;
@@ -812,8 +1291,13 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 			break;
 		}
 
+		orig_read = read;
 		read = remove_ansi_escape_seq(line, read);
 
+		/* mapped rows are not same like input file */
+		if (read != orig_read)
+			desc->rows_modified = true;
+
 		/* In query stream node exit when you find row with only GS - Group Separator */
 		if (opts->querystream && read == 1)
 		{
@@ -830,13 +1314,14 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 			clen = use_utf8 ? utf_string_dsplen(line, read) : read;
 
 		if (rows->nrows == LINEBUFFER_LINES)
-		{
-			LineBuffer *newrows = smalloc(sizeof(LineBuffer));
+			rows = lb_alloc(desc, rows);
 
-			rows->next = newrows;
-			newrows->prev = rows;
-			rows = newrows;
-		}
+		if (desc->mmap_addr && rows->nrows == 0)
+			save_lb_offset(desc, nrows / LINEBUFFER_LINES, line_offset);
+
+		/* the content of reused buffer should be copied to arena */
+		if (line == buffer)
+			line = arena_strndup(LB_ROWS_ARENA(rows), line, read);
 
 		rows->rows[rows->nrows++] = line;
 
@@ -850,76 +1335,24 @@ readfile(Options *opts, DataDesc *desc, StateData *state)
 			goto next_row;
 		}
 
-		/* save possible table name */
-		if (nrows == 0 && !isTopLeftChar(line))
-		{
-			strncpytrim(desc->title, line, 63, read);
-			desc->title_rows = 1;
-		}
-
-		if (desc->border_head_row == -1 && desc->border_top_row == -1 && isTopLeftChar(line))
-		{
-			desc->border_top_row = nrows;
-			desc->is_expanded_mode = is_expanded_header(line, NULL, NULL);
-			if (desc->is_expanded_mode)
-				desc->border_head_row = nrows;
-		}
-		else if (desc->border_head_row == -1 && isHeadLeftChar(line))
-		{
-			desc->border_head_row = nrows;
-
-			if (isUnicodeHeadLeftCharBorder2(line))
-			{
-				desc->load_data_rows = true;
-				log_row("next row will be data row");
-			}
-
-			if (!desc->is_expanded_mode)
-				desc->is_expanded_mode = is_expanded_header(line, NULL, NULL);
-
-			/* title surely doesn't it there */
-			if ((!desc->is_expanded_mode && nrows == 1) ||
-			    (desc->is_expanded_mode && nrows == 0))
-			{
-				desc->title[0] = '\0';
-				desc->title_rows = 0;
-			}
-		}
-		else if (!desc->is_expanded_mode && desc->border_bottom_row == -1 && isBottomLeftChar(line))
+		/*
+		 * In follow mode, the stream is displayed like plain text, because
+		 * older rows (with possible header) can be released.
+		 */
+		if (desc->lb_own_arenas)
 		{
-			desc->border_bottom_row = nrows;
-			desc->last_data_row = nrows - 1;
-			desc->load_data_rows = false;
-			log_row("next row will be desc row");
+			if ((int) read > desc->maxbytes)
+				desc->maxbytes = (int) read;
 
-		}
-		else if (!desc->is_expanded_mode && desc->border_bottom_row != -1 && desc->footer_row == -1)
-		{
-			desc->footer_row = nrows;
-		}
-		else if (desc->is_expanded_mode && isBottomLeftChar(line))
-		{
-			/* Outer border is repeated in expanded mode, use last detected row */
-			desc->border_bottom_row = nrows;
-			desc->last_data_row = nrows - 1;
-			log_row("next row will be desc row");
-		}
+			if ((int) clen > desc->maxx + 1)
+				desc->maxx = clen - 1;
 
-		if (!desc->is_expanded_mode && desc->border_head_row != -1 && desc->border_head_row < nrows
-			 && desc->alt_footer_row == -1)
-		{
-			if (*line != '\0' && *line != ' ')
-				desc->alt_footer_row = nrows;
+			desc->last_row = nrows;
+			nrows += 1;
+			goto next_row;
 		}
 
-		if ((int) len > desc->maxbytes)
-			desc->maxbytes = (int) len;
-
-		if ((int) clen > desc->maxx + 1)
-			desc->maxx = clen - 1;
-
-		if ((int) clen > 1 || (clen == 1 && *line != '\n'))
-			desc->last_row = nrows;
+		process_table_row(desc, line, read, len, clen, nrows);
 
 		nrows += 1;
 
@@ -938,6 +1371,20 @@ next_row:
 			break;
 		}
 
+		/*
+		 * The rest of mapped file is in memory already, so it can be
+		 * parsed in parallel (and progressive load is not necessary).
+		 */
+		if (parallel_parse && desc->mmap_addr && nrows >= PARSE_SEQUENTIAL_ROWS &&
+			!opts->querystream && !desc->lb_own_arenas &&
+			desc->mmap_size - desc->mmap_pos >= 2 * PARSE_CHUNK_SIZE)
+		{
+			nrows = parse_rows_parallel(desc, &rows, nrows, &clen, &bytes_read);
+
+			/* don't try it again, when there is not enough cpus */
+			parallel_parse = false;
+		}
+
 		if ((f_data_opts & STREAM_HAS_NOTIFY_SUPPORT) &&
 				nrows % 1000 == 0)
 		{
@@ -945,13 +1392,46 @@ next_row:
 			usleep(1000 * 10);
 		}
 
-		read = _getline(&line, &len, f_data, f_data_opts & STREAM_IS_IN_NONBLOCKING_MODE, true);
+		read = read_line(desc, &line, &buffer, &len, true);
 	} while (read != -1);
 
+rows_loaded:
+
+	free(buffer);
+
+	stats_timer_stop(STATS_LOAD, start_load);
+	stats_counter_add(STATS_ROWS_READ, nrows - first_nrows);
+	stats_counter_add(STATS_BYTES_READ, bytes_read);
+
+	/*
+	 * When loader has not data now, we should to try later. When
+	 * all data was processed, the loader can be released.
+	 */
+	if (desc->loader)
+	{
+		if (completed && read == -1 && errno == EAGAIN)
+			completed = false;
+		else if (completed)
+		{
+			int		_errno = errno;
+
+			loader_free(desc);
+			errno = _errno;
+		}
+	}
+
 	desc->total_rows = nrows;
 	desc->last_buffer = rows != &desc->rows ? rows : NULL;
 	desc->completed = completed;
 
+	if (completed)
+		snapshot_capture(opts, desc);
+
+	/* in follow mode the oldest rows are released */
+	if (desc->lb_own_arenas)
+		(void) lb_recycle(desc, opts->follow_rows,
+						  (size_t) opts->follow_mb * 1024 * 1024);
+
 	if (errno && errno != EAGAIN)
 	{
 		log_row("cannot to read from file (%s)", strerror(errno));
@@ -1439,10 +1919,11 @@ translate_headline(DataDesc *desc)
 }
 
 /*
- * Cut text from column.
+ * Cut text from column. The str starts on display position pos.
  */
 static bool
 cut_text(char *str,
+		 int pos,
 		 int xmin,
 		 int xmax,
 		 bool border0,
@@ -1454,7 +1935,6 @@ cut_text(char *str,
 	{
 		char	   *_str = NULL;
 		char	   *after_last_nospc = NULL;
-		int			pos = 0;
 		int			chrlen;
 		bool		skip_left_spaces = true;
 
@@ -1560,9 +2040,10 @@ cut_text(char *str,
 /*
  * Try to cut numeric (double) value from row defined by specified xmin, xmax positions.
  * Units (bytes, kB, MB, GB, TB) are supported. Returns true, when returned value is valid.
+ * The str starts on display position x.
  */
 static bool
-cut_numeric_value(char *str, int xmin, int xmax, double *d, bool border0, bool *isnull, char **nullstr)
+cut_numeric_value(char *str, int x, int xmin, int xmax, double *d, bool border0, bool *isnull, char **nullstr)
 {
 
 #define BUFFER_MAX_SIZE			101
@@ -1575,7 +2056,6 @@ cut_numeric_value(char *str, int xmin, int xmax, double *d, bool border0, bool *
 	bool		only_digits = false;
 	bool		only_digits_with_point = false;
 	bool		skip_initial_spaces = true;
-	int			x = 0;
 	long		mp = 1;
 
 	*isnull = false;
@@ -1758,133 +2238,185 @@ cut_numeric_value(char *str, int xmin, int xmax, double *d, bool border0, bool *
 void
 multilines_detection(DataDesc *desc)
 {
-	LineBufferIter	lbi;
-	LineBufferMark	lbm;
-	int				recno = 1;
+	int				recno;
+	int				rowno;
+	int				lbno;
 
 	bool		border0 = (desc->border_type == 0);
 	bool		border1 = (desc->border_type == 1);
 	bool		border2 = (desc->border_type == 2);
 
-	bool		has_multilines = false;
+	bool		has_multilines;
 
-	if (desc->multilines_already_tested)
+	if (desc->first_data_row < 0)
 		return;
 
-	init_lbi_ddesc(&lbi, desc, 0);
+	/* the results can be stored in snapshot already */
+	snapshot_restore_caches(desc);
 
-	while (lbi_set_mark_next(&lbi, &lbm))
+	/* only not tested rows (appended by progressive load) are processed */
+	if (desc->multilines_tested_rows == 0)
 	{
-		char	   *str;
-		int			lineno;
-		int			pos = 0;
-		bool		found_continuation_symbol = false;
+		rowno = desc->first_data_row;
+		recno = 1;
+		has_multilines = false;
+	}
+	else
+	{
+		rowno = desc->multilines_tested_rows;
+		recno = desc->multilines_recno;
+		has_multilines = desc->has_multilines;
+	}
+
+	if (rowno > desc->last_data_row)
+		return;
+
+	for (lbno = rowno / LINEBUFFER_LINES; ; lbno++)
+	{
+		LineBuffer *lb;
+		int			i;
 
-		(void) lbm_get_line(&lbm, &str, NULL, &lineno);
+		if (lbno > desc->lb_dir_items)
+			break;
 
-		if (lineno < desc->first_data_row || lineno > desc->last_data_row)
-			continue;
+		lb = lbno > 0 ? desc->lb_dir[lbno - 1] : &desc->rows;
 
-		/*
-		 * This implementation doesn't support old-ascii format
-		 */
-		while (pos < desc->headline_char_size)
+		LB_PAGE_IN(lb);
+
+		i = rowno - lb->first_row;
+
+		if (rowno == desc->first_data_row || i == 0)
+			lb->first_recno = recno;
+
+		for (; i < lb->nrows && rowno <= desc->last_data_row; i++, rowno++)
 		{
-			if (border0)
+			char	   *str = lb->rows[i];
+			int			pos = 0;
+			bool		found_continuation_symbol = false;
+
+			/*
+			 * This implementation doesn't support old-ascii format
+			 */
+			while (pos < desc->headline_char_size)
 			{
-				if (pos + 1 == desc->headline_char_size)
+				if (border0)
 				{
-					char	*sym;
+					if (pos + 1 == desc->headline_char_size)
+					{
+						char	*sym;
 
-					sym = str + charlen(str);
-					if (*sym != '\0')
-						found_continuation_symbol = is_line_continuation_char(sym, desc);
+						sym = str + charlen(str);
+						if (*sym != '\0')
+							found_continuation_symbol = is_line_continuation_char(sym, desc);
+					}
+					else if (desc->headline_transl[pos] == 'I')
+						found_continuation_symbol = is_line_continuation_char(str, desc);
+				}
+				else if (border1)
+				{
+					if ((pos + 1 < desc->headline_char_size && desc->headline_transl[pos + 1] == 'I') ||
+						  (pos + 1 == desc->headline_char_size))
+						found_continuation_symbol = is_line_continuation_char(str, desc);
+				}
+				else if (border2)
+				{
+					if ((pos + 1 < desc->headline_char_size) &&
+						  (desc->headline_transl[pos + 1] == 'I' || desc->headline_transl[pos + 1] == 'R'))
+						found_continuation_symbol = is_line_continuation_char(str, desc);
 				}
-				else if (desc->headline_transl[pos] == 'I')
-					found_continuation_symbol = is_line_continuation_char(str, desc);
-			}
-			else if (border1)
-			{
-				if ((pos + 1 < desc->headline_char_size && desc->headline_transl[pos + 1] == 'I') ||
-					  (pos + 1 == desc->headline_char_size))
-					found_continuation_symbol = is_line_continuation_char(str, desc);
-			}
-			else if (border2)
-			{
-				if ((pos + 1 < desc->headline_char_size) &&
-					  (desc->headline_transl[pos + 1] == 'I' || desc->headline_transl[pos + 1] == 'R'))
-					found_continuation_symbol = is_line_continuation_char(str, desc);
-			}
 
-			if (found_continuation_symbol)
-			{
-				lbm_xor_mask(&lbm, LINEINFO_CONTINUATION);
-				has_multilines = true;
-				break;
+				if (found_continuation_symbol)
+				{
+					/* returns zero filled memory */
+					if (!lb->continuation_bits)
+						lb->continuation_bits = arena_alloc(lb->arena, (LINEBUFFER_LINES + 7) / 8);
+
+					lb->continuation_bits[i >> 3] |= 1 << (i & 7);
+					has_multilines = true;
+					break;
+				}
+
+				pos += dsplen(str);
+				str += charlen(str);
 			}
 
-			pos += dsplen(str);
-			str += charlen(str);
+			if (!found_continuation_symbol)
+				recno += 1;
 		}
 
-		lbm_recno_offset(&lbm, lineno - recno);
-
-		if (!found_continuation_symbol)
-			recno += 1;
+		if (rowno > desc->last_data_row || i < lb->nrows)
+			break;
 	}
 
-	desc->multilines_already_tested = true;
+	desc->multilines_tested_rows = rowno;
+	desc->multilines_recno = recno;
 	desc->has_multilines = has_multilines;
 }
 
 /*
- * Prepare order map - it is used for printing data in different than
- * original order. "sbcn" - sort by column number
+ * Minimal number of rows processed by one worker of sort
  */
-void
-update_order_map(ScrDesc *scrdesc, DataDesc *desc, int sbcn, bool desc_sort)
-{
-	LineBuffer	   *lnb = &desc->rows;
-	char		   *nullstr = NULL;
-	int				xmin, xmax;
-	int				lineno = 0;
-	bool			continual_line = false;
-	bool			isnull;
-	bool			detect_string_column = false;
-	bool			border0 = (desc->border_type == 0);
-	SortData	   *sortbuf;
-	int				sortbuf_pos = 0;
-	int			i;
-
-	xmin = desc->cranges[sbcn - 1].xmin;
-	xmax = desc->cranges[sbcn - 1].xmax;
+#define SORT_ROWS_PER_WORKER		50000
 
-	sortbuf = smalloc(desc->total_rows * sizeof(SortData));
+typedef struct
+{
+	DataDesc   *desc;
+	SortData   *sortbuf;
+	int			first_lbno;			/* first processed line buffer */
+	int			last_lbno;			/* line buffer after last processed */
+	int			colno;				/* sorted column (counted from zero) */
+	int			xmin;
+	int			xmax;
+	bool		as_text;			/* use cut_text instead cut_numeric_value */
+	bool		column_offsets;		/* rows can be searched by lb_seek_column */
+	atomic_bool *string_detected;	/* stop numeric pass, string sort is necessary */
+	char	   *nullstr;			/* first not numeric value */
+	int			nitems;				/* number of sort items (from sortbuf + first row) */
+	int			nrows;				/* number of processed rows */
+} SortKeysTask;
 
-	/* multilines should be detected first */
-	multilines_detection(desc);
+/*
+ * Fill order map by original order, and collect sort keys from rows of
+ * specified line buffers. The sort keys are stored from position of first
+ * row of first line buffer, so more tasks can fill one buffer.
+ */
+static void *
+collect_sort_keys(void *arg)
+{
+	SortKeysTask *task = (SortKeysTask *) arg;
+	DataDesc   *desc = task->desc;
+	bool		border0 = (desc->border_type == 0);
+	bool		continual_line = false;
+	bool		isnull;
+	int			lineno = task->first_lbno * LINEBUFFER_LINES;
+	SortData   *sd = task->sortbuf + lineno;
+	int			lbno;
+	int			i;
 
-	lnb = &desc->rows;
-	lineno = 0;
-	sortbuf_pos = 0;
+	task->nullstr = NULL;
+	task->nitems = 0;
+	task->nrows = 0;
 
-	if (!desc->order_map)
+	/* continual_line is based on previous data row */
+	if (desc->has_multilines &&
+		lineno > desc->first_data_row && lineno - 1 <= desc->last_data_row)
 	{
-		desc->order_map = smalloc(desc->total_rows * sizeof(MappedLine));
-		desc->order_map_items = desc->total_rows;
+		LineBuffer *prev = task->first_lbno > 1 ? desc->lb_dir[task->first_lbno - 2] : &desc->rows;
+
+		continual_line = LB_IS_CONTINUED(prev, LINEBUFFER_LINES - 1);
 	}
 
-	/*
-	 * There are two possible sorting methods: numeric or string.
-	 * We can try numeric sort first if all values are numbers or
-	 * just only one type of string value (like NULL string). This
-	 * value can be repeated,
-	 *
-	 * When there are more different strings, then start again and
-	 * use string sort.
-	 */
-	while (lnb)
+	for (lbno = task->first_lbno; lbno < task->last_lbno; lbno++)
 	{
+		LineBuffer *lnb = lbno > 0 ? desc->lb_dir[lbno - 1] : &desc->rows;
+
+		/* other task found string, so this pass is useless */
+		if (!task->as_text && atomic_load(task->string_detected))
+			return NULL;
+
+		/* evicted rows can be paged in by more workers in parallel */
+		lb_pin(lnb);
+
 		for (i = 0; i < lnb->nrows; i++)
 		{
 			desc->order_map[lineno].lnb = lnb;
@@ -1894,96 +2426,309 @@ update_order_map(ScrDesc *scrdesc, DataDesc *desc, int sbcn, bool desc_sort)
 			{
 				if (!continual_line)
 				{
-					sortbuf[sortbuf_pos].lnb = lnb;
-					sortbuf[sortbuf_pos].lnb_row = i;
-					sortbuf[sortbuf_pos].strxfrm = NULL;
-
-					if (cut_numeric_value(lnb->rows[i],
-										   xmin, xmax,
-										   &sortbuf[sortbuf_pos].d,
-										   border0,
-										   &isnull,
-										   &nullstr))
-						sortbuf[sortbuf_pos++].info = INFO_DOUBLE;
+					char	   *str = lnb->rows[i];
+					int			pos = 0;
+
+					sd->lnb = lnb;
+					sd->lnb_row = i;
+
+					/*
+					 * The walk to the column can start on offset of column or
+					 * on checkpoint, when the row was displayed already.
+					 * cut_text counts display width by utf_dsplen, so it is
+					 * same only in UTF8 mode.
+					 */
+					if (str && (use_utf8 || !task->as_text))
+					{
+						if (task->column_offsets)
+							str = lb_seek_column(desc, lnb, i, task->colno, &pos);
+
+						if (pos == 0)
+							str = lb_seek_dsppos(lnb, i, task->xmin, false, &pos);
+					}
+
+					if (task->as_text)
+					{
+						sd->d = 0.0;
+
+						if (cut_text(str, pos, task->xmin, task->xmax, border0, &sd->strxfrm))
+							sd->info = INFO_STRXFRM;
+						else
+							sd->info = INFO_UNKNOWN;		/* empty string */
+					}
 					else
 					{
-						sortbuf[sortbuf_pos++].info = INFO_UNKNOWN;
-						if (!isnull)
+						sd->strxfrm = NULL;
+
+						if (cut_numeric_value(str, pos,
+											   task->xmin, task->xmax,
+											   &sd->d,
+											   border0,
+											   &isnull,
+											   &task->nullstr))
+							sd->info = INFO_DOUBLE;
+						else
 						{
-							detect_string_column = true;
-							goto sort_by_string;
+							sd->info = INFO_UNKNOWN;
+							if (!isnull)
+							{
+								atomic_store(task->string_detected, true);
+								lb_unpin(lnb);
+								return NULL;
+							}
 						}
 					}
+
+					sd += 1;
+					task->nitems += 1;
 				}
 
 				if (desc->has_multilines)
 				{
-					continual_line = (lnb->lineinfo &&
-									  (lnb->lineinfo[i].mask & LINEINFO_CONTINUATION));
+					continual_line = LB_IS_CONTINUED(lnb, i);
 				}
 			}
 
 			lineno += 1;
 		}
 
-		lnb = lnb->next;
+		lb_unpin(lnb);
+
+		task->nrows += lnb->nrows;
 	}
 
-sort_by_string:
+	return NULL;
+}
 
-	free(nullstr);
+/*
+ * Returns cache item of column. The cached keys are released, when
+ * they was created for different data.
+ */
+static SortCacheItem *
+get_sort_cache_item(DataDesc *desc, int sbcn)
+{
+	SortCacheItem *item;
+	int			i;
 
-	if (detect_string_column)
+	if (sbcn > desc->sort_cache_items)
 	{
-		/* read data again and use nls_string */
-		lnb = &desc->rows;
-		lineno = 0;
-		sortbuf_pos = 0;
-		while (lnb)
-		{
-			for (i = 0; i < lnb->nrows; i++)
-			{
-				desc->order_map[lineno].lnb = lnb;
-				desc->order_map[lineno].lnb_row = i;
+		desc->sort_cache = srealloc(desc->sort_cache, sbcn * sizeof(SortCacheItem));
+		memset(desc->sort_cache + desc->sort_cache_items, 0,
+			   (sbcn - desc->sort_cache_items) * sizeof(SortCacheItem));
+		desc->sort_cache_items = sbcn;
+	}
 
-				if (lineno >= desc->first_data_row && lineno <= desc->last_data_row)
-				{
-					if (!continual_line)
-					{
-						sortbuf[sortbuf_pos].lnb = lnb;
-						sortbuf[sortbuf_pos].lnb_row = i;
-						sortbuf[sortbuf_pos].d = 0.0;
+	item = &desc->sort_cache[sbcn - 1];
 
-						if (cut_text(lnb->rows[i], xmin, xmax, border0, &sortbuf[sortbuf_pos].strxfrm))
-							sortbuf[sortbuf_pos++].info = INFO_STRXFRM;
-						else
-							sortbuf[sortbuf_pos++].info = INFO_UNKNOWN;		/* empty string */
-					}
+	if (item->keys &&
+		(item->total_rows != desc->total_rows ||
+		 item->first_data_row != desc->first_data_row ||
+		 item->last_data_row != desc->last_data_row ||
+		 item->xmin != desc->cranges[sbcn - 1].xmin ||
+		 item->xmax != desc->cranges[sbcn - 1].xmax))
+	{
+		for (i = 0; i < item->nitems; i++)
+			free(item->keys[i].strxfrm);
 
-					if (desc->has_multilines)
-					{
-						continual_line =  (lnb->lineinfo &&
-										   (lnb->lineinfo[i].mask & LINEINFO_CONTINUATION));
-					}
-				}
+		free(item->keys);
+		item->keys = NULL;
+	}
 
-				lineno += 1;
-			}
-			lnb = lnb->next;
+	return item;
+}
+
+/*
+ * Set original order of rows in specified range of order map
+ */
+static void
+set_original_order(DataDesc *desc, int from, int to)
+{
+	int			lineno;
+
+	for (lineno = from; lineno < to; lineno++)
+	{
+		int		lbno = lineno / LINEBUFFER_LINES;
+
+		desc->order_map[lineno].lnb = lbno > 0 ? desc->lb_dir[lbno - 1] : &desc->rows;
+		desc->order_map[lineno].lnb_row = lineno % LINEBUFFER_LINES;
+	}
+}
+
+/*
+ * Collects sort keys of column, sorts them in ascending order and
+ * stores them to cache item. The order map is filled by original
+ * order.
+ */
+static void
+prepare_sort_keys(DataDesc *desc, int sbcn, SortCacheItem *item)
+{
+	atomic_bool		string_detected = false;
+	bool			detect_string_column = false;
+	SortData	   *sortbuf;
+	SortKeysTask   *tasks;
+	bool			column_offsets;
+	int				nworkers;
+	int				nbuffers;
+	int				sortbuf_pos = 0;
+	int				lineno = 0;
+	int				i;
+
+	sortbuf = smalloc(desc->total_rows * sizeof(SortData));
+
+	/*
+	 * The rows are divided between workers by line buffers. Every
+	 * worker collects sort keys from own rows.
+	 */
+	nbuffers = desc->lb_dir_items + 1;
+	nworkers = parallel_workers(desc->total_rows, SORT_ROWS_PER_WORKER);
+	if (nworkers > nbuffers)
+		nworkers = nbuffers;
+
+	tasks = smalloc(nworkers * sizeof(SortKeysTask));
+
+	column_offsets = lb_column_offsets_enabled(desc);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		tasks[i].desc = desc;
+		tasks[i].sortbuf = sortbuf;
+		tasks[i].first_lbno = (int) ((long) nbuffers * i / nworkers);
+		tasks[i].last_lbno = (int) ((long) nbuffers * (i + 1) / nworkers);
+		tasks[i].colno = sbcn - 1;
+		tasks[i].xmin = desc->cranges[sbcn - 1].xmin;
+		tasks[i].xmax = desc->cranges[sbcn - 1].xmax;
+		tasks[i].as_text = false;
+		tasks[i].column_offsets = column_offsets;
+		tasks[i].string_detected = &string_detected;
+	}
+
+	/*
+	 * There are two possible sorting methods: numeric or string.
+	 * We can try numeric sort first if all values are numbers or
+	 * just only one type of string value (like NULL string). This
+	 * value can be repeated,
+	 *
+	 * When there are more different strings, then start again and
+	 * use string sort.
+	 */
+	if (nworkers > 1)
+		log_row("sort keys are collected by %d workers", nworkers);
+
+	run_parallel_tasks(collect_sort_keys, tasks, sizeof(SortKeysTask), nworkers);
+
+	detect_string_column = atomic_load(&string_detected);
+
+	/* every task can see different first not numeric value */
+	for (i = 0; i < nworkers; i++)
+	{
+		if (!detect_string_column &&
+			tasks[i].nullstr && tasks[0].nullstr &&
+			strcmp(tasks[i].nullstr, tasks[0].nullstr) != 0)
+			detect_string_column = true;
+
+		if (!tasks[0].nullstr)
+		{
+			tasks[0].nullstr = tasks[i].nullstr;
+			tasks[i].nullstr = NULL;
 		}
 	}
 
+	for (i = 0; i < nworkers; i++)
+		free(tasks[i].nullstr);
+
+	if (detect_string_column)
+	{
+		/* read data again and use nls_string */
+		for (i = 0; i < nworkers; i++)
+			tasks[i].as_text = true;
+
+		run_parallel_tasks(collect_sort_keys, tasks, sizeof(SortKeysTask), nworkers);
+	}
+
+	/* join sort keys of tasks */
+	for (i = 0; i < nworkers; i++)
+	{
+		memmove(sortbuf + sortbuf_pos,
+				sortbuf + tasks[i].first_lbno * LINEBUFFER_LINES,
+				tasks[i].nitems * sizeof(SortData));
+
+		sortbuf_pos += tasks[i].nitems;
+		lineno += tasks[i].nrows;
+	}
+
+	free(tasks);
+
 	if (lineno != desc->total_rows)
 		leave("unexpected processed rows after sort prepare");
 
-	if (detect_string_column)
-		sort_column_text(sortbuf, sortbuf_pos, desc_sort);
+	if (nworkers > 1)
+		sort_column_parallel(sortbuf, sortbuf_pos, false, detect_string_column, nworkers);
+	else if (detect_string_column)
+		sort_column_text(sortbuf, sortbuf_pos, false);
+	else
+		sort_column_num(sortbuf, sortbuf_pos, false);
+
+	item->keys = sortbuf;
+	item->nitems = sortbuf_pos;
+	item->is_text = detect_string_column;
+	item->total_rows = desc->total_rows;
+	item->first_data_row = desc->first_data_row;
+	item->last_data_row = desc->last_data_row;
+	item->xmin = desc->cranges[sbcn - 1].xmin;
+	item->xmax = desc->cranges[sbcn - 1].xmax;
+}
+
+/*
+ * Prepare order map - it is used for printing data in different than
+ * original order. "sbcn" - sort by column number. The sorted keys are
+ * cached, so repeated sort by same column doesn't need to read data
+ * again. Descending order is created from ascending order.
+ */
+void
+update_order_map(ScrDesc *scrdesc, DataDesc *desc, int sbcn, bool desc_sort)
+{
+	LineBuffer	   *lnb;
+	SortCacheItem  *item;
+	SortData	   *sortbuf;
+	int				lineno;
+	int				i;
+	uint64_t		start_sort = stats_clock();
+
+	/* multilines should be detected first */
+	multilines_detection(desc);
+
+	/* order map can be too short after loading of next rows */
+	if (!desc->order_map || desc->order_map_items < desc->total_rows)
+	{
+		free(desc->order_map);
+		desc->order_map = smalloc(desc->total_rows * sizeof(MappedLine));
+		desc->order_map_items = desc->total_rows;
+	}
+
+	item = get_sort_cache_item(desc, sbcn);
+
+	if (!item->keys)
+		prepare_sort_keys(desc, sbcn, item);
+	else
+	{
+		log_row("sort keys of column %d are taken from cache", sbcn);
+
+		/* rows out of data has original order */
+		set_original_order(desc, 0, desc->first_data_row);
+		set_original_order(desc, desc->last_data_row + 1, desc->total_rows);
+	}
+
+	if (desc_sort)
+	{
+		sortbuf = smalloc(item->nitems * sizeof(SortData));
+		sort_column_reverse(item->keys, sortbuf, item->nitems, item->is_text);
+	}
 	else
-		sort_column_num(sortbuf, sortbuf_pos, desc_sort);
+		sortbuf = item->keys;
 
 	lineno = desc->first_data_row;
 
-	for (i = 0; i < sortbuf_pos; i++)
+	for (i = 0; i < item->nitems; i++)
 	{
 		desc->order_map[lineno].lnb = sortbuf[i].lnb;
 		desc->order_map[lineno].lnb_row = sortbuf[i].lnb_row;
@@ -1998,8 +2743,7 @@ sort_by_string:
 			lnb = sortbuf[i].lnb;
 			lnb_row = sortbuf[i].lnb_row;
 
-			continual = lnb->lineinfo &&
-									   (lnb->lineinfo[lnb_row].mask & LINEINFO_CONTINUATION);
+			continual = LB_IS_CONTINUED(lnb, lnb_row);
 
 			while (lnb && continual)
 			{
@@ -2014,8 +2758,7 @@ sort_by_string:
 				desc->order_map[lineno].lnb_row = lnb_row;
 				lineno += 1;
 
-				continual = lnb && lnb->lineinfo &&
-								(lnb->lineinfo[lnb_row].mask & LINEINFO_CONTINUATION);
+				continual = lnb && LB_IS_CONTINUED(lnb, lnb_row);
 			}
 		}
 	}
@@ -2026,8 +2769,8 @@ sort_by_string:
 	 */
 	scrdesc->found_row = -1;
 
-	for (i = 0; i < sortbuf_pos; i++)
-		free(sortbuf[i].strxfrm);
+	if (sortbuf != item->keys)
+		free(sortbuf);
 
-	free(sortbuf);
+	stats_timer_stop(STATS_SORT, start_sort);
 }
@@ -12,10 +12,32 @@
  */
 
 #include <ctype.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "unicode.h"
 #include "string.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SSE2_SEARCH
+#define HAVE_AVX2_SEARCH
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_SEARCH
+#endif
+
+/*
+ * The vector kernels read aligned blocks, that can be partially before
+ * start or after end of string. Aligned read cannot to cross page
+ * boundary, so it is safe, but address sanitizer doesn't know it.
+ */
+#if defined(__GNUC__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define NO_SANITIZE_ADDRESS
+#endif
+
 inline static wchar_t utf8_to_unicode(const unsigned char *c);
 
 /*
@@ -138,7 +160,7 @@ mbbisearch(wchar_t ucs, const struct mbinterval *table, int max)
  * in ISO 10646.
  */
 static int
-ucs_wcwidth(wchar_t ucs)
+ucs_wcwidth_bisearch(wchar_t ucs)
 {
 #include "unicode_combining_table.h"
 #include "unicode_east_asian_fw_table.h"
@@ -171,6 +193,73 @@ ucs_wcwidth(wchar_t ucs)
 	return 1;
 }
 
+/*
+ * Widths of BMP chars are stored in two level table. The chars are
+ * divided to blocks of 256 chars, and same blocks are stored only once,
+ * so the table is small (usually less than 8kB). Every char has two
+ * bits - width increased by one (-1 is stored as zero).
+ */
+#define BMP_BLOCK_CHARS			256
+#define BMP_BLOCK_BYTES			(BMP_BLOCK_CHARS / 4)
+#define BMP_BLOCKS				(0x10000 / BMP_BLOCK_CHARS)
+
+static unsigned char bmp_block_index[BMP_BLOCKS];
+static unsigned char bmp_blocks[BMP_BLOCKS][BMP_BLOCK_BYTES];
+static pthread_once_t bmp_widths_once = PTHREAD_ONCE_INIT;
+
+static void
+init_bmp_widths(void)
+{
+	int		nblocks = 0;
+	int		i;
+
+	for (i = 0; i < BMP_BLOCKS; i++)
+	{
+		unsigned char block[BMP_BLOCK_BYTES];
+		int		j;
+
+		memset(block, 0, BMP_BLOCK_BYTES);
+
+		for (j = 0; j < BMP_BLOCK_CHARS; j++)
+		{
+			int		width = ucs_wcwidth_bisearch(i * BMP_BLOCK_CHARS + j);
+
+			block[j / 4] |= (width + 1) << ((j % 4) * 2);
+		}
+
+		for (j = 0; j < nblocks; j++)
+			if (memcmp(bmp_blocks[j], block, BMP_BLOCK_BYTES) == 0)
+				break;
+
+		if (j == nblocks)
+			memcpy(bmp_blocks[nblocks++], block, BMP_BLOCK_BYTES);
+
+		bmp_block_index[i] = j;
+	}
+}
+
+/*
+ * The widths of BMP chars are taken from lookup table, that is created
+ * on first usage. It can be used by more threads.
+ */
+static int
+ucs_wcwidth(wchar_t ucs)
+{
+	if (ucs >= 0 && ucs < 0x10000)
+	{
+		unsigned int u = (unsigned int) ucs;
+		unsigned char *block;
+
+		pthread_once(&bmp_widths_once, init_bmp_widths);
+
+		block = bmp_blocks[bmp_block_index[u / BMP_BLOCK_CHARS]];
+
+		return ((block[(u % BMP_BLOCK_CHARS) / 4] >> ((u % 4) * 2)) & 3) - 1;
+	}
+
+	return ucs_wcwidth_bisearch(ucs);
+}
+
 /*
  * Map a Unicode code point to UTF-8.  utf8string must have 4 bytes of
  * space allocated.
@@ -254,6 +343,125 @@ utf8_to_unicode(const unsigned char *c)
 
 }
 
+/*
+ * Returns number of printable ASCII chars (with display width 1) on start
+ * of string, but max_bytes at most. The end of string (zero byte) stops
+ * the run too. The vector kernels use aligned reads like
+ * find_search_candidate, and they don't read blocks after max_bytes.
+ */
+#if !defined(HAVE_SSE2_SEARCH) && !defined(HAVE_NEON_SEARCH)
+
+static size_t
+ascii_run_length_scalar(const char *str, size_t max_bytes)
+{
+	const unsigned char *ptr = (const unsigned char *) str;
+	const unsigned char *endptr = ptr + max_bytes;
+
+	while (ptr < endptr && *ptr >= 0x20 && *ptr < 0x7f)
+		ptr++;
+
+	return (const char *) ptr - str;
+}
+
+#endif
+
+#ifdef HAVE_SSE2_SEARCH
+
+NO_SANITIZE_ADDRESS static size_t
+ascii_run_length_sse2(const char *str, size_t max_bytes)
+{
+	uintptr_t	offset = (uintptr_t) str & 15;
+	const char *ptr = str - offset;
+	__m128i		space = _mm_set1_epi8(0x20);
+	__m128i		del = _mm_set1_epi8(0x7f);
+	unsigned int mask;
+
+	for (;;)
+	{
+		__m128i		chunk = _mm_load_si128((const __m128i *) ptr);
+
+		/* signed comparison catches bytes with high bit too */
+		mask = (unsigned int) (_mm_movemask_epi8(_mm_cmplt_epi8(chunk, space)) |
+							   _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, del)));
+
+		/* ignore bytes before start of string */
+		mask &= 0xFFFFU << offset;
+		offset = 0;
+
+		if (mask)
+		{
+			size_t		n = ptr + __builtin_ctz(mask) - str;
+
+			return n < max_bytes ? n : max_bytes;
+		}
+
+		ptr += 16;
+
+		if ((size_t) (ptr - str) >= max_bytes)
+			return max_bytes;
+	}
+}
+
+#endif
+
+#ifdef HAVE_NEON_SEARCH
+
+NO_SANITIZE_ADDRESS static size_t
+ascii_run_length_neon(const char *str, size_t max_bytes)
+{
+	uintptr_t	offset = (uintptr_t) str & 15;
+	const char *ptr = str - offset;
+	uint8x16_t	space = vdupq_n_u8(0x20);
+	uint8x16_t	del = vdupq_n_u8(0x7f);
+
+	for (;;)
+	{
+		uint8x16_t	chunk = vld1q_u8((const uint8_t *) ptr);
+		uint8x16_t	stop;
+		uint64_t	mask;
+
+		stop = vorrq_u8(vcltq_u8(chunk, space), vcgeq_u8(chunk, del));
+
+		/* every byte is reduced to 4 bits */
+		mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+
+		mask &= ~UINT64_C(0) << (offset * 4);
+		offset = 0;
+
+		if (mask)
+		{
+			size_t		n = ptr + (__builtin_ctzll(mask) >> 2) - str;
+
+			return n < max_bytes ? n : max_bytes;
+		}
+
+		ptr += 16;
+
+		if ((size_t) (ptr - str) >= max_bytes)
+			return max_bytes;
+	}
+}
+
+#endif
+
+static inline size_t
+ascii_run_length(const char *str, size_t max_bytes)
+{
+#if defined(HAVE_SSE2_SEARCH)
+
+	return ascii_run_length_sse2(str, max_bytes);
+
+#elif defined(HAVE_NEON_SEARCH)
+
+	return ascii_run_length_neon(str, max_bytes);
+
+#else
+
+	return ascii_run_length_scalar(str, max_bytes);
+
+#endif
+}
+
 inline int
 utf_dsplen(const char *s)
 {
@@ -284,9 +492,11 @@ utf_string_dsplen(const char *s, int bytes)
 
 		if (c >= 0x20 && c < 0x7f)
 		{
-			s += 1;
-			result += 1;
-			bytes -= 1;
+			int		n = ascii_run_length(s, bytes);
+
+			s += n;
+			result += n;
+			bytes -= n;
 		}
 		else if (c)
 		{
@@ -317,6 +527,29 @@ utf_string_dsplen_multiline(const char *s, size_t max_bytes, bool *multiline, bo
 	{
 		int		clen;
 
+		if (*ptr >= 0x20 && *ptr < 0x7f)
+		{
+			size_t	n = ascii_run_length(ptr, max_bytes);
+			size_t	i;
+
+			if (!first_only)
+			{
+				for (i = 0; i < n; i++)
+				{
+					if (ptr[i] >= '0' && ptr[i] <= '9')
+						(*digits)++;
+					else if (ptr[i] != '-' && ptr[i] != ' ' && ptr[i] != ':')
+						(*others)++;
+				}
+			}
+
+			rowlen += n;
+			ptr += n;
+			max_bytes -= n;
+
+			continue;
+		}
+
 		if (!first_only)
 		{
 			if (*ptr >= '0' && *ptr <= '9')
@@ -523,6 +756,195 @@ utf8_tofold(const char *s)
 						  utf8_to_unicode((const unsigned char *) s));
 }
 
+/*
+ * Searching of candidates of start of pattern. Returns pointer to first
+ * byte of str, that is c1 or c2, or that is not ASCII char (and then
+ * it should be processed by slower case folding), or to the end of
+ * string. The kernel is selected by CPU on first call.
+ */
+static const char *
+find_search_candidate_scalar(const char *str, unsigned char c1, unsigned char c2)
+{
+	const unsigned char *ptr = (const unsigned char *) str;
+
+	while (*ptr && *ptr < 0x80 && *ptr != c1 && *ptr != c2)
+		ptr++;
+
+	return (const char *) ptr;
+}
+
+#ifdef HAVE_SSE2_SEARCH
+
+NO_SANITIZE_ADDRESS static const char *
+find_search_candidate_sse2(const char *str, unsigned char c1, unsigned char c2)
+{
+	uintptr_t	offset = (uintptr_t) str & 15;
+	const char *ptr = str - offset;
+	__m128i		v1 = _mm_set1_epi8((char) c1);
+	__m128i		v2 = _mm_set1_epi8((char) c2);
+	__m128i		zero = _mm_setzero_si128();
+	unsigned int mask;
+
+	for (;;)
+	{
+		__m128i		chunk = _mm_load_si128((const __m128i *) ptr);
+		__m128i		eq;
+
+		eq = _mm_or_si128(_mm_cmpeq_epi8(chunk, v1), _mm_cmpeq_epi8(chunk, v2));
+		eq = _mm_or_si128(eq, _mm_cmpeq_epi8(chunk, zero));
+
+		/* high bit of not ASCII chars are used directly */
+		mask = (unsigned int) (_mm_movemask_epi8(eq) | _mm_movemask_epi8(chunk));
+
+		/* ignore bytes before start of string */
+		mask &= 0xFFFFU << offset;
+		offset = 0;
+
+		if (mask)
+			return ptr + __builtin_ctz(mask);
+
+		ptr += 16;
+	}
+}
+
+#endif
+
+#ifdef HAVE_AVX2_SEARCH
+
+__attribute__((target("avx2")))
+NO_SANITIZE_ADDRESS static const char *
+find_search_candidate_avx2(const char *str, unsigned char c1, unsigned char c2)
+{
+	uintptr_t	offset = (uintptr_t) str & 31;
+	const char *ptr = str - offset;
+	__m256i		v1 = _mm256_set1_epi8((char) c1);
+	__m256i		v2 = _mm256_set1_epi8((char) c2);
+	__m256i		zero = _mm256_setzero_si256();
+	unsigned int mask;
+
+	for (;;)
+	{
+		__m256i		chunk = _mm256_load_si256((const __m256i *) ptr);
+		__m256i		eq;
+
+		eq = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, v1), _mm256_cmpeq_epi8(chunk, v2));
+		eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(chunk, zero));
+
+		mask = (unsigned int) _mm256_movemask_epi8(eq) |
+			   (unsigned int) _mm256_movemask_epi8(chunk);
+
+		mask &= 0xFFFFFFFFU << offset;
+		offset = 0;
+
+		if (mask)
+			return ptr + __builtin_ctz(mask);
+
+		ptr += 32;
+	}
+}
+
+#endif
+
+#ifdef HAVE_NEON_SEARCH
+
+NO_SANITIZE_ADDRESS static const char *
+find_search_candidate_neon(const char *str, unsigned char c1, unsigned char c2)
+{
+	uintptr_t	offset = (uintptr_t) str & 15;
+	const char *ptr = str - offset;
+	uint8x16_t	v1 = vdupq_n_u8(c1);
+	uint8x16_t	v2 = vdupq_n_u8(c2);
+	uint8x16_t	high = vdupq_n_u8(0x80);
+
+	for (;;)
+	{
+		uint8x16_t	chunk = vld1q_u8((const uint8_t *) ptr);
+		uint8x16_t	eq;
+		uint64_t	mask;
+
+		eq = vorrq_u8(vceqq_u8(chunk, v1), vceqq_u8(chunk, v2));
+		eq = vorrq_u8(eq, vceqzq_u8(chunk));
+		eq = vorrq_u8(eq, vcgeq_u8(chunk, high));
+
+		/* every byte is reduced to 4 bits */
+		mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+		mask &= ~UINT64_C(0) << (offset * 4);
+		offset = 0;
+
+		if (mask)
+			return ptr + (__builtin_ctzll(mask) >> 2);
+
+		ptr += 16;
+	}
+}
+
+#endif
+
+static const char *(*find_search_candidate_impl) (const char *, unsigned char, unsigned char) = NULL;
+
+const char *
+find_search_candidate(const char *str, unsigned char c1, unsigned char c2)
+{
+	if (!find_search_candidate_impl)
+	{
+		find_search_candidate_impl = find_search_candidate_scalar;
+
+#ifdef HAVE_SSE2_SEARCH
+		find_search_candidate_impl = find_search_candidate_sse2;
+#endif
+
+#ifdef HAVE_AVX2_SEARCH
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			find_search_candidate_impl = find_search_candidate_avx2;
+#endif
+
+#ifdef HAVE_NEON_SEARCH
+		find_search_candidate_impl = find_search_candidate_neon;
+#endif
+	}
+
+	return find_search_candidate_impl(str, c1, c2);
+}
+
+/*
+ * Case folding with fast path for ASCII chars
+ */
+static inline int
+fold_char(const char *s)
+{
+	unsigned char c = (unsigned char) *s;
+
+	if (c < 0x80)
+		return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+
+	return utf8_tofold(s);
+}
+
+static inline bool
+is_upper_char(const char *s)
+{
+	unsigned char c = (unsigned char) *s;
+
+	if (c < 0x80)
+		return c >= 'A' && c <= 'Z';
+
+	return utf8_isupper(s);
+}
+
+/*
+ * Returns first byte of needle, when it can be used for searching of
+ * candidates (ASCII char), else returns zero.
+ */
+static inline unsigned char
+candidate_char(const char *needle)
+{
+	unsigned char c = (unsigned char) *needle;
+
+	return c < 0x80 ? c : 0;
+}
+
 const char *
 utf8_nstrstr_with_sizes(const char *haystack,
 						int haystack_size,
@@ -550,10 +972,10 @@ utf8_nstrstr_with_sizes(const char *haystack,
 		{
 			needle_prev = needle_cur;
 			needle_char_len = utf8charlen(*needle_cur);
-			f1 = utf8_tofold(needle_cur);
+			f1 = fold_char(needle_cur);
 		}
 
-		f2 = utf8_tofold(haystack_cur);
+		f2 = fold_char(haystack_cur);
 		if (f1 == f2)
 		{
 			needle_cur += needle_char_len;
@@ -608,107 +1030,129 @@ utf8_nstarts_with_with_sizes(const char *str,
 	return true;
 }
 
+/*
+ * Returns true, when string str starts with case folded pattern. When
+ * str is shorter than pattern, then *at_end is true.
+ */
+static inline bool
+utf8_starts_with_folded(const char *str, const char *pattern, bool *at_end)
+{
+	while (*pattern)
+	{
+		if (!*str)
+		{
+			*at_end = true;
+			return false;
+		}
+
+		if (fold_char(str) != fold_char(pattern))
+			return false;
+
+		str += utf8charlen(*str);
+		pattern += utf8charlen(*pattern);
+	}
+
+	return true;
+}
+
 const char *
 utf8_nstrstr(const char *haystack, const char *needle)
 {
-	const char *haystack_cur, *needle_cur, *needle_prev;
-	int		f1 = 0, f2 = 0;
-	int		needle_char_len = 0; /* be compiler quiet */
+	unsigned char c = candidate_char(needle);
+	unsigned char lc = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+	unsigned char uc = (c >= 'a' && c <= 'z') ? c - 32 : c;
+	bool		at_end = false;
 
-	needle_cur = needle;
-	needle_prev = NULL;
-	haystack_cur = haystack;
+	if (!*needle)
+		return haystack;
 
-	while (*needle_cur != '\0')
+	for (;;)
 	{
-		if (*haystack_cur == '\0')
+		if (c)
+			haystack = find_search_candidate(haystack, lc, uc);
+
+		if (!*haystack)
 			return NULL;
 
-		if (needle_prev != needle_cur)
-		{
-			needle_prev = needle_cur;
-			needle_char_len = utf8charlen(*needle_cur);
-			f1 = utf8_tofold(needle_cur);
-		}
+		if (utf8_starts_with_folded(haystack, needle, &at_end))
+			return haystack;
 
-		f2 = utf8_tofold(haystack_cur);
-		if (f1 == f2)
-		{
-			needle_cur += needle_char_len;
-			haystack_cur += utf8charlen(*haystack_cur);
-		}
-		else
-		{
-			needle_cur = needle;
-			haystack_cur = haystack += utf8charlen(*haystack);
-		}
-	}
+		if (at_end)
+			return NULL;
 
-	return haystack;
+		haystack += utf8charlen(*haystack);
+	}
 }
 
 /*
  * Special string searching, lower chars are case insensitive,
  * upper chars are case sensitive.
  */
-const char *
-utf8_nstrstr_ignore_lower_case(const char *haystack, const char *needle)
+static inline bool
+utf8_starts_with_ignore_lower_case(const char *str, const char *pattern, bool *at_end)
 {
-	const char *haystack_cur, *needle_cur, *needle_prev;
-	int		f1 = 0, f2 = 0;
-	bool	eq;
-
-	needle_cur = needle;
-	needle_prev = NULL;
-	haystack_cur = haystack;
-
-	while (*needle_cur != '\0')
+	while (*pattern)
 	{
-		int		haystack_char_len;
-		int		needle_char_len = 0;
-		bool	needle_char_is_upper =  false;
-
-		if (*haystack_cur == '\0')
-			return NULL;
+		int		str_char_len;
+		int		pattern_char_len;
 
-		haystack_char_len = utf8charlen(*haystack_cur);
-
-		if (needle_prev != needle_cur)
+		if (!*str)
 		{
-			needle_prev = needle_cur;
-			needle_char_len = utf8charlen(*needle_cur);
-			needle_char_is_upper = utf8_isupper(needle_cur);
-			f1 = utf8_tofold(needle_cur);
+			*at_end = true;
+			return false;
 		}
 
-		if (needle_char_is_upper)
+		str_char_len = utf8charlen(*str);
+		pattern_char_len = utf8charlen(*pattern);
+
+		if (is_upper_char(pattern))
 		{
 			/* case sensitive */
-			if (needle_char_len == haystack_char_len)
-				eq = memcmp(haystack_cur, needle_cur, needle_char_len) == 0;
-			else
-				eq = false;
+			if (str_char_len != pattern_char_len ||
+				memcmp(str, pattern, pattern_char_len) != 0)
+				return false;
 		}
 		else
 		{
 			/* case insensitive */
-			f2 = utf8_tofold(haystack_cur);
-			eq = f1 == f2;
+			if (fold_char(str) != fold_char(pattern))
+				return false;
 		}
 
-		if (eq)
-		{
-			needle_cur += needle_char_len;
-			haystack_cur += haystack_char_len;
-		}
-		else
-		{
-			needle_cur = needle;
-			haystack_cur = haystack += utf8charlen(*haystack);
-		}
+		str += str_char_len;
+		pattern += pattern_char_len;
 	}
 
-	return haystack;
+	return true;
+}
+
+const char *
+utf8_nstrstr_ignore_lower_case(const char *haystack, const char *needle)
+{
+	unsigned char c = candidate_char(needle);
+	unsigned char lc = c;
+	unsigned char uc = (c >= 'a' && c <= 'z') ? c - 32 : c;
+	bool		at_end = false;
+
+	if (!*needle)
+		return haystack;
+
+	for (;;)
+	{
+		if (c)
+			haystack = find_search_candidate(haystack, lc, uc);
+
+		if (!*haystack)
+			return NULL;
+
+		if (utf8_starts_with_ignore_lower_case(haystack, needle, &at_end))
+			return haystack;
+
+		if (at_end)
+			return NULL;
+
+		haystack += utf8charlen(*haystack);
+	}
 }
 
 bool
@@ -23,6 +23,7 @@ extern int utf8charlen(char ch);
 extern int utf_dsplen(const char *s);
 extern int utf_string_dsplen(const char *s, int max_bytes);
 extern int readline_utf_string_dsplen(const char *s, size_t max_bytes, size_t offset);
+extern const char *find_search_candidate(const char *str, unsigned char c1, unsigned char c2);
 extern const char *utf8_nstrstr(const char *haystack, const char *needle);
 extern const char *utf8_nstrstr_with_sizes(const char *haystack, int haystack_size, const char *needle, int needle_size);
 extern const char *utf8_nstrstr_ignore_lower_case(const char *haystack, const char *needle);